@@ -0,0 +1,556 @@
+/**
+ * @file align.cpp Windowed, beam-pruned forced alignment
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "align.h"
+#include "state_align_search.h"
+
+/* Frames between two tracebacks of the windowed search */
+#define ALIGN_CHUNK_FRAMES 200
+/* Samples given to the front end at once */
+#define ALIGN_BLOCK_SAMPLES 2048
+/* Frames given to the front end at once */
+#define ALIGN_BLOCK_FRAMES 16
+
+namespace {
+
+/* A path entering a phone. Entries only point back, so the ones
+   no active state leads to are dropped by the traceback. */
+struct PhoneEntry {
+    int32 phone;
+    int32 frame;
+    int32 prev;
+    int64_t score; // path score on entry, without normalization
+};
+
+struct WindowAlignSearch {
+    ps_search_t base;
+    hmm_context_t *hmmctx;
+    hmm_t *hmms;
+    int n_phones;
+    int window;
+    int32 beam;
+    // Phones searched, all others are inactive
+    int lo, hi;
+    // Last frame searched
+    int frame;
+    // Sum of the best scores taken out by normalization
+    int64_t offset;
+    std::vector<PhoneEntry> entries;
+    size_t peak_entries;
+    // Per phone, its word, and where it was placed
+    std::vector<int> phone_word;
+    std::vector<int32> start, score;
+    // Per word, its id and first phone
+    std::vector<s3wid_t> word_id;
+    std::vector<int> word_phone;
+    // Whether the last phone was reached, otherwise the last phone
+    // placed on the best path
+    bool complete;
+    int reached;
+};
+
+}
+
+static WindowAlignSearch *window_align(ps_search_t *search) {
+    return reinterpret_cast<WindowAlignSearch *>(search);
+}
+
+static int window_align_start(ps_search_t *search) {
+    WindowAlignSearch *was = window_align(search);
+    for (int i = 0; i < was->n_phones; ++i)
+        hmm_clear(&was->hmms[i]);
+    was->entries.clear();
+    PhoneEntry root = {0, 0, -1, 0};
+    was->entries.push_back(root);
+    was->peak_entries = 1;
+    hmm_enter(&was->hmms[0], 0, 0, 0);
+    was->lo = was->hi = 0;
+    was->frame = -1;
+    was->offset = 0;
+    was->start.assign(was->n_phones, 0);
+    was->score.assign(was->n_phones, 0);
+    was->complete = false;
+    was->reached = 0;
+    return 0;
+}
+
+// Follows an entry back until a path already marked
+static void mark_path(WindowAlignSearch *was, int e, std::vector<char>& live,
+                      std::vector<int>& refs, std::vector<int>& child) {
+    while ((e >= 0) && !live[e]) {
+        live[e] = 1;
+        int prev = was->entries[e].prev;
+        if (prev >= 0) {
+            refs[prev]++;
+            child[prev] = e;
+        }
+        e = prev;
+    }
+}
+
+/*
+ * Places the phones that all active paths go through, and drops
+ * the entries that no active path goes through. What is kept is the
+ * part of the path the window has not settled yet, so it stays
+ * bounded by the window whatever the length of the sentence.
+ */
+static void window_align_traceback(WindowAlignSearch *was) {
+    int nf = was->frame + 1;
+    size_t n = was->entries.size();
+    std::vector<char> live(n, 0), held(n, 0);
+    std::vector<int> refs(n, 0), child(n, -1);
+    int i, j;
+    for (i = was->lo; i <= was->hi; ++i) {
+        hmm_t *hmm = &was->hmms[i];
+        if (hmm_frame(hmm) != nf) continue;
+        for (j = 0; j < hmm_n_emit_state(hmm); ++j) {
+            int e = hmm_history(hmm, j);
+            if ((hmm_score(hmm, j) <= WORST_SCORE) || (e < 0) || (e >= (int) n)) continue;
+            held[e] = 1;
+            mark_path(was, e, live, refs, child);
+        }
+        int e = hmm_out_history(hmm);
+        if ((hmm_out_score(hmm) > WORST_SCORE) && (e >= 0) && (e < (int) n)) {
+            held[e] = 1;
+            mark_path(was, e, live, refs, child);
+        }
+    }
+    if (!live[0]) return;
+
+    // The root leads to a single entry until the paths part
+    int e = 0;
+    while ((refs[e] == 1) && !held[e]) {
+        int c = child[e];
+        PhoneEntry& entry = was->entries[e];
+        was->start[entry.phone] = entry.frame;
+        was->score[entry.phone] = (int32) (was->entries[c].score - entry.score);
+        live[e] = 0;
+        was->entries[c].prev = -1;
+        e = c;
+    }
+
+    // Entries are after the ones they point to, so compacting in
+    // order keeps the root first
+    std::vector<int> remap(n, -1);
+    size_t kept = 0;
+    for (size_t k = 0; k < n; ++k) {
+        if (!live[k]) continue;
+        PhoneEntry entry = was->entries[k];
+        if (entry.prev >= 0) entry.prev = remap[entry.prev];
+        remap[k] = kept;
+        was->entries[kept++] = entry;
+    }
+    was->entries.resize(kept);
+    for (i = was->lo; i <= was->hi; ++i) {
+        hmm_t *hmm = &was->hmms[i];
+        if (hmm_frame(hmm) != nf) continue;
+        for (j = 0; j < hmm_n_emit_state(hmm); ++j) {
+            int h = hmm_history(hmm, j);
+            hmm_history(hmm, j) = ((h >= 0) && (h < (int) n)) ? remap[h] : -1;
+        }
+        int h = hmm_out_history(hmm);
+        hmm_out_history(hmm) = ((h >= 0) && (h < (int) n)) ? remap[h] : -1;
+    }
+}
+
+static int window_align_step(ps_search_t *search, int frame_idx) {
+    WindowAlignSearch *was = window_align(search);
+    acmod_t *acmod = ps_search_acmod(search);
+    int16 const *senscr;
+    int32 best = WORST_SCORE;
+    int i, best_phone = -1, lo = -1, hi = -1, nf = frame_idx + 1;
+
+    was->frame = frame_idx;
+    acmod_clear_active(acmod);
+    for (i = was->lo; i <= was->hi; ++i)
+        if (hmm_frame(&was->hmms[i]) == frame_idx)
+            acmod_activate_hmm(acmod, &was->hmms[i]);
+    senscr = acmod_score(acmod, &frame_idx);
+    hmm_context_set_senscore(was->hmmctx, senscr);
+
+    for (i = was->lo; i <= was->hi; ++i) {
+        hmm_t *hmm = &was->hmms[i];
+        if (hmm_frame(hmm) != frame_idx) continue;
+        int32 s = hmm_vit_eval(hmm);
+        if (s > best) {
+            best = s;
+            best_phone = i;
+        }
+    }
+    // The path was lost, finish reports it
+    if (best_phone < 0) return 0;
+
+    // Beam and window around the best phone
+    for (i = was->lo; i <= was->hi; ++i) {
+        hmm_t *hmm = &was->hmms[i];
+        if (hmm_frame(hmm) != frame_idx) continue;
+        if ((hmm_bestscore(hmm) < best + was->beam)
+            || (i < best_phone - was->window) || (i > best_phone + was->window)) {
+            hmm_clear(hmm);
+            continue;
+        }
+        hmm_frame(hmm) = nf;
+        if (lo < 0) lo = i;
+        hi = i;
+    }
+
+    // Phone transitions, each recorded as an entry
+    int last = hi;
+    for (i = lo; i <= hi; ++i) {
+        hmm_t *hmm = &was->hmms[i];
+        if ((hmm_frame(hmm) != nf) || (i + 1 >= was->n_phones) || (i + 1 > best_phone + was->window))
+            continue;
+        int32 out = hmm_out_score(hmm);
+        hmm_t *next = &was->hmms[i + 1];
+        if ((out < best + was->beam) || ((hmm_frame(next) == nf) && (out <= hmm_in_score(next))))
+            continue;
+        PhoneEntry entry = {i + 1, nf, hmm_out_history(hmm), out + was->offset};
+        was->entries.push_back(entry);
+        hmm_enter(next, out, was->entries.size() - 1, nf);
+        if (i + 1 > last) last = i + 1;
+    }
+    was->lo = lo;
+    was->hi = last;
+
+    for (i = was->lo; i <= was->hi; ++i)
+        if (hmm_frame(&was->hmms[i]) == nf)
+            hmm_normalize(&was->hmms[i], best);
+    was->offset += best;
+
+    was->peak_entries = std::max(was->peak_entries, was->entries.size());
+    if (nf % ALIGN_CHUNK_FRAMES == 0)
+        window_align_traceback(was);
+    return 0;
+}
+
+// Places the phones of the path ending with the given entry
+static void window_align_backtrace(WindowAlignSearch *was, int e, int64_t end_score) {
+    while ((e >= 0) && (e < (int) was->entries.size())) {
+        PhoneEntry& entry = was->entries[e];
+        was->start[entry.phone] = entry.frame;
+        was->score[entry.phone] = (int32) (end_score - entry.score);
+        end_score = entry.score;
+        e = entry.prev;
+    }
+}
+
+static int window_align_finish(ps_search_t *search) {
+    WindowAlignSearch *was = window_align(search);
+    int nf = was->frame + 1, i, j;
+    hmm_t *final_phone = &was->hmms[was->n_phones - 1];
+
+    window_align_traceback(was);
+    was->complete = (nf > 0) && (hmm_frame(final_phone) == nf)
+        && (hmm_out_score(final_phone) > WORST_SCORE);
+    if (was->complete) {
+        window_align_backtrace(was, hmm_out_history(final_phone),
+                               hmm_out_score(final_phone) + was->offset);
+        was->reached = was->n_phones - 1;
+    }
+    else {
+        // The best state still active, or the root if there is none
+        int32 best = WORST_SCORE;
+        int best_entry = 0;
+        was->reached = was->entries.empty() ? 0 : was->entries[0].phone;
+        for (i = was->lo; (nf > 0) && (i <= was->hi); ++i) {
+            hmm_t *hmm = &was->hmms[i];
+            if (hmm_frame(hmm) != nf) continue;
+            for (j = 0; j < hmm_n_emit_state(hmm); ++j) {
+                if ((hmm_score(hmm, j) > best) && (hmm_history(hmm, j) >= 0)) {
+                    best = hmm_score(hmm, j);
+                    best_entry = hmm_history(hmm, j);
+                    was->reached = i;
+                }
+            }
+        }
+        if (!was->entries.empty())
+            window_align_backtrace(was, best_entry, best + was->offset);
+    }
+    E_INFO("window_align: %d frames, %d phones, at most %u path entries%s\n",
+           nf, was->n_phones, (unsigned) was->peak_entries,
+           was->complete ? "" : ", path lost");
+    return 0;
+}
+
+static int window_align_reinit(ps_search_t *, dict_t *, dict2pid_t *) {
+    return 0;
+}
+
+static void window_align_free(ps_search_t *search) {
+    WindowAlignSearch *was = window_align(search);
+    ps_search_base_free(search);
+    for (int i = 0; i < was->n_phones; ++i)
+        hmm_deinit(&was->hmms[i]);
+    hmm_context_free(was->hmmctx);
+    delete[] was->hmms;
+    delete was;
+}
+
+static char const *window_align_hyp(ps_search_t *, int32 *) {
+    return NULL;
+}
+
+static ps_searchfuncs_t window_align_funcs = {
+    /* start: */  window_align_start,
+    /* step: */   window_align_step,
+    /* finish: */ window_align_finish,
+    /* reinit: */ window_align_reinit,
+    /* free: */   window_align_free,
+    /* lattice: */  NULL,
+    /* hyp: */      window_align_hyp,
+    /* prob: */     NULL,
+    /* seg_iter: */ NULL,
+};
+
+static ps_search_t *window_align_init(ps_decoder_t *ps, ps_alignment_t *al, int window) {
+    acmod_t *acmod = ps->acmod;
+    ps_alignment_iter_t *itor;
+    ps_alignment_entry_t *ae;
+    int i;
+
+    WindowAlignSearch *was = new WindowAlignSearch();
+    ps_search_init(&was->base, &window_align_funcs, "window_align", "window_align",
+                   ps->config, acmod, ps->dict, ps->d2p);
+    was->hmmctx = hmm_context_init(bin_mdef_n_emit_state(acmod->mdef),
+                                   acmod->tmat->tp, NULL, acmod->mdef->sseq);
+    was->window = window;
+    was->beam = logmath_log(acmod->lmath, cmd_ln_float64_r(ps->config, "-align_beam")) >> SENSCR_SHIFT;
+    was->n_phones = ps_alignment_n_phones(al);
+    was->hmms = new hmm_t[was->n_phones];
+    for (i = 0, itor = ps_alignment_phones(al); itor; ++i, itor = ps_alignment_iter_next(itor)) {
+        ae = ps_alignment_iter_get(itor);
+        hmm_init(was->hmmctx, &was->hmms[i], FALSE, ae->id.pid.ssid, ae->id.pid.tmatid);
+        was->phone_word.push_back(ae->parent);
+    }
+    for (itor = ps_alignment_words(al); itor; itor = ps_alignment_iter_next(itor))
+        was->word_id.push_back(ps_alignment_iter_get(itor)->id.wid);
+    was->word_phone.assign(was->word_id.size(), 0);
+    for (i = was->n_phones - 1; i >= 0; --i)
+        was->word_phone[was->phone_word[i]] = i;
+    return &was->base;
+}
+
+// Searches the frames the acoustic model has ready, returns how many
+static int feed_ready(acmod_t *acmod, ps_search_t *search) {
+    int n = 0;
+    while (acmod->n_feat_frame > 0) {
+        ps_search_step(search, acmod->output_frame);
+        acmod_advance(acmod);
+        n++;
+    }
+    return n;
+}
+
+// Gives the input of an utterance to the front end, audio if not
+// NULL, frames otherwise, until about max_frames frames were
+// searched, or until its end if max_frames is 0. Returns whether
+// all of it was given. Frames are given through a copy, since the
+// front end normalizes them in place, and they may be stored
+// frames that are aligned again later.
+static bool feed_input(acmod_t *acmod, ps_search_t *search, const int16 **audio, size_t *n_samples,
+                       mfcc_t ***frames, int *n_frames, int max_frames) {
+    int searched = 0;
+    int ncep = feat_cepsize(acmod->fcb);
+    std::vector<mfcc_t> cep;
+    mfcc_t *rows[ALIGN_BLOCK_FRAMES];
+    while ((max_frames <= 0) || (searched < max_frames)) {
+        if (*audio && (*n_samples > 0)) {
+            size_t nread = std::min(*n_samples, (size_t) ALIGN_BLOCK_SAMPLES);
+            int16 const *bptr = *audio;
+            *audio += nread;
+            *n_samples -= nread;
+            while (acmod_process_raw(acmod, &bptr, &nread, FALSE) > 0)
+                searched += feed_ready(acmod, search);
+        }
+        else if ((*audio == NULL) && (*n_frames > 0)) {
+            int nfr = std::min(*n_frames, ALIGN_BLOCK_FRAMES);
+            cep.resize(ALIGN_BLOCK_FRAMES * ncep);
+            for (int i = 0; i < nfr; ++i) {
+                rows[i] = &cep[i * ncep];
+                memcpy(rows[i], (*frames)[i], ncep * sizeof(mfcc_t));
+            }
+            *frames += nfr;
+            *n_frames -= nfr;
+            mfcc_t **bptr = rows;
+            while (acmod_process_cep(acmod, &bptr, &nfr, FALSE) > 0)
+                searched += feed_ready(acmod, search);
+        }
+        else
+            return true;
+    }
+    return false;
+}
+
+static void feed_end(acmod_t *acmod, ps_search_t *search) {
+    acmod_end_utt(acmod);
+    // Frames completed by the end of the utterance
+    feed_ready(acmod, search);
+    ps_search_finish(search);
+}
+
+// Runs a search over an utterance
+static void align_feed(acmod_t *acmod, ps_search_t *search, const int16 *audio, size_t n_samples,
+                       mfcc_t **frames, int n_frames) {
+    acmod_start_utt(acmod);
+    ps_search_start(search);
+    feed_input(acmod, search, &audio, &n_samples, &frames, &n_frames, 0);
+    feed_end(acmod, search);
+}
+
+// Aligns again over all their states the words from the one where
+// the window lost the path
+static void window_align_recover(ps_decoder_t *ps, WindowAlignSearch *was,
+                                 const int16 *audio, size_t n_samples,
+                                 mfcc_t **frames, int n_frames) {
+    int word = was->phone_word[was->reached];
+    int first = was->word_phone[word];
+    int from = was->start[first];
+    int i, w;
+    E_INFO("window_align: realigning %d words from frame %d over all states\n",
+           (int) was->word_id.size() - word, from);
+
+    ps_alignment_t *tail = ps_alignment_init(ps->d2p);
+    for (w = word; w < was->word_id.size(); ++w)
+        ps_alignment_add_word(tail, was->word_id[w], 0);
+    ps_alignment_populate(tail);
+    ps_search_t *search = state_align_search_init("state_align", ps->config, ps->acmod, tail);
+    if (search == NULL) {
+        ps_alignment_free(tail);
+        return;
+    }
+    if (audio) {
+        size_t shift = (size_t) (cmd_ln_float32_r(ps->config, "-samprate")
+                                 / cmd_ln_int32_r(ps->config, "-frate"));
+        size_t skip = std::min(n_samples, from * shift);
+        align_feed(ps->acmod, search, audio + skip, n_samples - skip, NULL, 0);
+    }
+    else
+        align_feed(ps->acmod, search, NULL, 0, frames + from, std::max(n_frames - from, 0));
+
+    ps_alignment_iter_t *itor;
+    for (i = first, itor = ps_alignment_phones(tail); itor && (i < was->n_phones);
+         ++i, itor = ps_alignment_iter_next(itor)) {
+        ps_alignment_entry_t *ae = ps_alignment_iter_get(itor);
+        was->start[i] = from + ae->start;
+        was->score[i] = ae->score;
+    }
+    if (itor) ps_alignment_iter_free(itor);
+    ps_search_free(search);
+    ps_alignment_free(tail);
+}
+
+// Copies the placed phones to the alignment, and the words from them
+static void window_align_write(WindowAlignSearch *was, ps_alignment_t *al, int n_frames) {
+    std::vector<ps_alignment_entry_t *> words;
+    ps_alignment_iter_t *itor;
+    int i;
+    for (itor = ps_alignment_words(al); itor; itor = ps_alignment_iter_next(itor)) {
+        ps_alignment_entry_t *ae = ps_alignment_iter_get(itor);
+        ae->start = -1;
+        ae->duration = 0;
+        ae->score = 0;
+        words.push_back(ae);
+    }
+    for (i = 1; i < was->n_phones; ++i)
+        was->start[i] = std::max(was->start[i], was->start[i - 1]);
+    for (i = 0, itor = ps_alignment_phones(al); itor; ++i, itor = ps_alignment_iter_next(itor)) {
+        ps_alignment_entry_t *ae = ps_alignment_iter_get(itor);
+        int end = (i + 1 < was->n_phones) ? was->start[i + 1] : n_frames;
+        ae->start = was->start[i];
+        ae->duration = std::max(end - ae->start, 0);
+        ae->score = was->score[i];
+        ps_alignment_entry_t *word = words[ae->parent];
+        if (word->start < 0) word->start = ae->start;
+        word->duration += ae->duration;
+        word->score += ae->score;
+    }
+}
+
+AlignJob::AlignJob(): ps(NULL), al(NULL), search(NULL), windowed(false), finished(false),
+                     audio(NULL), n_samples(0), frames(NULL), n_frames(0),
+                     audio_left(NULL), samples_left(0), frames_left(NULL), n_frames_left(0) {
+}
+
+AlignJob::~AlignJob() {
+    reset();
+}
+
+int AlignJob::start(ps_decoder_t *ps, ps_alignment_t *al, const int16 *audio, size_t n_samples,
+                    mfcc_t **frames, int n_frames) {
+    reset();
+    int window = cmd_ln_exists_r(ps->config, "-align_window")
+        ? cmd_ln_int32_r(ps->config, "-align_window") : 0;
+    windowed = (window > 0) && (ps_alignment_n_phones(al) > 0);
+    if (windowed)
+        search = window_align_init(ps, al, window);
+    else
+        search = state_align_search_init("state_align", ps->config, ps->acmod, al);
+    if (search == NULL) return -1;
+    this->ps = ps;
+    this->al = al;
+    this->audio = audio_left = audio;
+    this->n_samples = samples_left = n_samples;
+    this->frames = frames_left = frames;
+    this->n_frames = n_frames_left = n_frames;
+    acmod_start_utt(ps->acmod);
+    ps_search_start(search);
+    return 0;
+}
+
+int AlignJob::step(int max_frames) {
+    if (search == NULL) return -1;
+    if (finished) return 1;
+    if (!feed_input(ps->acmod, search, &audio_left, &samples_left, &frames_left, &n_frames_left, max_frames))
+        return 0;
+    feed_end(ps->acmod, search);
+    if (windowed) {
+        // The recovery, if needed, is part of the last step
+        WindowAlignSearch *was = window_align(search);
+        if (!was->complete)
+            window_align_recover(ps, was, audio, n_samples, frames, n_frames);
+        window_align_write(was, al, was->frame + 1);
+    }
+    finished = true;
+    return 1;
+}
+
+float AlignJob::progress() const {
+    if (finished) return 1;
+    if (audio)
+        return (n_samples > 0) ? (float) (n_samples - samples_left) / n_samples : 0;
+    return (n_frames > 0) ? (float) (n_frames - n_frames_left) / n_frames : 0;
+}
+
+ps_search_t *AlignJob::release() {
+    ps_search_t *result = search;
+    search = NULL;
+    reset();
+    return result;
+}
+
+void AlignJob::reset() {
+    if (search) ps_search_free(search);
+    search = NULL;
+    ps = NULL;
+    al = NULL;
+    windowed = finished = false;
+    audio = audio_left = NULL;
+    n_samples = samples_left = 0;
+    frames = frames_left = NULL;
+    n_frames = n_frames_left = 0;
+}
+
+ps_search_t *align_utterance(ps_decoder_t *ps, ps_alignment_t *al,
+                             const int16 *audio, size_t n_samples,
+                             mfcc_t **frames, int n_frames) {
+    AlignJob job;
+    if (job.start(ps, al, audio, n_samples, frames, n_frames) < 0) return NULL;
+    job.step(0);
+    return job.release();
+}
@@ -0,0 +1,80 @@
+/**
+ * @file align.h Forced alignment of a sentence on an utterance
+ */
+
+#ifndef __ALIGN_H__
+#define __ALIGN_H__
+
+#include <stddef.h>
+
+#include "pocketsphinx.h"
+#include "ps_alignment.h"
+#include "pocketsphinx_internal.h"
+#include "ps_search.h"
+
+/**
+ * Aligns the words of a populated alignment on an utterance, given
+ * either as audio or, when audio is NULL, as cepstral frames.
+ *
+ * With "-align_window" set, only the phones within that many phones
+ * of the best one, and within "-align_beam" of its score, are
+ * searched, and the path is traced back as it settles, so time and
+ * memory follow the window instead of the sentence. If the window
+ * loses the path, the words from the one where it was lost are
+ * aligned again over all their states. Otherwise the whole sentence
+ * is searched by state_align_search.
+ *
+ * @return the search, to free with ps_search_free once the
+ *         alignment is read, NULL if it could not be created
+ */
+ps_search_t *align_utterance(ps_decoder_t *ps, ps_alignment_t *al,
+                             const int16 *audio, size_t n_samples,
+                             mfcc_t **frames, int n_frames);
+
+/**
+ * The same alignment a slice of the utterance at a time, so that
+ * it can be interleaved with other work. The decoder must not be
+ * used for anything else, and the alignment, audio or frames must
+ * stay in place, until the job is done.
+ */
+class AlignJob {
+public:
+    AlignJob();
+    ~AlignJob();
+    /** Returns -1 if the search could not be created. */
+    int start(ps_decoder_t *ps, ps_alignment_t *al, const int16 *audio, size_t n_samples,
+              mfcc_t **frames, int n_frames);
+    /**
+     * Searches about max_frames more frames, all of them if 0.
+     *
+     * @return 1 once the alignment is written, 0 if there is more
+     *         to search, -1 if the job was not started
+     */
+    int step(int max_frames);
+    bool done() const { return finished; }
+    /** Share of the utterance searched, from 0 to 1. */
+    float progress() const;
+    /** Hands the search over, as align_utterance returns it. */
+    ps_search_t *release();
+    /** Drops the job and its search. */
+    void reset();
+private:
+    AlignJob(const AlignJob&);
+    AlignJob& operator=(const AlignJob&);
+    ps_decoder_t *ps;
+    ps_alignment_t *al;
+    ps_search_t *search;
+    bool windowed;
+    bool finished;
+    // The whole utterance, and what is left of it to search
+    const int16 *audio;
+    size_t n_samples;
+    mfcc_t **frames;
+    int n_frames;
+    const int16 *audio_left;
+    size_t samples_left;
+    mfcc_t **frames_left;
+    int n_frames_left;
+};
+
+#endif /* __ALIGN_H__ */
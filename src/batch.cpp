@@ -0,0 +1,203 @@
+/**
+ * @file batch.cpp Offline batch transcription over several decoders
+ */
+
+#include <algorithm>
+#include <deque>
+
+#include "batch.h"
+#include "clock.h"
+#include "sbthread.h"
+
+/* Cut points are searched this far around the nominal chunk end,
+   in 10ms steps */
+#define CUT_SEARCH (16000 / 2)
+#define CUT_STEP 160
+
+typedef struct chunk {
+    int clip;
+    size_t start, end;
+    std::string hyp;
+    double elapsed;
+    int failed;
+} chunk;
+
+typedef struct worker {
+    ps_decoder_t *ps;
+    std::deque<int> queue;
+    sbmtx_t *mtx;
+    struct scheduler *sched;
+} worker;
+
+typedef struct scheduler {
+    const AudioBuffers *clips;
+    std::vector<chunk> chunks;
+    std::vector<worker> workers;
+} scheduler;
+
+// Energy of the 10ms window starting at the given sample
+static double window_energy(const std::vector<int16_t>& audio, size_t start) {
+    double e = 0;
+    for (size_t i = start; (i < start + CUT_STEP) && (i < audio.size()); i++)
+        e += (double) audio[i] * audio[i];
+    return e;
+}
+
+// Splits one clip in chunks of about max_chunk samples, cutting at
+// the quietest 10ms window near each nominal boundary
+static void split_clip(scheduler *s, int clip, size_t max_chunk) {
+    const std::vector<int16_t>& audio = (*s->clips)[clip];
+    size_t start = 0;
+    while (start < audio.size()) {
+        size_t end = audio.size();
+        if (audio.size() - start > max_chunk + CUT_SEARCH) {
+            size_t nominal = start + max_chunk, best = nominal;
+            double best_e = -1;
+            for (size_t c = nominal - CUT_SEARCH; c <= nominal + CUT_SEARCH; c += CUT_STEP) {
+                double e = window_energy(audio, c);
+                if ((best_e < 0) || (e < best_e)) {
+                    best_e = e;
+                    best = c + CUT_STEP / 2;
+                }
+            }
+            end = best;
+        }
+        chunk c;
+        c.clip = clip;
+        c.start = start;
+        c.end = end;
+        c.elapsed = 0;
+        c.failed = 0;
+        s->chunks.push_back(c);
+        start = end;
+    }
+}
+
+static int decode_chunk(ps_decoder_t *ps, const AudioBuffers& clips, chunk *c) {
+    const std::vector<int16_t>& audio = clips[c->clip];
+    double t = clock_ms();
+    if ((ps_start_utt(ps) < 0)
+        || (ps_process_raw(ps, (const int16 *) &audio[c->start], c->end - c->start, FALSE, TRUE) < 0)
+        || (ps_end_utt(ps) < 0)) {
+        c->failed = 1;
+    } else {
+        const char *h = ps_get_hyp(ps, NULL);
+        c->hyp = (h == NULL) ? "" : h;
+    }
+    c->elapsed = clock_ms() - t;
+    return c->failed ? -1 : 0;
+}
+
+// Takes the next chunk for worker w, from its own queue first and
+// otherwise from the back of the longest other queue
+static int next_chunk(scheduler *s, int w) {
+    int id = -1;
+    worker *self = &s->workers[w];
+    sbmtx_lock(self->mtx);
+    if (!self->queue.empty()) {
+        id = self->queue.front();
+        self->queue.pop_front();
+    }
+    sbmtx_unlock(self->mtx);
+    while (id < 0) {
+        size_t longest = 0;
+        int victim = -1;
+        for (size_t v = 0; v < s->workers.size(); v++) {
+            if ((int) v == w) continue;
+            sbmtx_lock(s->workers[v].mtx);
+            if (s->workers[v].queue.size() > longest) {
+                longest = s->workers[v].queue.size();
+                victim = v;
+            }
+            sbmtx_unlock(s->workers[v].mtx);
+        }
+        if (victim < 0) break;
+        sbmtx_lock(s->workers[victim].mtx);
+        if (!s->workers[victim].queue.empty()) {
+            id = s->workers[victim].queue.back();
+            s->workers[victim].queue.pop_back();
+        }
+        sbmtx_unlock(s->workers[victim].mtx);
+    }
+    return id;
+}
+
+static int worker_main(sbthread_t *th) {
+    worker *self = (worker *) sbthread_arg(th);
+    scheduler *s = self->sched;
+    int w = self - &s->workers[0];
+    int id;
+    while ((id = next_chunk(s, w)) >= 0)
+        decode_chunk(self->ps, *s->clips, &s->chunks[id]);
+    return 0;
+}
+
+struct longer_chunk {
+    const std::vector<chunk> *chunks;
+    bool operator()(int a, int b) const {
+        return ((*chunks)[a].end - (*chunks)[a].start) > ((*chunks)[b].end - (*chunks)[b].start);
+    }
+};
+
+int batch_transcribe(std::vector<ps_decoder_t *>& decoders, const AudioBuffers& clips,
+                     BatchResults& results, size_t max_chunk) {
+    scheduler s;
+    size_t i;
+    int rv = 0;
+
+    s.clips = &clips;
+    for (i = 0; i < clips.size(); i++)
+        split_clip(&s, i, max_chunk);
+
+    // Longest chunks first, dealt round robin, so that the tail of
+    // the batch is made of short chunks that balance well
+    std::vector<int> order;
+    for (i = 0; i < s.chunks.size(); i++)
+        order.push_back(i);
+    longer_chunk cmp;
+    cmp.chunks = &s.chunks;
+    std::stable_sort(order.begin(), order.end(), cmp);
+
+    s.workers.resize(decoders.size());
+    for (i = 0; i < decoders.size(); i++) {
+        s.workers[i].ps = decoders[i];
+        s.workers[i].mtx = sbmtx_init();
+        s.workers[i].sched = &s;
+    }
+    for (i = 0; i < order.size(); i++)
+        s.workers[i % decoders.size()].queue.push_back(order[i]);
+
+    std::vector<sbthread_t *> threads;
+    for (i = 1; i < decoders.size(); i++) {
+        sbthread_t *th = sbthread_start(NULL, worker_main, &s.workers[i]);
+        if (th) threads.push_back(th);
+    }
+    // The calling thread is the first worker, and it steals whatever
+    // is left by workers that could not be started
+    int id;
+    while ((id = next_chunk(&s, 0)) >= 0)
+        decode_chunk(s.workers[0].ps, clips, &s.chunks[id]);
+    for (i = 0; i < threads.size(); i++) {
+        sbthread_wait(threads[i]);
+        sbthread_free(threads[i]);
+    }
+    for (i = 0; i < s.workers.size(); i++)
+        sbmtx_free(s.workers[i].mtx);
+
+    results.assign(clips.size(), BatchItem());
+    for (i = 0; i < clips.size(); i++) {
+        results[i].seconds = clips[i].size() / 16000.0;
+        results[i].elapsedMs = 0;
+        results[i].chunks = 0;
+    }
+    for (i = 0; i < s.chunks.size(); i++) {
+        BatchItem& item = results[s.chunks[i].clip];
+        if (s.chunks[i].failed) rv = -1;
+        if ((item.hyp.size() > 0) && (s.chunks[i].hyp.size() > 0))
+            item.hyp += " ";
+        item.hyp += s.chunks[i].hyp;
+        item.elapsedMs += s.chunks[i].elapsed;
+        item.chunks++;
+    }
+    return rv;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file batch.h Offline batch transcription over several decoders
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "pocketsphinx.h"
+
+/* Clips longer than this are split, at a quiet point, into chunks
+   that are scheduled independently */
+#define BATCH_MAX_CHUNK (10 * 16000)
+
+struct BatchItem {
+    std::string hyp;
+    float seconds;   /**< Duration of the clip */
+    float elapsedMs; /**< Decoding time summed over its chunks */
+    int chunks;
+};
+
+typedef std::vector<BatchItem> BatchResults;
+typedef std::vector<std::vector<int16_t> > AudioBuffers;
+
+/**
+ * Transcribes the clips with the given decoders, one worker thread
+ * per decoder, each decoder having the search to use selected.
+ * Chunks are dealt longest first to per-worker queues, and idle
+ * workers steal from the back of the busiest queue. Results are in
+ * input order. If threads are not available, the calling thread
+ * does all the work.
+ *
+ * @return 0 on success, -1 if any chunk failed to decode
+ */
+int batch_transcribe(std::vector<ps_decoder_t *>& decoders, const AudioBuffers& clips,
+                     BatchResults& results, size_t max_chunk);
+
+#endif /* __BATCH_H__ */
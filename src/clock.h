@@ -0,0 +1,24 @@
+/**
+ * @file clock.h Monotonic wall clock in milliseconds
+ */
+
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#else
+#include <time.h>
+#endif
+
+static inline double clock_ms(void) {
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+#endif
+}
+
+#endif /* __CLOCK_H__ */
@@ -0,0 +1,74 @@
+/**
+ * @file continuous.cpp Utterance rollover for always-on listening
+ */
+
+#include "continuous.h"
+
+/* A frame is quiet when its energy is within this factor of the
+   noise floor, which follows quiet frames down right away and
+   louder ones up slowly */
+#define QUIET_RATIO 4.0
+#define FLOOR_RISE 1.002
+/* Mean squared amplitude below which any frame is quiet */
+#define QUIET_MIN 100.0
+
+RolloverController::RolloverController(): max_frames(0), silence_frames(0), overlap_samples(0),
+                                          frame_samples(160), utt_samples(0), quiet_frames(0),
+                                          speech(false), forced(false), floor(0), window(0),
+                                          window_fill(0) {}
+
+void RolloverController::configure(int max, int silence, int overlap) {
+    max_frames = max;
+    silence_frames = silence;
+    overlap_samples = overlap * frame_samples;
+    floor = 0;
+    tail.clear();
+    tail.reserve(overlap_samples);
+    reset();
+}
+
+void RolloverController::reset() {
+    utt_samples = 0;
+    quiet_frames = 0;
+    speech = false;
+    window = 0;
+    window_fill = 0;
+}
+
+bool RolloverController::update(const int16_t *samples, size_t n) {
+    if (!enabled()) return false;
+    for (size_t i = 0; i < n; i++) {
+        window += (double) samples[i] * samples[i];
+        if (++window_fill < frame_samples) continue;
+        double e = window / frame_samples;
+        if ((floor == 0) || (e < floor)) floor = e;
+        else floor *= FLOOR_RISE;
+        if ((e < QUIET_MIN) || (e < QUIET_RATIO * floor)) {
+            quiet_frames++;
+        } else {
+            quiet_frames = 0;
+            speech = true;
+        }
+        window = 0;
+        window_fill = 0;
+    }
+    // The tail keeps the last overlap_samples samples, in order
+    if (n >= (size_t) overlap_samples) {
+        tail.assign(samples + n - overlap_samples, samples + n);
+    } else {
+        size_t keep = overlap_samples - n;
+        if (tail.size() > keep) tail.erase(tail.begin(), tail.end() - keep);
+        tail.insert(tail.end(), samples, samples + n);
+    }
+    utt_samples += n;
+    if (speech && (silence_frames > 0) && (quiet_frames >= silence_frames)) {
+        forced = false;
+        return true;
+    }
+    if (utt_samples >= (size_t) max_frames * frame_samples) {
+        // Nothing worth carrying over if the end was quiet
+        forced = speech && (quiet_frames * frame_samples < overlap_samples);
+        return true;
+    }
+    return false;
+}
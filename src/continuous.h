@@ -0,0 +1,64 @@
+/**
+ * @file continuous.h Utterance rollover for always-on listening
+ */
+
+#ifndef __CONTINUOUS_H__
+#define __CONTINUOUS_H__
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decides when a long running utterance should be ended and a new
+ * one started, from the audio given to process(): after a number
+ * of frames, or earlier after a run of quiet frames following
+ * speech. It keeps the last samples of audio so that a rollover
+ * forced in the middle of speech can feed them again to the next
+ * utterance.
+ */
+class RolloverController {
+public:
+    RolloverController();
+    /**
+     * @param max_frames roll over after this many frames, 0 to disable
+     * @param silence_frames roll over after this many quiet frames,
+     *                       0 to only roll over on max_frames
+     * @param overlap_frames audio fed again after a forced rollover
+     */
+    void configure(int max_frames, int silence_frames, int overlap_frames);
+    void setFrameSamples(int samples) { frame_samples = (samples > 0) ? samples : 160; }
+    bool enabled() const { return max_frames > 0; }
+    /** Starts counting from a new utterance. */
+    void reset();
+    /**
+     * Accounts for a buffer of audio given to the decoder.
+     *
+     * @return true if the utterance should roll over now
+     */
+    bool update(const int16_t *samples, size_t n);
+    /**
+     * Audio to feed the next utterance with, empty if the rollover
+     * happened in silence. Frames it holds are already in the
+     * utterance that ends.
+     */
+    const std::vector<int16_t>& overlap() const { return forced ? tail : empty; }
+    int overlapFrames() const { return forced ? tail.size() / frame_samples : 0; }
+
+private:
+    int max_frames;
+    int silence_frames;
+    int overlap_samples;
+    int frame_samples;
+    size_t utt_samples;
+    int quiet_frames;
+    bool speech;
+    bool forced;
+    double floor;
+    double window;
+    int window_fill;
+    std::vector<int16_t> tail;
+    std::vector<int16_t> empty;
+};
+
+#endif /* __CONTINUOUS_H__ */
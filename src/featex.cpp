@@ -3,10 +3,126 @@
  */
 
 #include "featex.h"
+#include "align.h"
 
-typedef struct alignment {
-	int start, dur, cipid, score;
-} alignment;
+#define ARENA_ALIGN 8
+#define GRAMMAR_SIZE 1000
+#define MAX_HYPS 256
+/* Share of the work of a job that goes to the alignment */
+#define ALIGN_SHARE 0.2f
+
+FeatexArena::FeatexArena(): block(NULL), size(0), used(0) {
+}
+
+FeatexArena::~FeatexArena() {
+    release();
+}
+
+void FeatexArena::reserve(size_t bytes) {
+    reset();
+    if (bytes <= size) return;
+    free(block);
+    block = (char *) malloc(bytes);
+    size = (block == NULL) ? 0 : bytes;
+}
+
+void *FeatexArena::alloc(size_t bytes) {
+    bytes = (bytes + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+    if (used + bytes <= size) {
+        void *p = block + used;
+        used += bytes;
+        return p;
+    }
+    // The reservation was too small, this chunk lives until reset()
+    void *p = malloc(bytes);
+    overflow.push_back(p);
+    return p;
+}
+
+void FeatexArena::rewind(size_t position) {
+    if (position <= used) used = position;
+}
+
+void FeatexArena::reset() {
+    for (size_t i = 0; i < overflow.size(); i++)
+        free(overflow[i]);
+    overflow.clear();
+    used = 0;
+}
+
+void FeatexArena::release() {
+    reset();
+    free(block);
+    block = NULL;
+    size = 0;
+}
+
+// Copies the window of audio starting at the given sample into the
+// middle of buf, with half a second of silence on each side
+static size_t fill_window(int16 *buf, const std::vector<int16_t>& buffer, size_t start, size_t nread) {
+    memset(buf, 0, sizeof(int16) * (nread + SAMPRATE));
+    for (size_t ii = SAMPRATE / 2, jj = start; (jj < start + nread) && (jj < buffer.size()); ii++, jj++)
+        buf[ii] = buffer[jj];
+    return nread + SAMPRATE;
+}
+
+// Appends a copy of a frame to the window
+static void add_window_frame(mfcc_t **rows, mfcc_t *cep, int ncep, int *n, const mfcc_t *frame) {
+    rows[*n] = cep + *n * ncep;
+    memcpy(rows[*n], frame, ncep * sizeof(mfcc_t));
+    (*n)++;
+}
+
+// Fills rows with copies, in cep, of the frames of the window
+// starting at the given frame, with pad silence frames on each
+// side, returns the number of rows. The front end normalizes the
+// rows in place, which must not change the frames nor the silence.
+static int fill_window_frames(mfcc_t **rows, mfcc_t *cep, int ncep, mfcc_t **frames, int n_frames,
+                              const mfcc_t *silence, int start, int nfr, int pad) {
+    int n = 0, i;
+    for (i = 0; i < pad; i++)
+        add_window_frame(rows, cep, ncep, &n, silence);
+    for (i = start; (i < start + nfr) && (i < n_frames); i++)
+        add_window_frame(rows, cep, ncep, &n, frames[i]);
+    for (i = 0; i < pad; i++)
+        add_window_frame(rows, cep, ncep, &n, silence);
+    return n;
+}
+
+void search_cep(acmod_t *acmod, ps_search_t *search, mfcc_t **frames, int n_frames) {
+    // Through a copy, for the same reason as the windows
+    int ncep = feat_cepsize(acmod->fcb);
+    std::vector<mfcc_t> cep(n_frames * ncep);
+    std::vector<mfcc_t *> rows(n_frames);
+    for (int i = 0; i < n_frames; i++) {
+        rows[i] = &cep[i * ncep];
+        memcpy(rows[i], frames[i], ncep * sizeof(mfcc_t));
+    }
+    mfcc_t **bptr = n_frames ? &rows[0] : NULL;
+    while (n_frames > 0) {
+        acmod_process_cep(acmod, &bptr, &n_frames, FALSE);
+        while (acmod->n_feat_frame > 0) {
+            ps_search_step(search, acmod->output_frame);
+            acmod_advance(acmod);
+        }
+    }
+}
+
+// Records hyp unless it was already seen in the current window,
+// returns whether it is new. Past MAX_HYPS, hypotheses could not
+// be told from those seen, so they are not counted
+static int hyp_add(const char **seen, int *nseen, const char *hyp, FeatexArena& arena) {
+    int i;
+    for (i = 0; i < *nseen; i++)
+        if (!strcmp(seen[i], hyp)) return 0;
+    if (*nseen >= MAX_HYPS) return 0;
+    char *copy = (char *) arena.alloc(strlen(hyp) + 1);
+    strcpy(copy, hyp);
+    seen[(*nseen)++] = copy;
+    if (*nseen == MAX_HYPS)
+        E_WARN("featex: %d distinct hypotheses in a window, the next ones are not counted\n", MAX_HYPS);
+    return 1;
+}
 
 template<typename Out>
 void split(const std::string &s, char delim, Out result) {
@@ -19,45 +135,43 @@ void split(const std::string &s, char delim, Out result) {
     }
 }
 
-Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::string& sentence) {
-
-	Feats feats;
-
-	dict_t *dict;
-    dict2pid_t *d2p;
-    acmod_t *acmod;
-    bin_mdef_t *mdef;
-    ps_alignment_t *al;
-    ps_alignment_iter_t *itor, *itor2;
-    ps_search_t *search;
-    ps_alignment_entry_t *ae;
-    ps_nbest_t *nb;
-    int32 score;
-    hash_table_t *hyptbl;
-    double frated;
-    int i, j, k, n, nwords, found, ii, jj, wend, maxdur, triphone_start;
-
-    char grammar[1000], target[10];
-    char *p, *q, *r; // string manipulation pointers for constructing grammar
-
-    size_t bufsize = 2048;
-
-    int16 buf[bufsize];
-    int16 *triphonebuf;
-    size_t nread;
-    int16 const *bptr;
-    int nfr;
-
-    alignment *algn;
+FeatexJob::FeatexJob(): stage(FEATEX_DONE), ps(NULL), input(NULL), frames(NULL), n_frames(0),
+                       silence(NULL), arena(NULL), phone_words(NULL), al(NULL), algn(NULL), n(0),
+                       phone(0), triphonebuf(NULL), windowrows(NULL), windowcep(NULL), ncep(0), pad(0), grammar(NULL),
+                       hyps(NULL), nhyps(0), hyps_mark(0) {
+}
 
-    frated = (double) FRATE;
+FeatexJob::~FeatexJob() {
+    reset();
+}
 
-    dict = ps->dict;
-    d2p = ps->d2p;
-    acmod = ps->acmod;
-    mdef = acmod->mdef;
+void FeatexJob::reset() {
+    align.reset();
+    if (al) ps_alignment_free(al);
+    al = NULL;
+    if (stage == FEATEX_PHONES) arena->reset();
+    stage = FEATEX_DONE;
+}
 
-    al = ps_alignment_init(d2p);
+// The audio input is used if given, the frames otherwise
+void FeatexJob::start(ps_decoder_t *ps, const std::vector<int16_t> *input, mfcc_t **frames, int n_frames,
+                      const mfcc_t *silence, const std::string& sentence, FeatexArena& arena,
+                      std::vector<int> *phone_words) {
+    reset();
+    feats.clear();
+    if (phone_words) phone_words->clear();
+    this->ps = ps;
+    this->input = input;
+    this->frames = frames;
+    this->n_frames = n_frames;
+    this->silence = silence;
+    this->arena = &arena;
+    this->phone_words = phone_words;
+
+    dict_t *dict = ps->dict;
+    int i, n, nwords;
+
+    al = ps_alignment_init(ps->d2p);
     ps_alignment_add_word(al, dict_wordid(dict, "<s>"), 0);
 
     std::vector<std::string> words;
@@ -77,52 +191,83 @@ Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::st
     ps_alignment_add_word(al, dict_wordid(dict, "</s>"), 0);
     ps_alignment_populate(al);
 
-    search = state_align_search_init("state_align", ps->config, acmod, al);
-
-    acmod_start_utt(acmod);
-    ps_search_start(search);
-
-    size_t arrsize = buffer.size();
-
-  	printf("Buffer size: %u\n", arrsize);
-
-    size_t start = 0, end = bufsize;
-
-    while (start < end && end <= arrsize) {
-	  	printf("start : %u, end : %u\n", start, end);
-
-    	memset(buf, 0, sizeof(int16) * bufsize);
-    	
-    	for (ii = start, jj = 0; ii < end; ii++, jj++) {
-    		buf[jj] = buffer[ii];
-    	}
-    	nread = end - start;
-    	bptr = buf; 
-        while ((nfr = acmod_process_raw(acmod, &bptr, &nread, FALSE)) > 0) {
-            while (acmod->n_feat_frame > 0) {
-                ps_search_step(search, acmod->output_frame);
-                acmod_advance(acmod);
-            }
-        	printf("processed %d frames\n", nfr);
-        }
+    const int16 *audio = (input && !input->empty()) ? &(*input)[0] : NULL;
+    if (align.start(ps, al, audio, input ? input->size() : 0, frames, n_frames) < 0) {
+        ps_alignment_free(al);
+        al = NULL;
+        return;
+    }
+    stage = FEATEX_ALIGN;
+}
 
-        start += bufsize;
-        end += bufsize;
-        if (end > arrsize) {
-        	end = arrsize;
-        }
+int FeatexJob::step(int align_frames) {
+    if (stage == FEATEX_ALIGN) {
+        if (align.step(align_frames) == 0) return 0;
+        preparePhones();
+    }
+    else if (stage == FEATEX_PHONES)
+        scorePhone(phone++);
+    if ((stage == FEATEX_PHONES) && (phone >= n)) {
+        // Single release of the scratch memory, the block itself
+        // is kept for the next call
+        arena->reset();
+        stage = FEATEX_DONE;
     }
+    return done() ? 1 : 0;
+}
 
-    acmod_end_utt(acmod);
-    ps_search_finish(search);
+float FeatexJob::progress() const {
+    if (stage == FEATEX_ALIGN) return ALIGN_SHARE * align.progress();
+    if (stage == FEATEX_PHONES) return ALIGN_SHARE + (1 - ALIGN_SHARE) * (phone - 1) / (n - 1);
+    return 1;
+}
+
+// Reads the phones of the alignment, and makes room for scoring them
+void FeatexJob::preparePhones() {
+    dict_t *dict = ps->dict;
+    bin_mdef_t *mdef = ps->acmod->mdef;
+    ps_alignment_iter_t *itor, *itor2;
+    ps_alignment_entry_t *ae;
+    double frated = (double) FRATE;
+    int i, wend, maxdur, nphones, word_index, nwinrows;
+    size_t nwin;
 
     printf("%s: aligned %d words, %d phones, and %d states\n",
         "featex.cpp", ps_alignment_n_words(al), ps_alignment_n_phones(al),
         ps_alignment_n_states(al));
 
 
-    algn = (alignment *) malloc(sizeof(alignment) * ps_alignment_n_phones(al));
+    // Size the scratch arena from the alignment: the phones, one
+    // window of audio for the longest triphone, the grammar and
+    // the hypotheses of a window
+    nphones = ps_alignment_n_phones(al);
+    maxdur = 0;
+    for (itor = ps_alignment_phones(al); itor; itor = ps_alignment_iter_next(itor)) {
+        ae = ps_alignment_iter_get(itor);
+        if (ae->duration > maxdur)
+            maxdur = ae->duration;
+    }
+    // Windows are either audio, or frames padded with half a second
+    // of silence frames
+    nwin = input ? (3 * maxdur * FPS + SAMPRATE) : 0;
+    pad = cmd_ln_int32_r(ps->config, "-frate") / 2;
+    nwinrows = input ? 0 : (3 * maxdur + 2 * pad);
+    ncep = feat_cepsize(ps->acmod->fcb);
+    arena->reserve(sizeof(Phone) * nphones + sizeof(int16) * nwin
+                   + (sizeof(mfcc_t *) + sizeof(mfcc_t) * ncep) * nwinrows
+                   + GRAMMAR_SIZE + sizeof(char *) * MAX_HYPS + 64 * MAX_HYPS);
+    algn = (Phone *) arena->alloc(sizeof(Phone) * nphones);
+    triphonebuf = (int16 *) arena->alloc(sizeof(int16) * nwin);
+    windowrows = (mfcc_t **) arena->alloc(sizeof(mfcc_t *) * nwinrows);
+    windowcep = (mfcc_t *) arena->alloc(sizeof(mfcc_t) * ncep * nwinrows);
+    grammar = (char *) arena->alloc(GRAMMAR_SIZE);
+    hyps = (const char **) arena->alloc(sizeof(char *) * MAX_HYPS);
+    hyps_mark = arena->mark();
+    nhyps = 0;
+    feats.reserve(FEATEX_PHONE_FEATS * nphones);
     n = 0;
+    // Word 0 is <s>
+    word_index = 0;
 
     maxdur = 0;
 
@@ -144,16 +289,19 @@ Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::st
             algn[n].start = ae->start;
             algn[n].dur = ae->duration;
             algn[n].score = ae->score;
+            algn[n].word = word_index;
             algn[n++].cipid = ae->id.pid.cipid;
             if (ae->duration > maxdur)
                 maxdur = ae->duration;
             itor2 = ps_alignment_iter_next(itor2);
         }
         itor = ps_alignment_iter_next(itor);
+        word_index++;
     }
 
-    ps_search_free(search);
+    ps_search_free(align.release());
     ps_alignment_free(al);
+    al = NULL;
 
     for (i = 0; i < n; i++) {
 
@@ -162,221 +310,261 @@ Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::st
             algn[i].start / frated, algn[i].dur / frated, algn[i].score);
     }
 
-    hyptbl = hash_table_new(175, HASH_CASE_YES); // for hypothesis deduplication
-
-
-    for (i = 1; i < n; i++) {
-
-        if (i == n-1) goto lastdiphone;
-
-        if (i > 1) printf(" ");
-
-        printf("%.2f %.3f", algn[i].dur / frated, 1 / log(2 - algn[i].score));
-        feats.push_back(algn[i].dur / frated);
-		feats.push_back(1 / log(2 - algn[i].score));
+    phone = 1;
+    stage = FEATEX_PHONES;
+}
 
-		// Populate triphone
-		nread = (algn[i-1].dur + algn[i].dur + algn[i+1].dur) * FPS;
-		triphonebuf = (int16 *) malloc(sizeof(int16) * (nread + 16000));
-		memset(triphonebuf, 0, (nread + 16000));
-		triphone_start = algn[i-1].start * FPS;
-		for (ii = 8000, jj = triphone_start; jj < triphone_start + nread; ii++, jj++) {
-			triphonebuf[ii] = buffer[jj];
-		}
+// Substitution and insertion/deletion scores of phone i, only the
+// latter for the last phone
+void FeatexJob::scorePhone(int i) {
+    static const std::vector<int16_t> no_audio;
+    const std::vector<int16_t>& buffer = input ? *input : no_audio;
+    bin_mdef_t *mdef = ps->acmod->mdef;
+    ps_nbest_t *nb;
+    int32 score;
+    double frated = (double) FRATE;
+    int j, k, found, triphone_start, nwinrows = 0;
+    char target[10];
+    char *p, *q, *r; // string manipulation pointers for constructing grammar
+    size_t nread;
 
-        printf("%s: triphone %d: %s-%s-%s\n", "featex.cpp", i,
-            mdef->ciname[algn[i-1].cipid],
-            mdef->ciname[algn[i].cipid],
-            mdef->ciname[algn[i+1].cipid]);
-
-        grammar[0] = '\0';
-        strcat(grammar, "#JSGF V1.0;\ngrammar subalts;\npublic <alts> = sil1 ");
-        if (algn[i-1].cipid != mdef->sil) {
-             p = mdef->ciname[algn[i-1].cipid];
-             q = grammar;
-             while (*++q);
-             while (*p) *q++ = tolower(*p++);
-             *q++ = '2';
-             *q = '\0';
-        }
-        strcat(grammar, " [ aa3 | ae3 | ah3 | ao3 | aw3 | ay3 | b3 | ch3 | d3"
-               " | dh3 | eh3 | er3 | ey3 | f3 | g3 | hh3 | ih3 | iy3 | jh3"
-               " | k3 | l3 | m3 | n3 | ng3 | ow3 | oy3 | p3 | r3 | s3 | sh3"
-               " | sil3 | t3 | th3 | uh3 | uw3 | v3 | w3 | y3 | z3 | zh3 ] ");
-        if (algn[i+1].cipid != mdef->sil) {
-             p = mdef->ciname[algn[i+1].cipid];
-             q = grammar;
-             while (*++q);
-             while (*p) *q++ = tolower(*p++);
-             *q++ = '4';
-             *q = '\0';
-        }
-        strcat(grammar, " sil5 ;\n");
+    if (i == n-1) goto lastdiphone;
+
+    if (i > 1) printf(" ");
+
+    printf("%.2f %.3f", algn[i].dur / frated, 1 / log(2 - algn[i].score));
+    feats.push_back(algn[i].dur / frated);
+    feats.push_back(1 / log(2 - algn[i].score));
+    if (phone_words) phone_words->push_back(algn[i].word - 1);
+
+    // Populate triphone
+    nread = (algn[i-1].dur + algn[i].dur + algn[i+1].dur) * FPS;
+    triphone_start = algn[i-1].start * FPS;
+    if (input)
+        fill_window(triphonebuf, buffer, triphone_start, nread);
+    else
+        nwinrows = fill_window_frames(windowrows, windowcep, ncep, frames, n_frames, silence, algn[i-1].start,
+                                      algn[i-1].dur + algn[i].dur + algn[i+1].dur, pad);
+
+    printf("%s: triphone %d: %s-%s-%s\n", "featex.cpp", i,
+        mdef->ciname[algn[i-1].cipid],
+        mdef->ciname[algn[i].cipid],
+        mdef->ciname[algn[i+1].cipid]);
+
+    grammar[0] = '\0';
+    strcat(grammar, "#JSGF V1.0;\ngrammar subalts;\npublic <alts> = sil1 ");
+    if (algn[i-1].cipid != mdef->sil) {
+         p = mdef->ciname[algn[i-1].cipid];
+         q = grammar;
+         while (*++q);
+         while (*p) *q++ = tolower(*p++);
+         *q++ = '2';
+         *q = '\0';
+    }
+    strcat(grammar, " [ aa3 | ae3 | ah3 | ao3 | aw3 | ay3 | b3 | ch3 | d3"
+           " | dh3 | eh3 | er3 | ey3 | f3 | g3 | hh3 | ih3 | iy3 | jh3"
+           " | k3 | l3 | m3 | n3 | ng3 | ow3 | oy3 | p3 | r3 | s3 | sh3"
+           " | sil3 | t3 | th3 | uh3 | uw3 | v3 | w3 | y3 | z3 | zh3 ] ");
+    if (algn[i+1].cipid != mdef->sil) {
+         p = mdef->ciname[algn[i+1].cipid];
+         q = grammar;
+         while (*++q);
+         while (*p) *q++ = tolower(*p++);
+         *q++ = '4';
+         *q = '\0';
+    }
+    strcat(grammar, " sil5 ;\n");
 
-        printf("%s: %s", "featex.cpp", grammar);
+    printf("%s: %s", "featex.cpp", grammar);
 
-        ps_set_jsgf_string(ps, "subalts", grammar);
-        ps_set_search(ps, "subalts");
-        ps_start_utt(ps);
-        ps_process_raw(ps, (const int16 *) triphonebuf, nread + 16000,
+    ps_set_jsgf_string(ps, "subalts", grammar);
+    ps_set_search(ps, "subalts");
+    ps_start_utt(ps);
+    if (input)
+        ps_process_raw(ps, (const int16 *) triphonebuf, nread + SAMPRATE,
                        FALSE, TRUE);
-        ps_end_utt(ps);
-
-        nb = ps_nbest(ps);
-        j = found = 0;
-        target[0] = ' '; target[1] = '\0';
-        strcat(target, mdef->ciname[algn[i].cipid]);
-        strcat(target, "3");
-        while (nb) {
-            p = (char *) ps_nbest_hyp(nb, &score);
-            if (p) { // some hypotheses are literally NULL
-                q = p;
-                while (*++q);
-                if (*(q-1) == '5') { // ignore hypotheses w/o whole match
-
-                    // ignore repeated hypotheses
-                    if (hash_table_lookup(hyptbl, p, NULL) == -1) {
-                        j++;
-                        printf("%s: triphone hypothesis %d: %s, %d\n",
-                            "featex.cpp", j, p, score);
-                        hash_table_enter_int32(hyptbl, p, score);
-
-                        if (strcasestr(p, target)) {
-                            found++;
-                            ps_nbest_free(nb);
-                            break;
-                        }
+    else
+        ps_process_cep(ps, windowrows, nwinrows, FALSE, TRUE);
+    ps_end_utt(ps);
+
+    nb = ps_nbest(ps);
+    j = found = 0;
+    target[0] = ' '; target[1] = '\0';
+    strcat(target, mdef->ciname[algn[i].cipid]);
+    strcat(target, "3");
+    while (nb) {
+        p = (char *) ps_nbest_hyp(nb, &score);
+        if (p) { // some hypotheses are literally NULL
+            q = p;
+            while (*++q);
+            if (*(q-1) == '5') { // ignore hypotheses w/o whole match
+
+                // ignore repeated hypotheses
+                if (hyp_add(hyps, &nhyps, p, *arena)) {
+                    j++;
+                    printf("%s: triphone hypothesis %d: %s, %d\n",
+                        "featex.cpp", j, p, score);
+
+                    if (strcasestr(p, target)) {
+                        found++;
+                        ps_nbest_free(nb);
+                        break;
                     }
                 }
             }
-            nb = ps_nbest_next(nb);
         }
-        if (!found) k = 42; // zero for bad recognition results or no match
-        printf("%s: SUBSTITUTION: %.3f\n", "featex.cpp", (42.0 - j) / 42.0);
-        printf(" %.3f", (42.0 - j) / 42.0);
-        feats.push_back((42.0 - j) / 42.0);
-
-        hash_table_empty(hyptbl);
-
-        lastdiphone: // goto target for the final set of two phonemes
-
-        // Populate diphone
-		nread = (algn[i-1].dur + algn[i].dur) * FPS;
-		triphonebuf = (int16 *) malloc(sizeof(int16) * (nread + 16000));
-		memset(triphonebuf, 0, (nread + 16000));
-		triphone_start = algn[i-1].start * FPS;
-		for (ii = 8000, jj = triphone_start; jj < triphone_start + nread; ii++, jj++) {
-			triphonebuf[ii] = buffer[jj];
-		}
-
-        printf("%s: diphone %d: %s-%s\n", "featex.cpp", i,
-                mdef->ciname[algn[i-1].cipid],
-                mdef->ciname[algn[i].cipid]);
-
-        grammar[0] = '\0';
-        strcat(grammar,
-            "#JSGF V1.0;\ngrammar insdels;\npublic <alts> = sil1 [ ");
-        p = mdef->ciname[algn[i-1].cipid];
-        q = grammar;
-        while (*++q);
-        while (*p) *q++ = tolower(*p++);
-        *q++ = '2';
-        *q = '\0';
-        r = q;
-        strcat(grammar, " ] [  aa3| ae3 | ah3 | ao3 | aw3 | ay3 | b3  | ch3"
-               " | d3  | dh3 | eh3 | er3 | ey3 | f3  | g3  | hh3 | ih3 | iy3"
-               " | jh3 | k3  | l3  | m3  | n3  | ng3 | ow3 | oy3 | p3  | r3 "
-               " | s3  | sh3 | sil3 | t3  | th3 | uh3 | uw3 | v3  | w3  | y3 "
-               " | z3  | zh3 ] ");
-        p = mdef->ciname[algn[i-1].cipid]; // first in diphone
-        while (*++q) { // blank out expected phoneme from possible insertions
-            if (isalpha(*q)) {
-                if ((*q == tolower(*p))
-                        && (((*(q+1) == '3') && *(p+1) == '\0')
-                           || *(q+1) == tolower(*(p+1)))) {
-                    *(q-2) = ' '; // blank out preceding '|'
-                    *q = ' '; *(q+1) = ' '; *(q+2) = ' '; *(q+3) = ' ';
-                } else {
-                    q += 3; // advance past the rest of the phoneme
-                }
+        nb = ps_nbest_next(nb);
+    }
+    if (!found) k = 42; // zero for bad recognition results or no match
+    printf("%s: SUBSTITUTION: %.3f\n", "featex.cpp", (42.0 - j) / 42.0);
+    printf(" %.3f", (42.0 - j) / 42.0);
+    feats.push_back((42.0 - j) / 42.0);
+
+    nhyps = 0;
+    arena->rewind(hyps_mark);
+
+    lastdiphone: // goto target for the final set of two phonemes
+
+    // Populate diphone
+    nread = (algn[i-1].dur + algn[i].dur) * FPS;
+    triphone_start = algn[i-1].start * FPS;
+    if (input)
+        fill_window(triphonebuf, buffer, triphone_start, nread);
+    else
+        nwinrows = fill_window_frames(windowrows, windowcep, ncep, frames, n_frames, silence, algn[i-1].start,
+                                      algn[i-1].dur + algn[i].dur, pad);
+
+    printf("%s: diphone %d: %s-%s\n", "featex.cpp", i,
+            mdef->ciname[algn[i-1].cipid],
+            mdef->ciname[algn[i].cipid]);
+
+    grammar[0] = '\0';
+    strcat(grammar,
+        "#JSGF V1.0;\ngrammar insdels;\npublic <alts> = sil1 [ ");
+    p = mdef->ciname[algn[i-1].cipid];
+    q = grammar;
+    while (*++q);
+    while (*p) *q++ = tolower(*p++);
+    *q++ = '2';
+    *q = '\0';
+    r = q;
+    strcat(grammar, " ] [  aa3| ae3 | ah3 | ao3 | aw3 | ay3 | b3  | ch3"
+           " | d3  | dh3 | eh3 | er3 | ey3 | f3  | g3  | hh3 | ih3 | iy3"
+           " | jh3 | k3  | l3  | m3  | n3  | ng3 | ow3 | oy3 | p3  | r3 "
+           " | s3  | sh3 | sil3 | t3  | th3 | uh3 | uw3 | v3  | w3  | y3 "
+           " | z3  | zh3 ] ");
+    p = mdef->ciname[algn[i-1].cipid]; // first in diphone
+    while (*++q) { // blank out expected phoneme from possible insertions
+        if (isalpha(*q)) {
+            if ((*q == tolower(*p))
+                    && (((*(q+1) == '3') && *(p+1) == '\0')
+                       || *(q+1) == tolower(*(p+1)))) {
+                *(q-2) = ' '; // blank out preceding '|'
+                *q = ' '; *(q+1) = ' '; *(q+2) = ' '; *(q+3) = ' ';
+            } else {
+                q += 3; // advance past the rest of the phoneme
             }
         }
-        p = mdef->ciname[algn[i].cipid]; // second in diphone
-        q = r;
-        while (*++q) { // blank out expected phoneme from possible insertions
-            if (isalpha(*q)) {
-                if ((*q == tolower(*p))
-                        && (((*(q+1) == '3') && *(p+1) == '\0')
-                           || *(q+1) == tolower(*(p+1)))) {
-                    *(q-2) = ' '; // blank out preceding '|'
-                    *q = ' '; *(q+1) = ' '; *(q+2) = ' '; *(q+3) = ' ';
-                } else {
-                    q += 3; // advance past the rest of the phoneme
-                }
+    }
+    p = mdef->ciname[algn[i].cipid]; // second in diphone
+    q = r;
+    while (*++q) { // blank out expected phoneme from possible insertions
+        if (isalpha(*q)) {
+            if ((*q == tolower(*p))
+                    && (((*(q+1) == '3') && *(p+1) == '\0')
+                       || *(q+1) == tolower(*(p+1)))) {
+                *(q-2) = ' '; // blank out preceding '|'
+                *q = ' '; *(q+1) = ' '; *(q+2) = ' '; *(q+3) = ' ';
+            } else {
+                q += 3; // advance past the rest of the phoneme
             }
         }
-        if (algn[i].cipid != mdef->sil) {
-             p = mdef->ciname[algn[i].cipid];
-             q = grammar;
-             while (*++q);
-             while (*p) *q++ = tolower(*p++);
-             *q++ = '4';
-             *q = '\0';
-        }
-        strcat(grammar, " sil5 ;\n");
-
-        printf("%s: %s", "featex.cpp", grammar);
-
-        ps_set_jsgf_string(ps, "insdels", grammar);
-        ps_set_search(ps, "insdels");
-        ps_start_utt(ps);
-        ps_process_raw(ps, (const int16 *) triphonebuf, (nread + 16000), FALSE, TRUE);
-        ps_end_utt(ps);
-
-        nb = ps_nbest(ps);
-        j = k = found = 0;
-        while (nb) {
-            p = (char *) ps_nbest_hyp(nb, &score);
-            if (p) { // some hypotheses are literally NULL
-                q = p;
-                while (*++q);
-                if (*(q-1) == '5') { // ignore hypotheses w/o whole match
-
-                    // ignore repeated hypotheses
-                    if (hash_table_lookup(hyptbl, p, NULL) == -1) {
-                        j++;
-                        printf("%s: diphone hypothesis %d: %s, %d\n",
-                            "featex.cpp", j, p, score);
-                        hash_table_enter_int32(hyptbl, p, score);
-
-                        if (!strstr(p, "2 ")) k++;
-                        if (strstr(p, "3 ")) k++;
-
-                        if (strstr(p, "2 ") && !strstr(p, "3 ")) {
-                            found++;
-                            ps_nbest_free(nb);
-                            break;
-                        }
+    }
+    if (algn[i].cipid != mdef->sil) {
+         p = mdef->ciname[algn[i].cipid];
+         q = grammar;
+         while (*++q);
+         while (*p) *q++ = tolower(*p++);
+         *q++ = '4';
+         *q = '\0';
+    }
+    strcat(grammar, " sil5 ;\n");
+
+    printf("%s: %s", "featex.cpp", grammar);
+
+    ps_set_jsgf_string(ps, "insdels", grammar);
+    ps_set_search(ps, "insdels");
+    ps_start_utt(ps);
+    if (input)
+        ps_process_raw(ps, (const int16 *) triphonebuf, (nread + SAMPRATE), FALSE, TRUE);
+    else
+        ps_process_cep(ps, windowrows, nwinrows, FALSE, TRUE);
+    ps_end_utt(ps);
+
+    nb = ps_nbest(ps);
+    j = k = found = 0;
+    while (nb) {
+        p = (char *) ps_nbest_hyp(nb, &score);
+        if (p) { // some hypotheses are literally NULL
+            q = p;
+            while (*++q);
+            if (*(q-1) == '5') { // ignore hypotheses w/o whole match
+
+                // ignore repeated hypotheses
+                if (hyp_add(hyps, &nhyps, p, *arena)) {
+                    j++;
+                    printf("%s: diphone hypothesis %d: %s, %d\n",
+                        "featex.cpp", j, p, score);
+
+                    if (!strstr(p, "2 ")) k++;
+                    if (strstr(p, "3 ")) k++;
+
+                    if (strstr(p, "2 ") && !strstr(p, "3 ")) {
+                        found++;
+                        ps_nbest_free(nb);
+                        break;
                     }
                 }
             }
-            nb = ps_nbest_next(nb);
         }
-        if (j == 0)
-            k = 160; // zero for bad recognition results
-        else if (!found) {
-            k += 80; // add half the range if the preferred hypothesis missed
-            if (k > 160) k = 160; // clamp
-        }
-        printf("%s: INS/DEL: %.3f\n", "featex.cpp", (160.0 - k) / 160);
-        printf(" %.3f", (160.0 - k) / 160);
-        feats.push_back((160.0 - k) / 160);
-
-        hash_table_empty(hyptbl);
+        nb = ps_nbest_next(nb);
+    }
+    if (j == 0)
+        k = 160; // zero for bad recognition results
+    else if (!found) {
+        k += 80; // add half the range if the preferred hypothesis missed
+        if (k > 160) k = 160; // clamp
     }
+    printf("%s: INS/DEL: %.3f\n", "featex.cpp", (160.0 - k) / 160);
+    printf(" %.3f", (160.0 - k) / 160);
+    feats.push_back((160.0 - k) / 160);
+
+    nhyps = 0;
+    arena->rewind(hyps_mark);
+}
+
+Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::string& sentence) {
+    FeatexArena arena;
+    return featex(ps, buffer, sentence, arena);
+}
+
+// The audio input is used if given, the frames otherwise
+static Feats featex_run(ps_decoder_t *ps, const std::vector<int16_t> *input,
+                        mfcc_t **frames, int n_frames, const mfcc_t *silence,
+                        const std::string& sentence, FeatexArena& arena,
+                        std::vector<int> *phone_words) {
+    FeatexJob job;
+    job.start(ps, input, frames, n_frames, silence, sentence, arena, phone_words);
+    while (job.step(0) == 0);
+    return job.features();
+}
 
-    free(triphonebuf);
-    free(algn);
+Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::string& sentence, FeatexArena& arena,
+             std::vector<int> *phone_words) {
+    return featex_run(ps, &buffer, NULL, 0, NULL, sentence, arena, phone_words);
+}
 
-    return feats;
-}
\ No newline at end of file
+Feats featex(ps_decoder_t *ps, mfcc_t **frames, int n_frames, const mfcc_t *silence,
+             const std::string& sentence, FeatexArena& arena, std::vector<int> *phone_words) {
+    return featex_run(ps, NULL, frames, n_frames, silence, sentence, arena, phone_words);
+}
@@ -16,6 +16,7 @@
 #include "state_align_search.h"
 #include "pocketsphinx_internal.h"
 #include "ps_search.h"
+#include "align.h"
 
 #include <ctype.h>
 #include <math.h>
@@ -23,11 +24,132 @@
 #define FRATE 65
 #define SAMPRATE 16000
 #define FPS (SAMPRATE / FRATE)
+/* Features of each phone of the sentence: duration, alignment
+   score, substitution and insertion/deletion scores. The last
+   phone only has the insertion/deletion score of its diphone */
+#define FEATEX_PHONE_FEATS 4
 
 //#define _GNU_SOURCE // strcasestr() non-standard string search
 
 typedef std::vector<float> Feats;
 
+/**
+ * Bump allocator for the scratch memory of featex().
+ *
+ * The block is sized from the alignment before the phone loop and
+ * kept between calls, so repeated evaluations do not go back to the
+ * allocator. Requests beyond the block are served from overflow
+ * chunks, and everything is released at once by reset().
+ */
+class FeatexArena {
+public:
+    FeatexArena();
+    ~FeatexArena();
+    /** Makes sure the block holds at least size bytes, resets the arena. */
+    void reserve(size_t size);
+    void *alloc(size_t size);
+    /** Position to rewind to, to drop the allocations made after it. */
+    size_t mark() const { return used; }
+    void rewind(size_t position);
+    void reset();
+    /** Gives the block back to the heap. */
+    void release();
+    size_t capacity() const { return size; }
+private:
+    FeatexArena(const FeatexArena&);
+    FeatexArena& operator=(const FeatexArena&);
+    char *block;
+    size_t size;
+    size_t used;
+    std::vector<void *> overflow;
+};
+
 Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::string& sentence);
+/**
+ * If phone_words is given, it receives the word of each phone
+ * with FEATEX_PHONE_FEATS features, counted from 0 for the first
+ * word of the sentence.
+ */
+Feats featex(ps_decoder_t *ps, const std::vector<int16_t>& buffer, const std::string& sentence, FeatexArena& arena,
+             std::vector<int> *phone_words = NULL);
+
+/**
+ * Same on the cepstral frames of an utterance already run through
+ * the front end. Phone windows are padded with the given frame,
+ * which should be the cepstrum of silence.
+ */
+Feats featex(ps_decoder_t *ps, mfcc_t **frames, int n_frames, const mfcc_t *silence,
+             const std::string& sentence, FeatexArena& arena, std::vector<int> *phone_words = NULL);
+
+/**
+ * featex() a step at a time, so that it can be interleaved with
+ * other work: the alignment a number of frames per step, then one
+ * phone per step. The decoder must not be used for anything else,
+ * and the audio or frames and the arena must stay in place, until
+ * the job is done.
+ */
+class FeatexJob {
+public:
+    FeatexJob();
+    ~FeatexJob();
+    /** Same arguments as featex(), the audio is used if not NULL. */
+    void start(ps_decoder_t *ps, const std::vector<int16_t> *input, mfcc_t **frames, int n_frames,
+               const mfcc_t *silence, const std::string& sentence, FeatexArena& arena,
+               std::vector<int> *phone_words = NULL);
+    /**
+     * Aligns about align_frames more frames, all of them if 0, or
+     * once the sentence is aligned, scores the next phone.
+     *
+     * @return 1 once the features are complete, 0 if there is more
+     */
+    int step(int align_frames);
+    bool done() const { return stage == FEATEX_DONE; }
+    /** From 0 to 1, the alignment counting for a fifth. */
+    float progress() const;
+    /** Empty if the sentence could not be aligned. */
+    const Feats& features() const { return feats; }
+    /** Drops the job, keeping the features of a finished one. */
+    void reset();
+private:
+    FeatexJob(const FeatexJob&);
+    FeatexJob& operator=(const FeatexJob&);
+    enum Stage { FEATEX_DONE, FEATEX_ALIGN, FEATEX_PHONES };
+    struct Phone {
+        int start, dur, cipid, score, word;
+    };
+    void preparePhones();
+    void scorePhone(int i);
+    Stage stage;
+    ps_decoder_t *ps;
+    const std::vector<int16_t> *input;
+    mfcc_t **frames;
+    int n_frames;
+    const mfcc_t *silence;
+    FeatexArena *arena;
+    std::vector<int> *phone_words;
+    ps_alignment_t *al;
+    AlignJob align;
+    // Aligned phones, and the next one to score
+    Phone *algn;
+    int n;
+    int phone;
+    // Scratch memory of the phones, from the arena
+    int16 *triphonebuf;
+    mfcc_t **windowrows;
+    mfcc_t *windowcep; // copies of the frames of a window
+    int ncep;
+    int pad;
+    char *grammar;
+    const char **hyps; // hypotheses seen in the current window
+    int nhyps;
+    size_t hyps_mark;
+    Feats feats;
+};
+
+/**
+ * Runs a search, started on an utterance started on acmod, over
+ * cepstral frames.
+ */
+void search_cep(acmod_t *acmod, ps_search_t *search, mfcc_t **frames, int n_frames);
 
 #endif /* __FEATEX_H__ */
\ No newline at end of file
@@ -0,0 +1,265 @@
+/**
+ * @file frameskip.cpp Adaptive frame skipping of the acoustic scoring
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "frameskip.h"
+
+namespace {
+
+struct FrameSkipMgau {
+    ps_mgau_t base;
+    ps_mgau_t *inner;
+    float threshold;
+    int max_run;
+    bool paused;
+    int n_sen;
+    int ceplen;
+    // Cepstra of the previous frame, and of the last frame scored
+    std::vector<float> last, anchor;
+    int last_frame;
+    // Frames skipped in a row, and frames to score after a change
+    int run;
+    int guard;
+    // Per senone, the scored frame its score is from
+    std::vector<int> scored;
+    int epoch;
+    // Best senone of the last frame scored and its score, which
+    // the scores computed on skipped frames are shifted to match
+    int anchor_best;
+    int16 anchor_best_score;
+    // Senones to score on a skipped frame, and their active list
+    std::vector<int> senones, missing, subset;
+    std::vector<uint8> missing_list;
+    std::vector<int16> audit_scores;
+    int until_audit;
+    FrameSkipCounts counts;
+};
+
+}
+
+static FrameSkipMgau *frame_skip(ps_mgau_t *mgau) {
+    return reinterpret_cast<FrameSkipMgau *>(mgau);
+}
+
+// Root mean square of the difference with the given cepstrum
+static float cep_change(mfcc_t const *cep, const std::vector<float>& other) {
+    float sum = 0;
+    for (size_t i = 0; i < other.size(); ++i) {
+        float d = MFCC2FLOAT(cep[i]) - other[i];
+        sum += d * d;
+    }
+    return other.empty() ? 0 : sqrtf(sum / other.size());
+}
+
+// Senone ids of an active list, which holds the differences
+// between consecutive senones, or all senones
+static void list_senones(FrameSkipMgau *fs, uint8 const *active, int32 n_active, int32 compallsen) {
+    fs->senones.clear();
+    if (compallsen) {
+        for (int s = 0; s < fs->n_sen; ++s) fs->senones.push_back(s);
+        return;
+    }
+    int sen = 0;
+    for (int32 i = 0; i < n_active; ++i) {
+        sen += active[i];
+        fs->senones.push_back(sen);
+    }
+}
+
+static void encode_senones(const std::vector<int>& senones, std::vector<uint8>& list) {
+    list.clear();
+    int last = 0;
+    for (size_t i = 0; i < senones.size(); ++i) {
+        int delta = senones[i] - last;
+        // Gaps are bridged with extra senones, as acmod does
+        while (delta > 255) {
+            list.push_back(255);
+            delta -= 255;
+        }
+        list.push_back(delta);
+        last = senones[i];
+    }
+}
+
+// Best senone of the list, scores being costs
+static int best_senone(const std::vector<int>& senones, int16 const *scores) {
+    int best = -1;
+    for (size_t i = 0; i < senones.size(); ++i)
+        if ((best < 0) || (scores[senones[i]] < scores[best])) best = senones[i];
+    return best;
+}
+
+// Scores senones on a skipped frame, on the scale of the scores
+// reused from the last frame scored. The mixtures normalize the
+// scores to the best of the senones they compute, so the best
+// senone of that frame is computed with them, and the difference
+// with its score then is added to theirs.
+static int score_on_anchor(FrameSkipMgau *fs, int16 *scores, const std::vector<int>& senones,
+                           mfcc_t **featbuf, int32 frame) {
+    fs->subset = senones;
+    std::vector<int>::iterator at = std::lower_bound(fs->subset.begin(), fs->subset.end(), fs->anchor_best);
+    bool extra = (at == fs->subset.end()) || (*at != fs->anchor_best);
+    if (extra) fs->subset.insert(at, fs->anchor_best);
+    encode_senones(fs->subset, fs->missing_list);
+    int16 kept = scores[fs->anchor_best];
+    int rv = ps_mgau_frame_eval(fs->inner, scores, &fs->missing_list[0], fs->missing_list.size(),
+                                featbuf, frame, FALSE);
+    int shift = fs->anchor_best_score - scores[fs->anchor_best];
+    for (size_t i = 0; i < senones.size(); ++i)
+        scores[senones[i]] = (int16) std::max(-32768, std::min(32767, scores[senones[i]] + shift));
+    if (extra) scores[fs->anchor_best] = kept;
+    return rv;
+}
+
+static int frame_skip_eval(ps_mgau_t *mgau, int16 *senscr, uint8 *senone_active,
+                           int32 n_senone_active, mfcc_t **featbuf, int32 frame,
+                           int32 compallsen) {
+    FrameSkipMgau *fs = frame_skip(mgau);
+    mfcc_t const *cep = featbuf[0];
+    bool follows = (frame == fs->last_frame + 1);
+    float change = follows ? cep_change(cep, fs->last) : 0;
+    bool reuse = !fs->paused && follows && (fs->guard == 0) && (fs->run < fs->max_run) && (fs->anchor_best >= 0)
+        && (change < fs->threshold) && (cep_change(cep, fs->anchor) < fs->threshold);
+    if (follows && (change >= fs->threshold))
+        fs->guard = FRAME_SKIP_GUARD;
+    else if (fs->guard > 0)
+        fs->guard--;
+    for (int i = 0; i < fs->ceplen; ++i)
+        fs->last[i] = MFCC2FLOAT(cep[i]);
+    fs->last_frame = frame;
+    fs->counts.frames++;
+
+    list_senones(fs, senone_active, n_senone_active, compallsen);
+    if (!reuse) {
+        fs->run = 0;
+        fs->epoch++;
+        fs->anchor = fs->last;
+        for (size_t i = 0; i < fs->senones.size(); ++i)
+            fs->scored[fs->senones[i]] = fs->epoch;
+        fs->counts.senones_scored += fs->senones.size();
+        int rv = ps_mgau_frame_eval(fs->inner, senscr, senone_active, n_senone_active,
+                                    featbuf, frame, compallsen);
+        fs->anchor_best = best_senone(fs->senones, senscr);
+        if (fs->anchor_best >= 0) fs->anchor_best_score = senscr[fs->anchor_best];
+        return rv;
+    }
+
+    fs->run++;
+    fs->counts.skipped++;
+    fs->missing.clear();
+    for (size_t i = 0; i < fs->senones.size(); ++i)
+        if (fs->scored[fs->senones[i]] != fs->epoch)
+            fs->missing.push_back(fs->senones[i]);
+    fs->counts.senones_scored += fs->missing.size();
+    fs->counts.senones_reused += fs->senones.size() - fs->missing.size();
+    int rv = 0;
+    if (fs->missing.size() > 0)
+        rv = score_on_anchor(fs, senscr, fs->missing, featbuf, frame);
+    if (--fs->until_audit <= 0) {
+        // The frame is scored in full aside, on the same scale, and
+        // compared with the reused and the missing scores
+        fs->until_audit = FRAME_SKIP_AUDIT;
+        rv = score_on_anchor(fs, &fs->audit_scores[0], fs->senones, featbuf, frame);
+        double error = 0, new_error = 0;
+        for (size_t i = 0; i < fs->senones.size(); ++i) {
+            int s = fs->senones[i];
+            if (fs->scored[s] == fs->epoch)
+                error += abs(senscr[s] - fs->audit_scores[s]);
+            else
+                new_error += abs(senscr[s] - fs->audit_scores[s]);
+        }
+        size_t reused = fs->senones.size() - fs->missing.size();
+        if (reused > 0)
+            fs->counts.score_error += (error / reused - fs->counts.score_error) / (fs->counts.audited + 1);
+        if (fs->missing.size() > 0) {
+            fs->counts.new_score_error += (new_error / fs->missing.size() - fs->counts.new_score_error)
+                / (fs->counts.audited_new + 1);
+            fs->counts.audited_new++;
+        }
+        if (best_senone(fs->senones, senscr) == best_senone(fs->senones, &fs->audit_scores[0]))
+            fs->counts.best_agreed++;
+        fs->counts.audited++;
+    }
+    for (size_t i = 0; i < fs->missing.size(); ++i)
+        fs->scored[fs->missing[i]] = fs->epoch;
+    return rv;
+}
+
+static int frame_skip_transform(ps_mgau_t *mgau, ps_mllr_t *mllr) {
+    return ps_mgau_transform(frame_skip(mgau)->inner, mllr);
+}
+
+static void frame_skip_free(ps_mgau_t *mgau) {
+    FrameSkipMgau *fs = frame_skip(mgau);
+    ps_mgau_free(fs->inner);
+    delete fs;
+}
+
+static ps_mgaufuncs_t frame_skip_funcs = {
+    "frame_skip",
+    frame_skip_eval,
+    frame_skip_transform,
+    frame_skip_free
+};
+
+static FrameSkipMgau *wrapper(acmod_t *acmod) {
+    if ((acmod == NULL) || (acmod->mgau == NULL) || (acmod->mgau->vt != &frame_skip_funcs))
+        return NULL;
+    return frame_skip(acmod->mgau);
+}
+
+int frame_skip_init(acmod_t *acmod, float threshold, int max_run) {
+    if (wrapper(acmod)) return -1;
+    FrameSkipMgau *fs = new FrameSkipMgau();
+    fs->base.vt = &frame_skip_funcs;
+    fs->base.frame_idx = 0;
+    fs->inner = acmod->mgau;
+    fs->threshold = threshold;
+    fs->max_run = max_run;
+    fs->paused = false;
+    fs->n_sen = bin_mdef_n_sen(acmod->mdef);
+    // The cepstrum starts the first stream of the features
+    fs->ceplen = std::min((int) feat_cepsize(acmod->fcb), (int) feat_stream_len(acmod->fcb, 0));
+    fs->last.assign(fs->ceplen, 0);
+    fs->scored.assign(fs->n_sen, 0);
+    fs->epoch = 0;
+    fs->audit_scores.assign(fs->n_sen, 0);
+    acmod->mgau = &fs->base;
+    frame_skip_reset(acmod);
+    return 0;
+}
+
+bool frame_skip_active(acmod_t *acmod) {
+    return wrapper(acmod) != NULL;
+}
+
+bool frame_skip_pause(acmod_t *acmod, bool paused) {
+    FrameSkipMgau *fs = wrapper(acmod);
+    if (fs == NULL) return false;
+    bool was_paused = fs->paused;
+    fs->paused = paused;
+    return was_paused;
+}
+
+void frame_skip_reset(acmod_t *acmod) {
+    FrameSkipMgau *fs = wrapper(acmod);
+    if (fs == NULL) return;
+    fs->last_frame = -2;
+    fs->anchor_best = -1;
+    fs->run = 0;
+    fs->guard = 0;
+    fs->until_audit = FRAME_SKIP_AUDIT;
+    memset(&fs->counts, 0, sizeof(fs->counts));
+}
+
+void frame_skip_counts(acmod_t *acmod, FrameSkipCounts& counts) {
+    FrameSkipMgau *fs = wrapper(acmod);
+    if (fs) counts = fs->counts;
+    else memset(&counts, 0, sizeof(counts));
+}
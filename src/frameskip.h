@@ -0,0 +1,78 @@
+/**
+ * @file frameskip.h Adaptive frame skipping of the acoustic scoring
+ */
+
+#ifndef __FRAMESKIP_H__
+#define __FRAMESKIP_H__
+
+#include "pocketsphinx.h"
+#include "pocketsphinx_internal.h"
+
+/* Frames scored on every senone after a change above the threshold */
+#define FRAME_SKIP_GUARD 2
+/* Skipped frames between two that are also scored in full, to
+   measure what reusing the scores costs */
+#define FRAME_SKIP_AUDIT 20
+
+/* Counts since the last frame_skip_reset. Audited frames are
+   skipped frames scored again in full: score_error is the mean
+   difference of the reused senone scores, new_score_error the one
+   of the senones computed on the frame, over the audited_new frames
+   that had some, and best_agreed the number of audited frames whose
+   best senone was the same. */
+struct FrameSkipCounts {
+    int frames;
+    int skipped;
+    long senones_scored;
+    long senones_reused;
+    int audited;
+    double score_error;
+    int audited_new;
+    double new_score_error;
+    int best_agreed;
+};
+
+/**
+ * Wraps the Gaussian mixtures of an acoustic model so that a frame
+ * whose cepstrum changed by less than the threshold, as the root
+ * mean square of the difference, since both the previous frame and
+ * the last frame scored, reuses the senone scores of the latter.
+ * Senones that were not active then are scored on the frame, and
+ * shifted to the scale of the reused scores by also scoring the
+ * best senone of the last frame scored. At
+ * most max_run frames in a row are skipped, and frames are scored
+ * in full at the start of an utterance, on a change above the
+ * threshold and for FRAME_SKIP_GUARD frames after it, and when
+ * they are not given in order, as with the lookahead of
+ * -pl_window.
+ *
+ * @return 0, or -1 if the model is already wrapped
+ */
+int frame_skip_init(acmod_t *acmod, float threshold, int max_run);
+
+/** Whether frame_skip_init was called on the model. */
+bool frame_skip_active(acmod_t *acmod);
+
+/**
+ * Scores every frame while paused, for alignments whose scores
+ * are features themselves. Returns whether it was paused before.
+ */
+bool frame_skip_pause(acmod_t *acmod, bool paused);
+
+void frame_skip_reset(acmod_t *acmod);
+void frame_skip_counts(acmod_t *acmod, FrameSkipCounts& counts);
+
+/** Pauses the skipping for the lifetime of the object. */
+class FrameSkipPause {
+public:
+    explicit FrameSkipPause(acmod_t *acmod)
+        : acmod(acmod), was_paused(frame_skip_pause(acmod, true)) {}
+    ~FrameSkipPause() { frame_skip_pause(acmod, was_paused); }
+private:
+    FrameSkipPause(const FrameSkipPause&);
+    FrameSkipPause& operator=(const FrameSkipPause&);
+    acmod_t *acmod;
+    bool was_paused;
+};
+
+#endif /* __FRAMESKIP_H__ */
@@ -0,0 +1,54 @@
+/**
+ * @file fsgblob.cpp Grammars packed in a binary blob by tools/fsg_pack.js
+ */
+
+#include <string.h>
+
+#include "fsgblob.h"
+
+#define HEADER_INTS 8
+
+static int32_t read_le32(const unsigned char *p) {
+    return (int32_t) (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+}
+
+int fsg_blob_parse(const std::string& data, FsgBlob *blob) {
+    const unsigned char *p = (const unsigned char *) data.data();
+    size_t size = data.size();
+    if ((size < 4 * HEADER_INTS) || memcmp(p, "PSFG", 4) || (read_le32(p + 4) != FSG_BLOB_VERSION))
+        return -1;
+    blob->numStates = read_le32(p + 8);
+    blob->start = read_le32(p + 12);
+    blob->end = read_le32(p + 16);
+    int32_t n_words = read_le32(p + 20);
+    int32_t n_arcs = read_le32(p + 24);
+    int32_t word_bytes = read_le32(p + 28);
+    if ((blob->numStates <= 0) || (blob->start < 0) || (blob->start >= blob->numStates)
+        || (blob->end < 0) || (blob->end >= blob->numStates)
+        || (n_words < 0) || (n_arcs < 0) || (word_bytes < 0) || (word_bytes % 4)
+        || (size - 4 * HEADER_INTS < (size_t) word_bytes)
+        || ((size - 4 * HEADER_INTS - word_bytes) / (4 * FSG_BLOB_ARC_SIZE) < (size_t) n_arcs))
+        return -1;
+    // Word table, the last string must be terminated
+    const char *table = (const char *) p + 4 * HEADER_INTS;
+    const char *table_end = table + word_bytes;
+    blob->words.clear();
+    for (const char *w = table; (int32_t) blob->words.size() < n_words; w += strlen(w) + 1) {
+        if ((w >= table_end) || (memchr(w, 0, table_end - w) == NULL))
+            return -1;
+        blob->words.push_back(w);
+    }
+    const unsigned char *a = (const unsigned char *) table_end;
+    blob->arcs.resize((size_t) n_arcs * FSG_BLOB_ARC_SIZE);
+    for (size_t i = 0; i < blob->arcs.size(); i += FSG_BLOB_ARC_SIZE, a += 4 * FSG_BLOB_ARC_SIZE) {
+        int32_t from = read_le32(a), to = read_le32(a + 4), word = read_le32(a + 12);
+        if ((from < 0) || (from >= blob->numStates) || (to < 0) || (to >= blob->numStates)
+            || (word < -1) || (word >= n_words))
+            return -1;
+        blob->arcs[i] = from;
+        blob->arcs[i + 1] = to;
+        blob->arcs[i + 2] = read_le32(a + 8);
+        blob->arcs[i + 3] = word;
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file fsgblob.h Grammars packed in a binary blob by tools/fsg_pack.js
+ */
+
+#ifndef __FSGBLOB_H__
+#define __FSGBLOB_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/* Layout, all integers 32-bit little-endian:
+   "PSFG", version, number of states, start state, end state,
+   number of words, number of arcs, size of the word table, the
+   words as NUL-terminated UTF-8 strings padded to 4 bytes, then
+   the arcs as (from, to, logp, word index or -1 for none). */
+#define FSG_BLOB_VERSION 1
+#define FSG_BLOB_ARC_SIZE 4
+
+struct FsgBlob {
+    int numStates;
+    int start;
+    int end;
+    std::vector<const char *> words; /**< Point into the blob */
+    std::vector<int32_t> arcs;       /**< FSG_BLOB_ARC_SIZE values per arc */
+    int numArcs() const { return arcs.size() / FSG_BLOB_ARC_SIZE; }
+};
+
+/**
+ * Reads a packed grammar, checking that states and word indices
+ * are in range. The blob must outlive the result.
+ *
+ * @return 0, or -1 if the blob is malformed
+ */
+int fsg_blob_parse(const std::string& data, FsgBlob *blob);
+
+#endif /* __FSGBLOB_H__ */
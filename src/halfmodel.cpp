@@ -0,0 +1,296 @@
+/**
+ * @file halfmodel.cpp Acoustic model parameters stored in 16-bit floats
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#endif
+
+#include "halfmodel.h"
+
+#define BYTE_ORDER_MAGIC 0x11223344
+#define HEADER_LINE 1024
+/* Values converted at a time */
+#define EXPAND_CHUNK 4096
+
+static const char *half_files[] = {"means", "variances", "mixture_weights", NULL};
+
+// One half precision file, seen as the float32 file it expands to
+struct HalfFile {
+    std::string dst;
+    // s3 header, byte order magic and leading integers
+    std::string head;
+    long data_offset;
+    long count;
+    int bf16;
+    FILE *in;
+};
+
+// Files being expanded, by id
+static std::vector<HalfFile *> expanding;
+
+static float half_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    float f;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            // Subnormal, normalize it
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                exp--;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+    } else if (exp == 0x1f) {
+        bits = sign | 0x7f800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static float bfloat_to_float(uint16_t h) {
+    uint32_t bits = (uint32_t) h << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static uint32_t read_le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Number of 16-bit values between the position and the end
+static long half_values_left(FILE *in) {
+    long pos = ftell(in);
+    if ((pos < 0) || (fseek(in, 0, SEEK_END) != 0)) return -1;
+    long end = ftell(in);
+    if (fseek(in, pos, SEEK_SET) != 0) return -1;
+    return (end - pos) / 2;
+}
+
+// Reads the header of a half precision file and makes the one of
+// the float32 file, in native byte order, which PocketSphinx finds
+// from the magic
+static int read_header(HalfFile& file) {
+    char line[HEADER_LINE];
+    int n_ints = -1;
+    unsigned char word[4];
+    std::vector<int32_t> ints;
+    uint32_t magic = BYTE_ORDER_MAGIC;
+
+    file.head = "s3\n";
+    file.bf16 = 0;
+    if ((fgets(line, sizeof(line), file.in) == NULL) || strcmp(line, "s3\n"))
+        return -1;
+    while (fgets(line, sizeof(line), file.in)) {
+        if (!strcmp(line, "endhdr\n"))
+            break;
+        if (!strncmp(line, "datatype ", 9))
+            file.bf16 = !strncmp(line + 9, "bf16", 4);
+        else if (!strncmp(line, "leading_ints ", 13))
+            n_ints = atoi(line + 13);
+        else
+            file.head += line;
+    }
+    file.head += "endhdr\n";
+    if ((n_ints < 1) || (fread(word, 1, 4, file.in) != 4) || (read_le32(word) != BYTE_ORDER_MAGIC))
+        return -1;
+    for (int i = 0; i < n_ints; i++) {
+        if (fread(word, 1, 4, file.in) != 4)
+            return -1;
+        ints.push_back((int32_t) read_le32(word));
+    }
+    // The last leading integer is the number of values, checked
+    // against the size of the file
+    file.count = ints.back();
+    if ((file.count < 0) || (half_values_left(file.in) < file.count))
+        return -1;
+    file.data_offset = ftell(file.in);
+    file.head.append((const char *) &magic, 4);
+    file.head.append((const char *) &ints[0], 4 * ints.size());
+    return 0;
+}
+
+static long expanded_size(const HalfFile& file) {
+    return file.head.size() + 4 * file.count;
+}
+
+// Copies bytes of the float32 file, from the given position, and
+// returns how many, or -1 on a read error. Values are converted a
+// chunk at a time, as they are read.
+static long read_expanded(HalfFile& file, char *dst, long length, long position) {
+    unsigned char half[2 * EXPAND_CHUNK];
+    float values[EXPAND_CHUNK];
+    long total = expanded_size(file), done = 0, head = file.head.size();
+    if ((position < 0) || (position >= total))
+        return 0;
+    length = std::min(length, total - position);
+    if (position < head) {
+        done = std::min(length, head - position);
+        memcpy(dst, file.head.data() + position, done);
+    }
+    while (done < length) {
+        long byte = position + done - head;
+        long first = byte / 4, skip = byte % 4;
+        long n = std::min((long) EXPAND_CHUNK, (length - done + skip + 3) / 4);
+        if ((fseek(file.in, file.data_offset + 2 * first, SEEK_SET) != 0)
+            || (fread(half, 2, n, file.in) != (size_t) n))
+            return -1;
+        for (long i = 0; i < n; i++) {
+            uint16_t h = half[2 * i] | (half[2 * i + 1] << 8);
+            values[i] = file.bf16 ? bfloat_to_float(h) : half_to_float(h);
+        }
+        long bytes = std::min(4 * n - skip, length - done);
+        memcpy(dst + done, (const char *) values + skip, bytes);
+        done += bytes;
+    }
+    return done;
+}
+
+static void close_file(HalfFile *file) {
+    if (file->in) fclose(file->in);
+    delete file;
+}
+
+#ifdef __EMSCRIPTEN__
+
+// Read callback of the devices below
+extern "C" EMSCRIPTEN_KEEPALIVE int hmm_half_read(int id, char *dst, int length, double position) {
+    if ((id < 0) || (id >= (int) expanding.size()) || (expanding[id] == NULL))
+        return -1;
+    return read_expanded(*expanding[id], dst, length, (long) position);
+}
+
+// The float32 file is a read-only device of the virtual file
+// system, so that the values are converted straight into the
+// buffers of the model as PocketSphinx loads it, without a float32
+// copy of the file in memory
+static int expose_file(int id, HalfFile& file) {
+    // Minor device numbers
+    if (id > 255)
+        return -1;
+    return EM_ASM_INT({
+        var id = $0, path = UTF8ToString($1), size = $2;
+        try {
+            var dev = FS.makedev(64, id);
+            FS.registerDevice(dev, {
+                open: function(stream) {
+                    stream.seekable = true;
+                },
+                read: function(stream, buffer, offset, length, position) {
+                    var n = (buffer === HEAP8) ? Module['_hmm_half_read'](id, offset, length, position) : -1;
+                    if (n < 0) throw new FS.ErrnoError(ERRNO_CODES.EIO);
+                    return n;
+                },
+                llseek: function(stream, offset, whence) {
+                    var position = offset;
+                    if (whence === 1) position += stream.position;
+                    else if (whence === 2) position += size;
+                    if (position < 0) throw new FS.ErrnoError(ERRNO_CODES.EINVAL);
+                    return position;
+                }
+            });
+            FS.mkdev(path, 292, dev);
+            return 0;
+        } catch (e) {
+            return -1;
+        }
+    }, id, file.dst.c_str(), (double) expanded_size(file));
+}
+
+#else
+
+// Natively the float32 file is written, a chunk at a time
+static int expose_file(int, HalfFile& file) {
+    char buf[4 * EXPAND_CHUNK];
+    FILE *out;
+    long position = 0, total = expanded_size(file), n;
+    int rv = 0;
+    if ((out = fopen(file.dst.c_str(), "wb")) == NULL)
+        return -1;
+    while ((rv == 0) && (position < total)) {
+        n = read_expanded(file, buf, sizeof(buf), position);
+        if ((n <= 0) || (fwrite(buf, 1, n, out) != (size_t) n))
+            rv = -1;
+        position += n;
+    }
+    if (fclose(out) != 0)
+        rv = -1;
+    if (rv < 0)
+        remove(file.dst.c_str());
+    return rv;
+}
+
+#endif /* __EMSCRIPTEN__ */
+
+// Makes the float32 file of one half precision file
+static int expand_file(const std::string& src, const std::string& dst) {
+    HalfFile *file = new HalfFile();
+    file->dst = dst;
+    file->in = fopen(src.c_str(), "rb");
+    if ((file->in == NULL) || (read_header(*file) < 0)) {
+        close_file(file);
+        return -1;
+    }
+    // Ids are reused, devices are told apart by them
+    int id = std::find(expanding.begin(), expanding.end(), (HalfFile *) NULL) - expanding.begin();
+    if (id == (int) expanding.size())
+        expanding.push_back(NULL);
+    expanding[id] = file;
+    if (expose_file(id, *file) < 0) {
+        expanding[id] = NULL;
+        close_file(file);
+        return -1;
+    }
+#ifndef __EMSCRIPTEN__
+    // The written file no longer needs the source
+    expanding[id] = NULL;
+    close_file(file);
+#endif
+    return 0;
+}
+
+int hmm_expand_half(const std::string& hmm_dir, std::vector<std::string>& created) {
+    for (int i = 0; half_files[i]; i++) {
+        std::string dst = hmm_dir + "/" + half_files[i];
+        std::string src = dst + ".f16";
+        FILE *fh;
+        if ((fh = fopen(dst.c_str(), "rb")) != NULL) {
+            fclose(fh);
+            continue;
+        }
+        if ((fh = fopen(src.c_str(), "rb")) == NULL)
+            continue;
+        fclose(fh);
+        if (expand_file(src, dst) < 0)
+            return -1;
+        created.push_back(dst);
+    }
+    return 0;
+}
+
+void hmm_remove_expanded(std::vector<std::string>& created) {
+    for (size_t i = 0; i < created.size(); i++) {
+        remove(created[i].c_str());
+        for (size_t j = 0; j < expanding.size(); j++)
+            if (expanding[j] && (expanding[j]->dst == created[i])) {
+                close_file(expanding[j]);
+                expanding[j] = NULL;
+            }
+    }
+    created.clear();
+}
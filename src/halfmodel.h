@@ -0,0 +1,29 @@
+/**
+ * @file halfmodel.h Acoustic model parameters stored in 16-bit floats
+ */
+
+#ifndef __HALFMODEL_H__
+#define __HALFMODEL_H__
+
+#include <string>
+#include <vector>
+
+/**
+ * Expands the parameter files of an acoustic model folder stored
+ * in half precision by tools/hmm_half.js (means.f16, ...) to the
+ * float32 files PocketSphinx reads, unless they exist already.
+ * In JavaScript, these are devices of the virtual file system that
+ * convert the values as they are read, so the model is loaded
+ * without a float32 copy of the files in memory. Natively, they are
+ * written a chunk at a time.
+ *
+ * @param hmm_dir model folder
+ * @param created paths of the files written, to remove with
+ *                hmm_remove_expanded once the model is loaded
+ * @return 0 on success, -1 if a file could not be expanded
+ */
+int hmm_expand_half(const std::string& hmm_dir, std::vector<std::string>& created);
+
+void hmm_remove_expanded(std::vector<std::string>& created);
+
+#endif /* __HALFMODEL_H__ */
@@ -0,0 +1,143 @@
+/**
+ * @file latency.cpp Pruning adaptation to a real-time budget
+ */
+
+#include <string.h>
+
+#include "latency.h"
+#include "fsg_search.h"
+#include "ngram_search.h"
+#include "kws_search.h"
+#include "multisearch.h"
+
+/* Weight of the last measure in the smoothed real-time factor */
+#define RTF_SMOOTHING 0.3f
+/* Pruning is relaxed again below this fraction of the target */
+#define RTF_RELAX 0.7f
+#define SCALE_TIGHTEN 0.85f
+#define SCALE_RELAX 1.05f
+/* Floors of the scaled limits */
+#define MIN_HMMPF 100
+#define MIN_WPF 5
+
+static int32 log_beam(cmd_ln_t *config, logmath_t *lmath, const char *name) {
+    return (int32) logmath_log(lmath, cmd_ln_float64_r(config, name)) >> SENSCR_SHIFT;
+}
+
+void beams_from_config(cmd_ln_t *config, logmath_t *lmath, beam_settings_t *base) {
+    base->beam = log_beam(config, lmath, "-beam");
+    base->wbeam = log_beam(config, lmath, "-wbeam");
+    base->pbeam = log_beam(config, lmath, "-pbeam");
+    base->lpbeam = log_beam(config, lmath, "-lpbeam");
+    base->lponlybeam = log_beam(config, lmath, "-lponlybeam");
+    base->fwdflatbeam = log_beam(config, lmath, "-fwdflatbeam");
+    base->fwdflatwbeam = log_beam(config, lmath, "-fwdflatwbeam");
+    base->maxhmmpf = cmd_ln_int32_r(config, "-maxhmmpf");
+    base->maxwpf = cmd_ln_int32_r(config, "-maxwpf");
+}
+
+static int32 scale_limit(int32 limit, float scale, int32 floor) {
+    int32 scaled;
+    if (limit <= 0) return limit;
+    scaled = (int32) (limit * scale);
+    return (scaled < floor) ? floor : scaled;
+}
+
+int beams_apply(ps_search_t *search, const beam_settings_t *base, float scale) {
+    const char *type;
+    if (search == NULL) return -1;
+    type = ps_search_type(search);
+    if (0 == strcmp(type, PS_SEARCH_TYPE_FSG)) {
+        fsg_search_t *fsgs = (fsg_search_t *) search;
+        fsgs->beam_orig = (int32) (base->beam * scale);
+        fsgs->pbeam_orig = (int32) (base->pbeam * scale);
+        fsgs->wbeam_orig = (int32) (base->wbeam * scale);
+        fsgs->beam = (int32) (fsgs->beam_orig * fsgs->beam_factor);
+        fsgs->pbeam = (int32) (fsgs->pbeam_orig * fsgs->beam_factor);
+        fsgs->wbeam = (int32) (fsgs->wbeam_orig * fsgs->beam_factor);
+        fsgs->maxhmmpf = scale_limit(base->maxhmmpf, scale, MIN_HMMPF);
+    } else if (0 == strcmp(type, PS_SEARCH_TYPE_NGRAM)) {
+        ngram_search_t *ngs = (ngram_search_t *) search;
+        ngs->beam = (int32) (base->beam * scale);
+        ngs->dynbeam = ngs->beam;
+        ngs->pbeam = (int32) (base->pbeam * scale);
+        ngs->wbeam = (int32) (base->wbeam * scale);
+        ngs->lpbeam = (int32) (base->lpbeam * scale);
+        ngs->lponlybeam = (int32) (base->lponlybeam * scale);
+        ngs->fwdflatbeam = (int32) (base->fwdflatbeam * scale);
+        ngs->fwdflatwbeam = (int32) (base->fwdflatwbeam * scale);
+        ngs->maxhmmpf = scale_limit(base->maxhmmpf, scale, MIN_HMMPF);
+        ngs->maxwpf = scale_limit(base->maxwpf, scale, MIN_WPF);
+    } else if (0 == strcmp(type, PS_SEARCH_TYPE_KWS)) {
+        kws_search_t *kwss = (kws_search_t *) search;
+        kwss->beam = (int32) (base->beam * scale);
+    } else if (0 == strcmp(type, PS_SEARCH_TYPE_MULTI)) {
+        for (int i = 0; i < multi_search_n(search); ++i)
+            beams_apply(multi_search_get(search, i), base, scale);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int beams_get(ps_search_t *search, beam_settings_t *out) {
+    const char *type;
+    memset(out, 0, sizeof(*out));
+    if (search == NULL) return -1;
+    type = ps_search_type(search);
+    if (0 == strcmp(type, PS_SEARCH_TYPE_FSG)) {
+        fsg_search_t *fsgs = (fsg_search_t *) search;
+        out->beam = fsgs->beam_orig;
+        out->pbeam = fsgs->pbeam_orig;
+        out->wbeam = fsgs->wbeam_orig;
+        out->maxhmmpf = fsgs->maxhmmpf;
+    } else if (0 == strcmp(type, PS_SEARCH_TYPE_NGRAM)) {
+        ngram_search_t *ngs = (ngram_search_t *) search;
+        out->beam = ngs->beam;
+        out->pbeam = ngs->pbeam;
+        out->wbeam = ngs->wbeam;
+        out->lpbeam = ngs->lpbeam;
+        out->lponlybeam = ngs->lponlybeam;
+        out->fwdflatbeam = ngs->fwdflatbeam;
+        out->fwdflatwbeam = ngs->fwdflatwbeam;
+        out->maxhmmpf = ngs->maxhmmpf;
+        out->maxwpf = ngs->maxwpf;
+    } else if (0 == strcmp(type, PS_SEARCH_TYPE_KWS)) {
+        out->beam = ((kws_search_t *) search)->beam;
+    } else if (0 == strcmp(type, PS_SEARCH_TYPE_MULTI)) {
+        return beams_get(multi_search_get(search, 0), out);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+LatencyController::LatencyController(): target(0), min_scale(1), current_scale(1),
+                                        smoothed_rtf(0), frame_ms(0), frames_per_ms(0.1) {}
+
+void LatencyController::configure(float target_rtf, float min) {
+    target = target_rtf;
+    min_scale = (min > 1) ? 1 : min;
+    current_scale = 1;
+    smoothed_rtf = 0;
+    frame_ms = 0;
+}
+
+bool LatencyController::update(double elapsed_ms, double audio_ms) {
+    if (audio_ms <= 0) return false;
+    float rtf = elapsed_ms / audio_ms;
+    float ms = elapsed_ms / (audio_ms * frames_per_ms);
+    smoothed_rtf = (smoothed_rtf == 0) ? rtf : (RTF_SMOOTHING * rtf + (1 - RTF_SMOOTHING) * smoothed_rtf);
+    frame_ms = (frame_ms == 0) ? ms : (RTF_SMOOTHING * ms + (1 - RTF_SMOOTHING) * frame_ms);
+    if (!enabled()) return false;
+    float scale = current_scale;
+    if (smoothed_rtf > target)
+        scale = current_scale * SCALE_TIGHTEN;
+    else if (smoothed_rtf < RTF_RELAX * target)
+        scale = current_scale * SCALE_RELAX;
+    if (scale < min_scale) scale = min_scale;
+    if (scale > 1) scale = 1;
+    if (scale == current_scale) return false;
+    current_scale = scale;
+    return true;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file latency.h Pruning adaptation to a real-time budget
+ */
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include "pocketsphinx.h"
+#include "pocketsphinx_internal.h"
+
+/**
+ * Pruning settings shared by the search types, beams in the
+ * scaled log domain of the searches.
+ */
+typedef struct beam_settings_s {
+    int32 beam, wbeam, pbeam;
+    int32 lpbeam, lponlybeam;
+    int32 fwdflatbeam, fwdflatwbeam;
+    int32 maxhmmpf, maxwpf;
+} beam_settings_t;
+
+/**
+ * Reads the settings searches are initialized with from the
+ * decoder configuration.
+ */
+void beams_from_config(cmd_ln_t *config, logmath_t *lmath, beam_settings_t *base);
+
+/**
+ * Sets the pruning of an fsg, ngram or kws search, or of the
+ * searches of a multi search, to the base settings scaled by the
+ * given factor, 1 being the base
+ * settings, smaller values pruning harder. Limits on HMMs and
+ * words per frame are scaled too, unless unlimited.
+ *
+ * @return 0, or -1 for no search or other search types, which are
+ *         left unchanged
+ */
+int beams_apply(ps_search_t *search, const beam_settings_t *base, float scale);
+
+/**
+ * Reads the current pruning of a search, fields that the
+ * search does not use are set to 0. A multi search gives the
+ * pruning of its first search.
+ *
+ * @return 0, or -1 for unsupported search types
+ */
+int beams_get(ps_search_t *search, beam_settings_t *out);
+
+/**
+ * Keeps a smoothed real-time factor and derives the beam scale
+ * that holds it under the target.
+ */
+class LatencyController {
+public:
+    LatencyController();
+    void configure(float target_rtf, float min_scale);
+    /** @return true if the scale changed */
+    bool update(double elapsed_ms, double audio_ms);
+    bool enabled() const { return target > 0; }
+    float targetRtf() const { return target; }
+    float rtf() const { return smoothed_rtf; }
+    float scale() const { return current_scale; }
+    float frameMs() const { return frame_ms; }
+    void setFrameRate(int frate) { frames_per_ms = frate / 1000.0; }
+
+private:
+    float target;
+    float min_scale;
+    float current_scale;
+    float smoothed_rtf;
+    float frame_ms;
+    double frames_per_ms;
+};
+
+#endif /* __LATENCY_H__ */
@@ -0,0 +1,86 @@
+/**
+ * @file lazydict.cpp Pronunciation dictionary read on demand
+ */
+
+#include <string.h>
+#include <algorithm>
+
+#include "lazydict.h"
+
+#define MAX_LINE 4096
+
+// FNV-1a of the word, up to the "(" of an alternate number
+static uint32_t word_hash(const char *word, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; (i < len) && (word[i] != '('); i++) {
+        h ^= (unsigned char) word[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t base_length(const char *word, size_t len) {
+    const char *paren = (const char *) memchr(word, '(', len);
+    return paren ? paren - word : len;
+}
+
+static size_t token_length(const char *s) {
+    return strcspn(s, " \t\r\n");
+}
+
+LazyDictionary::LazyDictionary(): file(NULL), line(MAX_LINE) {}
+
+LazyDictionary::~LazyDictionary() {
+    close();
+}
+
+int LazyDictionary::open(const char *path) {
+    close();
+    if ((file = fopen(path, "r")) == NULL)
+        return -1;
+    long offset = ftell(file);
+    while (fgets(&line[0], line.size(), file)) {
+        const char *w = &line[0] + strspn(&line[0], " \t");
+        size_t len = token_length(w);
+        // Comments start with ";;"
+        if ((len > 0) && strncmp(w, ";;", 2))
+            index.push_back(((uint64_t) word_hash(w, len) << 32) | (uint32_t) offset);
+        // Skip the rest of lines longer than the buffer
+        while (!strchr(&line[0], '\n') && fgets(&line[0], line.size(), file))
+            ;
+        offset = ftell(file);
+    }
+    std::sort(index.begin(), index.end());
+    std::vector<uint64_t>(index).swap(index);
+    return 0;
+}
+
+void LazyDictionary::close() {
+    if (file) fclose(file);
+    file = NULL;
+    std::vector<uint64_t>().swap(index);
+}
+
+int LazyDictionary::lookup(const std::string& word, DictEntries& entries) {
+    entries.clear();
+    if ((file == NULL) || word.empty()) return 0;
+    size_t base = base_length(word.c_str(), word.size());
+    uint64_t key = (uint64_t) word_hash(word.c_str(), base) << 32;
+    for (std::vector<uint64_t>::iterator i = std::lower_bound(index.begin(), index.end(), key);
+         (i != index.end()) && ((*i & 0xffffffff00000000ULL) == key); ++i) {
+        if ((fseek(file, (long) (*i & 0xffffffffULL), SEEK_SET) < 0)
+            || (fgets(&line[0], line.size(), file) == NULL))
+            continue;
+        const char *w = &line[0] + strspn(&line[0], " \t");
+        size_t len = token_length(w);
+        // Hash collisions
+        if ((base_length(w, len) != base) || strncmp(w, word.c_str(), base))
+            continue;
+        const char *phones = w + len + strspn(w + len, " \t");
+        size_t phones_len = strcspn(phones, "\r\n");
+        while ((phones_len > 0) && strchr(" \t", phones[phones_len - 1])) phones_len--;
+        if (phones_len > 0)
+            entries.push_back(std::make_pair(std::string(w, len), std::string(phones, phones_len)));
+    }
+    return entries.size();
+}
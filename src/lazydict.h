@@ -0,0 +1,49 @@
+/**
+ * @file lazydict.h Pronunciation dictionary read on demand
+ */
+
+#ifndef __LAZYDICT_H__
+#define __LAZYDICT_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+typedef std::vector<std::pair<std::string, std::string> > DictEntries;
+
+/**
+ * Index of a dictionary file in the Sphinx format, which keeps the
+ * file open and reads the pronunciations of a word when asked for
+ * them. Each entry takes 8 bytes, a hash of the word without its
+ * alternate number and the offset of its line, so that memory does
+ * not depend on the length of words and pronunciations.
+ */
+class LazyDictionary {
+public:
+    LazyDictionary();
+    ~LazyDictionary();
+    /** @return 0, or -1 if the file cannot be read */
+    int open(const char *path);
+    void close();
+    bool isOpen() const { return file != NULL; }
+    /**
+     * Reads the pronunciations of a word and of its alternates,
+     * "WORD(2)" and so on, in file order.
+     *
+     * @return number of entries found
+     */
+    int lookup(const std::string& word, DictEntries& entries);
+    size_t size() const { return index.size(); }
+    size_t bytes() const { return index.capacity() * sizeof(uint64_t); }
+
+private:
+    LazyDictionary(const LazyDictionary&);
+    LazyDictionary& operator=(const LazyDictionary&);
+    FILE *file;
+    std::vector<uint64_t> index;
+    std::vector<char> line;
+};
+
+#endif /* __LAZYDICT_H__ */
@@ -0,0 +1,109 @@
+/**
+ * @file multisearch.cpp Several searches decoding the same utterance
+ */
+
+#include <vector>
+
+#include "multisearch.h"
+
+namespace {
+
+struct MultiSearch {
+    ps_search_t base;
+    std::vector<ps_search_t *> searches;
+};
+
+}
+
+static MultiSearch *multi_search(ps_search_t *search) {
+    return reinterpret_cast<MultiSearch *>(search);
+}
+
+static ps_search_t *primary(ps_search_t *search) {
+    return multi_search(search)->searches[0];
+}
+
+static int multi_search_start(ps_search_t *search) {
+    MultiSearch *ms = multi_search(search);
+    for (size_t i = 0; i < ms->searches.size(); ++i)
+        if (ps_search_start(ms->searches[i]) < 0) return -1;
+    return 0;
+}
+
+static int multi_search_step(ps_search_t *search, int frame_idx) {
+    MultiSearch *ms = multi_search(search);
+    acmod_t *acmod = ps_search_acmod(search);
+    uint8 compallsen = acmod->compallsen;
+    int rv = 0;
+    // acmod_score only reuses the scores of a frame when all
+    // senones are computed, otherwise each search would score the
+    // frame again with its own active senones
+    acmod->compallsen = TRUE;
+    for (size_t i = 0; (rv >= 0) && (i < ms->searches.size()); ++i)
+        rv = ps_search_step(ms->searches[i], frame_idx);
+    acmod->compallsen = compallsen;
+    return rv;
+}
+
+static int multi_search_finish(ps_search_t *search) {
+    MultiSearch *ms = multi_search(search);
+    int rv = 0;
+    for (size_t i = 0; i < ms->searches.size(); ++i)
+        if (ps_search_finish(ms->searches[i]) < 0) rv = -1;
+    return rv;
+}
+
+// The decoder reinitializes the searches it owns
+static int multi_search_reinit(ps_search_t *, dict_t *, dict2pid_t *) {
+    return 0;
+}
+
+static void multi_search_free(ps_search_t *search) {
+    ps_search_base_free(search);
+    delete multi_search(search);
+}
+
+static ps_lattice_t *multi_search_lattice(ps_search_t *search) {
+    return ps_search_lattice(primary(search));
+}
+
+static char const *multi_search_hyp(ps_search_t *search, int32 *out_score) {
+    return ps_search_hyp(primary(search), out_score);
+}
+
+static int32 multi_search_prob(ps_search_t *search) {
+    return ps_search_prob(primary(search));
+}
+
+static ps_seg_t *multi_search_seg_iter(ps_search_t *search) {
+    return ps_search_seg_iter(primary(search));
+}
+
+static ps_searchfuncs_t multi_search_funcs = {
+    /* start: */  multi_search_start,
+    /* step: */   multi_search_step,
+    /* finish: */ multi_search_finish,
+    /* reinit: */ multi_search_reinit,
+    /* free: */   multi_search_free,
+    /* lattice: */  multi_search_lattice,
+    /* hyp: */      multi_search_hyp,
+    /* prob: */     multi_search_prob,
+    /* seg_iter: */ multi_search_seg_iter,
+};
+
+ps_search_t *multi_search_init(ps_decoder_t *ps, ps_search_t **searches, int n_searches) {
+    if (n_searches < 1) return NULL;
+    MultiSearch *ms = new MultiSearch();
+    ps_search_init(&ms->base, &multi_search_funcs, PS_SEARCH_TYPE_MULTI, PS_SEARCH_TYPE_MULTI,
+                   ps->config, ps->acmod, ps->dict, ps->d2p);
+    ms->searches.assign(searches, searches + n_searches);
+    return &ms->base;
+}
+
+int multi_search_n(ps_search_t *search) {
+    return multi_search(search)->searches.size();
+}
+
+ps_search_t *multi_search_get(ps_search_t *search, int i) {
+    return multi_search(search)->searches[i];
+}
@@ -0,0 +1,31 @@
+/**
+ * @file multisearch.h Several searches decoding the same utterance
+ */
+
+#ifndef __MULTISEARCH_H__
+#define __MULTISEARCH_H__
+
+#include "pocketsphinx.h"
+#include "pocketsphinx_internal.h"
+
+#define PS_SEARCH_TYPE_MULTI "multi"
+
+/**
+ * Creates a search that runs the given searches side by side,
+ * stepping each of them on every frame. The frame is scored once
+ * for all of them: all senones are computed by the first search
+ * and the others read the scores cached by the acoustic model, so
+ * the acoustic cost does not grow with the number of searches.
+ *
+ * The hypothesis, segmentation, lattice and probability are those
+ * of the first search. The searches stay owned by the decoder and
+ * must outlive this one, which is not registered with the decoder
+ * and is freed with ps_search_free.
+ */
+ps_search_t *multi_search_init(ps_decoder_t *ps, ps_search_t **searches, int n_searches);
+
+/** Number of searches and each of them, in the order given. */
+int multi_search_n(ps_search_t *search);
+ps_search_t *multi_search_get(ps_search_t *search, int i);
+
+#endif /* __MULTISEARCH_H__ */
@@ -0,0 +1,129 @@
+/**
+ * @file pronmodel.cpp Pronunciation scoring model run on featex output
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "pronmodel.h"
+
+/* Phones scored at once. Rows of the block are contiguous phones,
+   so that the inner loops are plain multiply-adds over arrays,
+   which the compiler vectorizes */
+#define PRON_BLOCK 64
+#define HEADER_INTS 4
+
+static uint32_t read_le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Reads n floats, advancing the position
+static void read_floats(const unsigned char *&p, std::vector<float>& out, int n) {
+    out.resize(n);
+    for (int i = 0; i < n; ++i, p += 4) {
+        uint32_t bits = read_le32(p);
+        memcpy(&out[i], &bits, sizeof(float));
+    }
+}
+
+PronModel::PronModel(): inputs(0), hidden(0), activation(PRON_MODEL_RELU), output_bias(0) {}
+
+int PronModel::load(const std::string& data, int n_inputs) {
+    inputs = 0;
+    std::vector<float>().swap(block_inputs);
+    std::vector<float>().swap(block_hidden);
+    if (data.size() == 0) return 0;
+    const unsigned char *p = (const unsigned char *) data.data();
+    if ((data.size() < 4 * (1 + HEADER_INTS)) || memcmp(p, "PSPM", 4)
+        || (read_le32(p + 4) != PRON_MODEL_VERSION))
+        return -1;
+    int32_t n_in = (int32_t) read_le32(p + 8);
+    int32_t n_hidden = (int32_t) read_le32(p + 12);
+    int32_t act = (int32_t) read_le32(p + 16);
+    if ((n_in != n_inputs) || (n_hidden < 0) || (n_hidden > 4096)
+        || ((act != PRON_MODEL_RELU) && (act != PRON_MODEL_TANH)))
+        return -1;
+    size_t n_floats = 2 * n_in + n_hidden * (n_in + 1) + (n_hidden ? n_hidden : n_in) + 1;
+    if (data.size() != 4 * (1 + HEADER_INTS) + 4 * n_floats) return -1;
+    p += 4 * (1 + HEADER_INTS);
+    read_floats(p, mean, n_in);
+    read_floats(p, scale, n_in);
+    read_floats(p, hidden_weights, n_hidden * n_in);
+    read_floats(p, hidden_biases, n_hidden);
+    read_floats(p, output_weights, n_hidden ? n_hidden : n_in);
+    std::vector<float> bias;
+    read_floats(p, bias, 1);
+    output_bias = bias[0];
+    hidden = n_hidden;
+    activation = act;
+    block_inputs.resize(n_in * PRON_BLOCK);
+    block_hidden.resize(PRON_BLOCK);
+    inputs = n_in;
+    return 0;
+}
+
+void PronModel::score(const std::vector<float>& feats, const std::vector<int>& phone_words,
+                      std::vector<float>& phone_scores, std::vector<float>& word_scores) {
+    int n_phones = phone_words.size();
+    if (n_phones * inputs > feats.size()) n_phones = feats.size() / inputs;
+    phone_scores.assign(n_phones, 0);
+    word_scores.clear();
+    if (!loaded()) return;
+    for (int first = 0; first < n_phones; first += PRON_BLOCK) {
+        int n = (n_phones - first < PRON_BLOCK) ? (n_phones - first) : PRON_BLOCK;
+        // Standardized inputs, one row per input
+        for (int i = 0; i < inputs; ++i) {
+            float *x = &block_inputs[i * PRON_BLOCK];
+            const float *f = &feats[first * inputs + i];
+            const float m = mean[i], s = scale[i];
+            for (int k = 0; k < n; ++k)
+                x[k] = (f[k * inputs] - m) * s;
+        }
+        float *out = &phone_scores[first];
+        for (int k = 0; k < n; ++k) out[k] = output_bias;
+        if (hidden == 0) {
+            for (int i = 0; i < inputs; ++i) {
+                const float *x = &block_inputs[i * PRON_BLOCK];
+                const float w = output_weights[i];
+                for (int k = 0; k < n; ++k) out[k] += w * x[k];
+            }
+        }
+        for (int h = 0; h < hidden; ++h) {
+            float *acc = &block_hidden[0];
+            const float *w = &hidden_weights[h * inputs];
+            for (int k = 0; k < n; ++k) acc[k] = hidden_biases[h];
+            for (int i = 0; i < inputs; ++i) {
+                const float *x = &block_inputs[i * PRON_BLOCK];
+                const float wi = w[i];
+                for (int k = 0; k < n; ++k) acc[k] += wi * x[k];
+            }
+            if (activation == PRON_MODEL_TANH)
+                for (int k = 0; k < n; ++k) acc[k] = tanhf(acc[k]);
+            else
+                for (int k = 0; k < n; ++k) acc[k] = (acc[k] > 0) ? acc[k] : 0;
+            const float wo = output_weights[h];
+            for (int k = 0; k < n; ++k) out[k] += wo * acc[k];
+        }
+        for (int k = 0; k < n; ++k) out[k] = 1 / (1 + expf(-out[k]));
+    }
+    // Words average the scores of their phones
+    std::vector<int> counts;
+    for (int k = 0; k < n_phones; ++k) {
+        int w = phone_words[k];
+        if (w < 0) continue;
+        if (w >= word_scores.size()) {
+            word_scores.resize(w + 1, 0);
+            counts.resize(w + 1, 0);
+        }
+        word_scores[w] += phone_scores[k];
+        counts[w]++;
+    }
+    for (int w = 0; w < word_scores.size(); ++w)
+        if (counts[w] > 0) word_scores[w] /= counts[w];
+}
+
+size_t PronModel::bytes() const {
+    return sizeof(float) * (mean.capacity() + scale.capacity() + hidden_weights.capacity()
+                            + hidden_biases.capacity() + output_weights.capacity()
+                            + block_inputs.capacity() + block_hidden.capacity());
+}
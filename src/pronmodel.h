@@ -0,0 +1,57 @@
+/**
+ * @file pronmodel.h Pronunciation scoring model run on featex output
+ */
+
+#ifndef __PRONMODEL_H__
+#define __PRONMODEL_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/* Layout, integers 32-bit and floats 32-bit, little-endian:
+   "PSPM", version, number of inputs, number of hidden units (0 for
+   a logistic regression), hidden activation, then the floats: mean
+   and scale of each input, which is standardized as
+   (x - mean) * scale, the hidden weights (one row of inputs per
+   unit) and biases, the output weights (one per hidden unit, or
+   per input without hidden layer) and the output bias. The output
+   goes through a sigmoid. */
+#define PRON_MODEL_VERSION 1
+#define PRON_MODEL_RELU 0
+#define PRON_MODEL_TANH 1
+
+class PronModel {
+public:
+    PronModel();
+    /**
+     * Reads a model packed by tools/pron_model_pack.js, an empty
+     * blob removes the model.
+     *
+     * @return 0, or -1 if the blob is malformed or its number of
+     *         inputs is not the given one, the model is then removed
+     */
+    int load(const std::string& data, int n_inputs);
+    bool loaded() const { return inputs > 0; }
+    /**
+     * Scores the phones of featex output, n_inputs features per
+     * phone, and averages them over the words the phones belong
+     * to. Scores are between 0 and 1.
+     */
+    void score(const std::vector<float>& feats, const std::vector<int>& phone_words,
+               std::vector<float>& phone_scores, std::vector<float>& word_scores);
+    size_t bytes() const;
+private:
+    int inputs;
+    int hidden;
+    int activation;
+    std::vector<float> mean, scale;
+    std::vector<float> hidden_weights, hidden_biases;
+    std::vector<float> output_weights;
+    float output_bias;
+    // Inputs and hidden units of a block of phones, one row per
+    // input or unit, kept between calls
+    std::vector<float> block_inputs, block_hidden;
+};
+
+#endif /* __PRONMODEL_H__ */
@@ -1,5 +1,12 @@
+#include <algorithm>
+#include <malloc.h>
+#include <limits.h>
 #include "psRecognizer.h"
 #include "pocketsphinxjs-config.h"
+#include "clock.h"
+#include "fsgblob.h"
+#include "fsg_search.h"
+#include "kws_search.h"
 
 
 namespace pocketsphinxjs {
@@ -8,137 +15,1529 @@ namespace pocketsphinxjs {
 
   // Implemented later in this file
   ReturnType parseStringList(const std::string &, StringsSetType*, std::string*);
+  int heapInUse();
 
-  Recognizer::Recognizer(): is_fsg(true), is_recording(false), current_hyp(""), grammar_index(0) {
+  // Layout version of exportAdaptationState
+  const float ADAPTATION_STATE_VERSION = 1;
+  // Frames a word must have ended before the current frame, and
+  // be in two successive hypotheses, to be reported final
+  const int EVENT_STABLE_FRAMES = 30;
+  // Longest audio fed again to the next utterance when the
+  // continuous mode rolls over in the middle of speech
+  const int CONTINUOUS_OVERLAP_FRAMES = 100;
+  // Frames of alignment per step of a background job
+  const int JOB_ALIGN_FRAMES = 50;
+  // Stored frames decoded again at a time
+  const int STORED_BLOCK_FRAMES = 256;
+
+  // Trace arguments of a list of transitions or of floats
+  static void traceTransitions(TraceArgs& args, const std::vector<Transition>& transitions) {
+    args.i32(transitions.size());
+    for (int i = 0; i < transitions.size(); ++i) {
+      const Transition& t = transitions.at(i);
+      args.i32(t.from).i32(t.to).i32(t.logp).str(t.word);
+    }
+  }
+
+  static void traceFeats(TraceArgs& args, const Feats& values) {
+    args.i32(values.size());
+    for (int i = 0; i < values.size(); ++i) args.f32(values.at(i));
+  }
+
+  // Frees what a search keeps of the last utterance: its lattice,
+  // and the word history of grammars or the key phrases spotted.
+  // The next utterance starts from scratch anyway.
+  static void releaseSearchUtterance(ps_search_t *search) {
+    if (search == NULL) return;
+    if (search->dag) ps_lattice_free(search->dag);
+    search->dag = NULL;
+    const char *type = ps_search_type(search);
+    if (0 == strcmp(type, PS_SEARCH_TYPE_FSG))
+      fsg_history_reset(((fsg_search_t *) search)->history);
+    else if (0 == strcmp(type, PS_SEARCH_TYPE_KWS))
+      kws_detections_reset(((kws_search_t *) search)->detections);
+    else if (0 == strcmp(type, PS_SEARCH_TYPE_MULTI))
+      for (int i = 0; i < multi_search_n(search); ++i)
+        releaseSearchUtterance(multi_search_get(search, i));
+  }
+
+  Recognizer::Recognizer(): is_fsg(true), is_recording(false), current_hyp(""), grammar_index(0), decoder(NULL), logmath(NULL), lattice_ready(false), nbest_itor(NULL), nbest_exhausted(false), init_bytes(0), init_dictionary_bytes(0), utterance_start_bytes(0), lm_set(NULL), lm_set_index(-1), lm_set_bytes(0), samprate(16000), feature_store_max(0), feature_store_frames(0), feature_store_complete(false), ncep(0), history_max(0), utterance_offset(0), skip_frames(0), events_max(0), words_final(0), word_events_end(-1), word_skip_frames(0), multi_search(NULL), job_decoder(NULL), job_words(0), job_status(), job_heap_start(0), job_al(NULL), al(NULL), search(NULL) {
     Config c;
     if (init(c) != SUCCESS) cleanup();
   }
 
-  Recognizer::Recognizer(const Config& config) : is_fsg(true), is_recording(false), current_hyp(""), grammar_index(0) {
-    if (init(config) != SUCCESS) cleanup();
+  Recognizer::Recognizer(const Config& config) : is_fsg(true), is_recording(false), current_hyp(""), grammar_index(0), decoder(NULL), logmath(NULL), lattice_ready(false), nbest_itor(NULL), nbest_exhausted(false), init_bytes(0), init_dictionary_bytes(0), utterance_start_bytes(0), lm_set(NULL), lm_set_index(-1), lm_set_bytes(0), samprate(16000), feature_store_max(0), feature_store_frames(0), feature_store_complete(false), ncep(0), history_max(0), utterance_offset(0), skip_frames(0), events_max(0), words_final(0), word_events_end(-1), word_skip_frames(0), multi_search(NULL), job_decoder(NULL), job_words(0), job_status(), job_heap_start(0), job_al(NULL), al(NULL), search(NULL) {
+    double t = clock_ms();
+    ReturnType r = init(config);
+    if (r != SUCCESS) cleanup();
+    traceInit(config, r, clock_ms() - t);
   }
 
   ReturnType Recognizer::reInit(const Config& config) {
+    double t = clock_ms();
+    clearUtteranceResults();
+    // Adaptation carries over if the new features are the same
+    Feats state;
+    if (decoder) exportAdaptationState(state);
     ReturnType r = init(config);
     if (r != SUCCESS) cleanup();
+    else if (state.size() > 0) restoreAdaptationState(state);
+    traceInit(config, r, clock_ms() - t);
     return r;
   }
 
+  // The configuration is recorded without -trace, so that a
+  // replay does not record again
+  void Recognizer::traceInit(const Config& config, ReturnType result, double ms) {
+    if (!tracer.isOpen()) return;
+    TraceArgs args;
+    int n = 0;
+    for (int i = 0; i < config.size(); ++i)
+      if (config[i].key != "-trace") n++;
+    args.i32(n);
+    for (int i = 0; i < config.size(); ++i)
+      if (config[i].key != "-trace") args.str(config[i].key).str(config[i].value);
+    tracer.write(TRACE_INIT, args, result, ms, "");
+  }
+
   ReturnType Recognizer::addWords(const std::vector<Word>& words) {
-    if (decoder == NULL) return BAD_STATE;
+    TraceScope trace(tracer, TRACE_ADD_WORDS);
+    trace.args().i32(words.size());
+    for (int i = 0; i < words.size(); ++i)
+      trace.args().str(words.at(i).word).str(words.at(i).pronunciation);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    // Batch decoders are loaded again with the new words
+    freeBatchWorkers();
     for (int i=0 ; i<words.size() ; ++i) {
       // This case is not properly handeled by ps_add_word, so we treat it separately
-      if (words.at(i).pronunciation.size() == 0) return RUNTIME_ERROR;
-      if (ps_add_word(decoder, words.at(i).word.c_str(), words.at(i).pronunciation.c_str(), 1) < 0) return RUNTIME_ERROR;
+      if (words.at(i).pronunciation.size() == 0) return trace.end(RUNTIME_ERROR);
+      if (ps_add_word(decoder, words.at(i).word.c_str(), words.at(i).pronunciation.c_str(), 1) < 0) return trace.end(RUNTIME_ERROR);
+      added_words.push_back(words.at(i));
+    }
+    return trace.end(SUCCESS);
+  }
+
+  /*******************************************
+   *
+   * With "-lazy_dict" instead of "-dict", the dictionary file is
+   * only indexed at init. Words are read from it and added to the
+   * decoder, with their cross-word triphones, when a grammar, key
+   * phrase, language model, lookup or alignment first uses them,
+   * so that startup and memory follow the words in use.
+   *
+   *****************************************/
+  bool Recognizer::resolveWord(const std::string& word) {
+    if (ps_lookup_word(decoder, word.c_str())) return true;
+    DictEntries entries;
+    if (lazy_dict.lookup(word, entries) == 0) return false;
+    // Searches that use the new words are built after this
+    for (int i = 0; i < entries.size(); ++i) {
+      if (ps_add_word(decoder, entries.at(i).first.c_str(), entries.at(i).second.c_str(), 0) < 0) continue;
+      Word w;
+      w.word = entries.at(i).first;
+      w.pronunciation = entries.at(i).second;
+      added_words.push_back(w);
+    }
+    freeBatchWorkers();
+    return ps_lookup_word(decoder, word.c_str()) != NULL;
+  }
+
+  void Recognizer::resolveWords(const std::string& text, const char *separators) {
+    if (!lazy_dict.isOpen()) return;
+    size_t start = text.find_first_not_of(separators);
+    while (start != std::string::npos) {
+      size_t end = text.find_first_of(separators, start);
+      resolveWord(text.substr(start, (end == std::string::npos) ? end : end - start));
+      start = text.find_first_not_of(separators, end);
     }
-    return SUCCESS;
   }
 
   ReturnType Recognizer::addGrammar(Integers& id, const Grammar& grammar) {
-    if (decoder == NULL) return BAD_STATE;
+    TraceScope trace(tracer, TRACE_ADD_GRAMMAR);
+    traceTransitions(trace.args().i32(grammar.numStates).i32(grammar.start).i32(grammar.end), grammar.transitions);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    int heap_before = heapInUse();
     std::ostringstream grammar_name;
     grammar_name << grammar_index;
     grammar_names.push_back(grammar_name.str());
     current_grammar = fsg_model_init(grammar_names.back().c_str(), logmath, 1.0, grammar.numStates);
     if (current_grammar == NULL)
-      return RUNTIME_ERROR;
+      return trace.end(RUNTIME_ERROR);
     current_grammar->start_state = grammar.start;
     current_grammar->final_state = grammar.end;
+    WordTransitions& index = grammar_transitions[grammar_index];
+    index.clear();
     for (int i=0;i<grammar.transitions.size();i++) {
-      if ((grammar.transitions.at(i).word.size() > 0) && (ps_lookup_word(decoder, grammar.transitions.at(i).word.c_str())))
-	fsg_model_trans_add(current_grammar, grammar.transitions.at(i).from, grammar.transitions.at(i).to, grammar.transitions.at(i).logp, fsg_model_word_add(current_grammar, grammar.transitions.at(i).word.c_str()));
-      else
-	fsg_model_null_trans_add(current_grammar, grammar.transitions.at(i).from, grammar.transitions.at(i).to, grammar.transitions.at(i).logp);
+      const Transition& t = grammar.transitions.at(i);
+      if ((t.word.size() > 0) && resolveWord(t.word)) {
+	fsg_model_trans_add(current_grammar, t.from, t.to, t.logp, fsg_model_word_add(current_grammar, t.word.c_str()));
+	index.insert(std::make_pair(t.word, std::make_pair(t.from, t.to)));
+      }
+      else {
+	fsg_model_null_trans_add(current_grammar, t.from, t.to, t.logp);
+	index.insert(std::make_pair(std::string(""), std::make_pair(t.from, t.to)));
+      }
     }
     fsg_model_add_silence(current_grammar, "<sil>", -1, 1.0);
 
     if(ps_set_fsg(decoder, grammar_names.back().c_str(), current_grammar)) {
-      return RUNTIME_ERROR;
+      return trace.end(RUNTIME_ERROR);
+    }
+    return trace.end(searchAdded(id, heap_before));
+  }
+
+  /*******************************************
+   *
+   * Fast paths for large grammars, which take seconds to cross
+   * the JavaScript boundary one Transition at a time. A JSGF
+   * source goes to the JSGF parser of sphinxbase as one string.
+   * A blob from tools/fsg_pack.js holds each word once and the
+   * arcs as packed integers. Both grammars can then be edited
+   * like the ones of addGrammar.
+   *
+   *****************************************/
+  ReturnType Recognizer::addGrammarJsgf(Integers& id, const std::string& jsgf) {
+    TraceScope trace(tracer, TRACE_ADD_GRAMMAR_JSGF);
+    trace.args().str(jsgf);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    if (jsgf.size() == 0) return trace.end(BAD_ARGUMENT);
+    int heap_before = heapInUse();
+    // Rule names and other tokens are simply not found
+    resolveWords(jsgf, " \t\r\n()[]<>{}|*+;=/");
+    std::ostringstream grammar_name;
+    grammar_name << grammar_index;
+    if (ps_set_jsgf_string(decoder, grammar_name.str().c_str(), jsgf.c_str()))
+      return trace.end(RUNTIME_ERROR);
+    grammar_names.push_back(grammar_name.str());
+    fsg_model_t *fsg = ps_get_fsg(decoder, grammar_names.back().c_str());
+    if (fsg == NULL) return trace.end(RUNTIME_ERROR);
+    // Index the arcs the JSGF compiler made, for editing
+    WordTransitions& index = grammar_transitions[grammar_index];
+    index.clear();
+    for (int i = 0; i < fsg_model_n_state(fsg); ++i) {
+      for (fsg_arciter_t *itor = fsg_model_arcs(fsg, i); itor; itor = fsg_arciter_next(itor)) {
+	fsg_link_t *link = fsg_arciter_get(itor);
+	int32 wid = fsg_link_wid(link);
+	if ((wid >= 0) && fsg_model_is_filler(fsg, wid)) continue;
+	index.insert(std::make_pair(std::string((wid < 0) ? "" : fsg_model_word_str(fsg, wid)),
+				    std::make_pair(fsg_link_from_state(link), fsg_link_to_state(link))));
+      }
+    }
+    return trace.end(searchAdded(id, heap_before));
+  }
+
+  ReturnType Recognizer::addGrammarBinary(Integers& id, const std::string& blob) {
+    TraceScope trace(tracer, TRACE_ADD_GRAMMAR_BINARY);
+    trace.args().str(blob);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    FsgBlob grammar;
+    if (fsg_blob_parse(blob, &grammar) < 0) return trace.end(BAD_ARGUMENT);
+    int heap_before = heapInUse();
+    std::ostringstream grammar_name;
+    grammar_name << grammar_index;
+    grammar_names.push_back(grammar_name.str());
+    current_grammar = fsg_model_init(grammar_names.back().c_str(), logmath, 1.0, grammar.numStates);
+    if (current_grammar == NULL)
+      return trace.end(RUNTIME_ERROR);
+    current_grammar->start_state = grammar.start;
+    current_grammar->final_state = grammar.end;
+    // Words are looked up once, unknown ones make null transitions
+    // as in addGrammar
+    std::vector<int32> wids(grammar.words.size(), -1);
+    for (int i = 0; i < grammar.words.size(); ++i)
+      if (resolveWord(grammar.words.at(i)))
+	wids.at(i) = fsg_model_word_add(current_grammar, grammar.words.at(i));
+    WordTransitions& index = grammar_transitions[grammar_index];
+    index.clear();
+    for (int i = 0; i < grammar.numArcs(); ++i) {
+      const int32_t *arc = &grammar.arcs[i * FSG_BLOB_ARC_SIZE];
+      int32 wid = (arc[3] < 0) ? -1 : wids.at(arc[3]);
+      if (wid >= 0) {
+	fsg_model_trans_add(current_grammar, arc[0], arc[1], arc[2], wid);
+	index.insert(std::make_pair(std::string(grammar.words.at(arc[3])), std::make_pair(arc[0], arc[1])));
+      }
+      else {
+	fsg_model_null_trans_add(current_grammar, arc[0], arc[1], arc[2]);
+	index.insert(std::make_pair(std::string(""), std::make_pair(arc[0], arc[1])));
+      }
     }
+    fsg_model_add_silence(current_grammar, "<sil>", -1, 1.0);
+
+    if(ps_set_fsg(decoder, grammar_names.back().c_str(), current_grammar)) {
+      return trace.end(RUNTIME_ERROR);
+    }
+    return trace.end(searchAdded(id, heap_before));
+  }
+
+  // Accounts for the search just set with the last name of
+  // grammar_names, gives its id and selects it
+  ReturnType Recognizer::searchAdded(Integers& id, int heap_before) {
+    registerSearchMemory(grammar_index, heapInUse() - heap_before);
     if (id.size() == 0) id.push_back(grammar_index);
     else id.at(0) = grammar_index;
     grammar_index++;
-    // We switch to the newly added grammar right away
+    // We switch to the newly added search right away
     if (ps_set_search(decoder, grammar_names.back().c_str())) {
       return RUNTIME_ERROR;
     }
+    dropSearches();
     return SUCCESS;
   }
 
 
   ReturnType Recognizer::addKeyword(Integers& id, const std::string& keyphrase) {
-    if (decoder == NULL) return BAD_STATE;
+    TraceScope trace(tracer, TRACE_ADD_KEYWORD);
+    trace.args().str(keyphrase);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    int heap_before = heapInUse();
+    resolveWords(keyphrase, " \t\r\n");
     std::ostringstream search_name;
     search_name << grammar_index;
     grammar_names.push_back(search_name.str());
     if(ps_set_keyphrase(decoder, grammar_names.back().c_str(), keyphrase.c_str())) {
-      return RUNTIME_ERROR;
+      return trace.end(RUNTIME_ERROR);
     }
-    if (id.size() == 0) id.push_back(grammar_index);
-    else id.at(0) = grammar_index;
-    grammar_index++;
-    // We switch to the newly added search right away
-    if (ps_set_search(decoder, grammar_names.back().c_str())) {
+    return trace.end(searchAdded(id, heap_before));
+  }
+
+
+  /*******************************************
+   *
+   * Reads a language model and adds it to the model set, which
+   * is created, with its own search, on the first call. All
+   * models of the set share one word mapping, so switching
+   * between them does not touch the search or the acoustic
+   * model. Adding a model rebuilds the search once for the
+   * words it brings. The id is the one of the set's search,
+   * the same for every model, and the new model is selected.
+   *
+   *****************************************/
+  ReturnType Recognizer::addLanguageModel(Integers& id, const std::string& name, const std::string& path) {
+    TraceScope trace(tracer, TRACE_ADD_LANGUAGE_MODEL);
+    trace.args().str(name).str(path);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if ((name.size() == 0) || (path.size() == 0)) return trace.end(BAD_ARGUMENT);
+    if (lm_set && ngram_model_set_lookup(lm_set, name.c_str())) return trace.end(BAD_ARGUMENT);
+    int heap_before = heapInUse();
+    ngram_model_t *lm = ngram_model_read(ps_get_config(decoder), path.c_str(), NGRAM_AUTO, ps_get_logmath(decoder));
+    if (lm == NULL) return trace.end(RUNTIME_ERROR);
+    // The search maps every word of the model to the dictionary
+    if (lazy_dict.isOpen())
+      for (int i = 0; i < ngram_model_get_counts(lm)[0]; ++i)
+	resolveWord(ngram_word(lm, i));
+    if (lm_set == NULL) {
+      char *lm_name = (char *) name.c_str();
+      ngram_model_t *set = ngram_model_set_init(ps_get_config(decoder), &lm, &lm_name, NULL, 1);
+      if (set == NULL) {
+	ngram_model_free(lm);
+	return trace.end(RUNTIME_ERROR);
+      }
+      std::ostringstream search_name;
+      search_name << grammar_index;
+      // The search keeps its own reference to the set
+      int rv = ps_set_lm(decoder, search_name.str().c_str(), set);
+      ngram_model_free(set);
+      if (rv) return trace.end(RUNTIME_ERROR);
+      grammar_names.push_back(search_name.str());
+      lm_set = ps_get_lm(decoder, grammar_names.back().c_str());
+      lm_set_index = grammar_index++;
+    } else {
+      if (ngram_model_set_add(lm_set, lm, name.c_str(), 1.0, FALSE) == NULL) {
+	ngram_model_free(lm);
+	return trace.end(RUNTIME_ERROR);
+      }
+      // Words of the new model get mapped, and the search is
+      // updated for them
+      ps_search_t *lm_search = (ps_search_t *) NULL;
+      if ((hash_table_lookup(decoder->searches, grammar_names.at(lm_set_index).c_str(), (void **) &lm_search) < 0)
+	  || (ps_search_reinit(lm_search, decoder->dict, decoder->d2p) < 0))
+	return trace.end(RUNTIME_ERROR);
+    }
+    if (ngram_model_set_select(lm_set, name.c_str()) == NULL) return trace.end(RUNTIME_ERROR);
+    lm_set_bytes += heapInUse() - heap_before;
+    registerSearchMemory(lm_set_index, lm_set_bytes);
+    // Batch decoders share the set but need the new words
+    batch_searches.erase(grammar_names.at(lm_set_index));
+    if (id.size() == 0) id.push_back(lm_set_index);
+    else id.at(0) = lm_set_index;
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::selectLanguageModel(const std::string& name) {
+    TraceScope trace(tracer, TRACE_SELECT_LANGUAGE_MODEL);
+    trace.args().str(name);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if ((lm_set == NULL) || (ngram_model_set_select(lm_set, name.c_str()) == NULL))
+      return trace.end(BAD_ARGUMENT);
+    return trace.end(SUCCESS);
+  }
+
+  /*******************************************
+   *
+   * Interpolates every model of the set with the given
+   * weights, normalized to sum to one. All models must be
+   * named, in any order.
+   *
+   *****************************************/
+  ReturnType Recognizer::interpolateLanguageModels(const StringsListType& names, const Feats& weights) {
+    TraceScope trace(tracer, TRACE_INTERPOLATE_LANGUAGE_MODELS);
+    trace.args().i32(names.size());
+    for (int i = 0; i < names.size(); ++i) trace.args().str(names.at(i));
+    traceFeats(trace.args(), weights);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if ((lm_set == NULL) || (names.size() != weights.size())
+	|| (names.size() != ngram_model_set_count(lm_set)))
+      return trace.end(BAD_ARGUMENT);
+    float total = 0;
+    for (int i = 0; i < weights.size(); ++i) {
+      if ((weights.at(i) <= 0) || (ngram_model_set_lookup(lm_set, names.at(i).c_str()) == NULL))
+	return trace.end(BAD_ARGUMENT);
+      total += weights.at(i);
+    }
+    std::vector<const char *> lm_names;
+    std::vector<float32> lm_weights;
+    for (int i = 0; i < names.size(); ++i) {
+      lm_names.push_back(names.at(i).c_str());
+      lm_weights.push_back(weights.at(i) / total);
+    }
+    if (ngram_model_set_interp(lm_set, &lm_names[0], &lm_weights[0]) == NULL)
+      return trace.end(RUNTIME_ERROR);
+    return trace.end(SUCCESS);
+  }
+
+  /*******************************************
+   *
+   * Grammar edits patch the fsg_model of the grammar in place,
+   * in time proportional to the number of transitions given.
+   * The search compiles the grammar into a lextree that cannot
+   * be patched from outside pocketsphinx, so it is reinitialized
+   * from the patched grammar once for all the edits made since
+   * it was last used, when the grammar is next selected or
+   * started.
+   *
+   *****************************************/
+  ReturnType Recognizer::addTransitions(int id, const std::vector<Transition>& transitions) {
+    TraceScope trace(tracer, TRACE_ADD_TRANSITIONS);
+    traceTransitions(trace.args().i32(id), transitions);
+    fsg_model_t *fsg;
+    ReturnType r = editableGrammar(id, &fsg);
+    if (r != SUCCESS) return trace.end(r);
+    for (int i = 0; i < transitions.size(); ++i) {
+      const Transition& t = transitions.at(i);
+      if ((t.from < 0) || (t.from >= fsg_model_n_state(fsg)) || (t.to < 0) || (t.to >= fsg_model_n_state(fsg)))
+	return trace.end(BAD_ARGUMENT);
+      if ((t.word.size() > 0) && !resolveWord(t.word))
+	return trace.end(BAD_ARGUMENT);
+    }
+    WordTransitions& index = grammar_transitions[id];
+    for (int i = 0; i < transitions.size(); ++i) {
+      const Transition& t = transitions.at(i);
+      if (t.word.size() > 0)
+	fsg_model_trans_add(fsg, t.from, t.to, t.logp, fsg_model_word_add(fsg, t.word.c_str()));
+      else
+	fsg_model_null_trans_add(fsg, t.from, t.to, t.logp);
+      std::pair<WordTransitions::iterator, WordTransitions::iterator> range = index.equal_range(t.word);
+      WordTransitions::iterator it = range.first;
+      while ((it != range.second) && (it->second != std::make_pair(t.from, t.to))) ++it;
+      if (it == range.second) index.insert(std::make_pair(t.word, std::make_pair(t.from, t.to)));
+    }
+    stale_grammars.insert(id);
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::removeTransitions(int id, const std::vector<Transition>& transitions) {
+    TraceScope trace(tracer, TRACE_REMOVE_TRANSITIONS);
+    traceTransitions(trace.args().i32(id), transitions);
+    fsg_model_t *fsg;
+    ReturnType r = editableGrammar(id, &fsg);
+    if (r != SUCCESS) return trace.end(r);
+    for (int i = 0; i < transitions.size(); ++i)
+      removeTransition(id, fsg, transitions.at(i));
+    stale_grammars.insert(id);
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::removeWord(int id, const std::string& word) {
+    TraceScope trace(tracer, TRACE_REMOVE_WORD);
+    trace.args().i32(id).str(word);
+    fsg_model_t *fsg;
+    ReturnType r = editableGrammar(id, &fsg);
+    if (r != SUCCESS) return trace.end(r);
+    if (word.size() == 0) return trace.end(BAD_ARGUMENT);
+    std::vector<Transition> transitions;
+    WordTransitions& index = grammar_transitions[id];
+    std::pair<WordTransitions::iterator, WordTransitions::iterator> range = index.equal_range(word);
+    for (WordTransitions::iterator it = range.first; it != range.second; ++it) {
+      Transition t;
+      t.from = it->second.first;
+      t.to = it->second.second;
+      t.logp = 0;
+      t.word = word;
+      transitions.push_back(t);
+    }
+    for (int i = 0; i < transitions.size(); ++i)
+      removeTransition(id, fsg, transitions.at(i));
+    stale_grammars.insert(id);
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::editableGrammar(int id, fsg_model_t **fsg) {
+    if ((decoder == NULL) || (is_recording)) return BAD_STATE;
+    if (grammar_transitions.find(id) == grammar_transitions.end()) return BAD_ARGUMENT;
+    *fsg = ps_get_fsg(decoder, grammar_names.at(id).c_str());
+    if (*fsg == NULL) return RUNTIME_ERROR;
+    return SUCCESS;
+  }
+
+  // Removed transitions leave the hash tables of the fsg_model at
+  // once. Their links stay allocated until updateGrammar, as the
+  // lextree and the history of the search still point to them.
+  void Recognizer::removeTransition(int id, fsg_model_t *fsg, const Transition& t) {
+    WordTransitions& index = grammar_transitions[id];
+    std::pair<WordTransitions::iterator, WordTransitions::iterator> range = index.equal_range(t.word);
+    WordTransitions::iterator it = range.first;
+    while ((it != range.second) && (it->second != std::make_pair(t.from, t.to))) ++it;
+    if (it == range.second) return;
+    index.erase(it);
+    int32 to = t.to;
+    if (t.word.size() == 0) {
+      fsg_link_t *link = fsg_model_null_trans(fsg, t.from, t.to);
+      if (link == NULL) return;
+      hash_table_delete_bkey(fsg->trans[t.from].null_trans, (char const *) &to, sizeof(to));
+      removed_links[id].push_back(link);
+      return;
+    }
+    int32 wid = fsg_model_word_id(fsg, t.word.c_str());
+    glist_t links = fsg_model_trans(fsg, t.from, t.to);
+    for (gnode_t *gn = links, *prev = NULL; gn; prev = gn, gn = gnode_next(gn)) {
+      fsg_link_t *link = (fsg_link_t *) gnode_ptr(gn);
+      if (link->wid != wid) continue;
+      // The list is keyed by the state of one of its links, which
+      // may be this one, so it is entered again under the first
+      hash_table_delete_bkey(fsg->trans[t.from].trans, (char const *) &to, sizeof(to));
+      gnode_t *next = gnode_free(gn, prev);
+      if (prev == NULL) links = next;
+      if (links)
+	hash_table_enter_bkey(fsg->trans[t.from].trans, (char const *) &((fsg_link_t *) gnode_ptr(links))->to_state,
+			      sizeof(to), links);
+      removed_links[id].push_back(link);
+      return;
+    }
+  }
+
+  // Copy of a grammar with only the words its transitions use, and
+  // without the fillers, which are added again as addGrammar does
+  static fsg_model_t *compactGrammar(fsg_model_t *fsg, logmath_t *lmath) {
+    fsg_model_t *copy = fsg_model_init(fsg_model_name(fsg), lmath, fsg->lw, fsg_model_n_state(fsg));
+    if (copy == NULL) return NULL;
+    copy->start_state = fsg_model_start_state(fsg);
+    copy->final_state = fsg_model_final_state(fsg);
+    for (int i = 0; i < fsg_model_n_state(fsg); ++i) {
+      for (fsg_arciter_t *itor = fsg_model_arcs(fsg, i); itor; itor = fsg_arciter_next(itor)) {
+	fsg_link_t *link = fsg_arciter_get(itor);
+	int32 wid = fsg_link_wid(link);
+	if ((wid >= 0) && fsg_model_is_filler(fsg, wid)) continue;
+	if (wid < 0)
+	  fsg_model_null_trans_add(copy, fsg_link_from_state(link), fsg_link_to_state(link), link->logs2prob);
+	else
+	  fsg_model_trans_add(copy, fsg_link_from_state(link), fsg_link_to_state(link), link->logs2prob,
+			      fsg_model_word_add(copy, fsg_model_word_str(fsg, wid)));
+      }
+    }
+    fsg_model_add_silence(copy, "<sil>", -1, 1.0);
+    return copy;
+  }
+
+  // Reinitializes the search of an edited grammar on its patched
+  // fsg_model, which also clears the history of the last utterance,
+  // so the links of removed transitions can then be freed. Words
+  // whose transitions were all removed stay in the vocabulary of
+  // the grammar, so once the removals outnumber the transitions
+  // left, the search is rebuilt from a compact copy instead.
+  ReturnType Recognizer::updateGrammar(int id) {
+    if (stale_grammars.find(id) == stale_grammars.end()) return SUCCESS;
+    const char *name = grammar_names.at(id).c_str();
+    ps_search_t *fsg_search = (ps_search_t *) NULL;
+    fsg_model_t *fsg = ps_get_fsg(decoder, name);
+    if ((fsg == NULL) || (hash_table_lookup(decoder->searches, name, (void **) &fsg_search) < 0))
       return RUNTIME_ERROR;
+    int heap_before = heapInUse();
+    std::vector<fsg_link_t *>& removed = removed_links[id];
+    grammar_removals[id] += removed.size();
+    if (grammar_removals[id] <= grammar_transitions[id].size()) {
+      if (ps_search_reinit(fsg_search, decoder->dict, decoder->d2p) < 0) return RUNTIME_ERROR;
+      for (int i = 0; i < removed.size(); ++i) listelem_free(fsg->link_alloc, removed.at(i));
+      removed.clear();
+    }
+    else {
+      fsg_model_t *compact = compactGrammar(fsg, logmath);
+      if (compact == NULL) return RUNTIME_ERROR;
+      // The removed links are freed with the old grammar
+      removed.clear();
+      grammar_removals[id] = 0;
+      // The new search replaces and frees the old one, which the
+      // decoder may still have selected
+      bool selected = (decoder->search == fsg_search);
+      int rv = ps_set_fsg(decoder, name, compact);
+      fsg_model_free(compact);
+      if ((rv < 0) || (selected && ps_set_search(decoder, name)))
+	return RUNTIME_ERROR;
+      if (latency.enabled() && (hash_table_lookup(decoder->searches, name, (void **) &fsg_search) == 0))
+	beams_apply(fsg_search, &beam_base, latency.scale());
+    }
+    std::ostringstream component;
+    component << "search " << id;
+    registerSearchMemory(id, memory_usage[component.str()].bytes + heapInUse() - heap_before);
+    stale_grammars.erase(id);
+    // Batch decoders share the fsg but have their own search
+    batch_searches.erase(grammar_names.at(id));
+    return SUCCESS;
+  }
+
+  /*******************************************
+   *
+   * The adaptation state is laid out as:
+   * version, CMN vector length, CMN frame count,
+   * CMN means, CMN sums,
+   * AGC max, AGC sum of utterance maxima, AGC utterance count,
+   * AGC noise threshold.
+   * The CMN part is empty if CMN is disabled. Noise removal
+   * statistics are internal to the front end and not included.
+   *
+   *****************************************/
+  ReturnType Recognizer::exportAdaptationState(Feats& state) {
+    if (decoder == NULL) return BAD_STATE;
+    cmn_t *cmn = decoder->acmod->fcb->cmn_struct;
+    agc_t *agc = decoder->acmod->fcb->agc_struct;
+    int veclen = cmn ? cmn->veclen : 0;
+    state.clear();
+    state.push_back(ADAPTATION_STATE_VERSION);
+    state.push_back(veclen);
+    state.push_back(cmn ? cmn->nframe : 0);
+    for (int i = 0; i < veclen; ++i) state.push_back(MFCC2FLOAT(cmn->cmn_mean[i]));
+    for (int i = 0; i < veclen; ++i) state.push_back(MFCC2FLOAT(cmn->sum[i]));
+    state.push_back(agc ? MFCC2FLOAT(agc->max) : 0);
+    state.push_back(agc ? MFCC2FLOAT(agc->obs_max_sum) : 0);
+    state.push_back(agc ? agc->obs_utt : 0);
+    state.push_back(agc ? MFCC2FLOAT(agc->noise_thresh) : 0);
+    return SUCCESS;
+  }
+
+  ReturnType Recognizer::importAdaptationState(const Feats& state) {
+    TraceScope trace(tracer, TRACE_IMPORT_ADAPTATION_STATE);
+    traceFeats(trace.args(), state);
+    return trace.end(restoreAdaptationState(state));
+  }
+
+  // Not traced, for the state saved by reInit and reprocess
+  ReturnType Recognizer::restoreAdaptationState(const Feats& state) {
+    if ((decoder == NULL) || (is_recording)) return BAD_STATE;
+    cmn_t *cmn = decoder->acmod->fcb->cmn_struct;
+    agc_t *agc = decoder->acmod->fcb->agc_struct;
+    int veclen = cmn ? cmn->veclen : 0;
+    if ((state.size() != 3 + 2 * veclen + 4) || (state.at(0) != ADAPTATION_STATE_VERSION)
+	|| (state.at(1) != veclen) || (state.at(2) < 0))
+      return BAD_ARGUMENT;
+    int index = 2;
+    if (cmn) {
+      cmn->nframe = (int32) state.at(index);
+      for (int i = 0; i < veclen; ++i) cmn->cmn_mean[i] = FLOAT2MFCC(state.at(++index));
+      for (int i = 0; i < veclen; ++i) cmn->sum[i] = FLOAT2MFCC(state.at(++index));
+    } else {
+      index += 2 * veclen;
+    }
+    if (agc) {
+      agc->max = FLOAT2MFCC(state.at(++index));
+      agc->obs_max_sum = FLOAT2MFCC(state.at(++index));
+      agc->obs_utt = (int32) state.at(++index);
+      agc->noise_thresh = FLOAT2MFCC(state.at(++index));
     }
     return SUCCESS;
   }
 
+  ReturnType Recognizer::setLatencyBudget(float targetRtf, float minScale) {
+    TraceScope trace(tracer, TRACE_SET_LATENCY_BUDGET);
+    trace.args().f32(targetRtf).f32(minScale);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    if ((targetRtf < 0) || (minScale <= 0) || (minScale > 1)) return trace.end(BAD_ARGUMENT);
+    latency.configure(targetRtf, minScale);
+    beams_apply(decoder->search, &beam_base, latency.scale());
+    return trace.end(SUCCESS);
+  }
+
+  FrameSkipReport Recognizer::getFrameSkipStats() {
+    FrameSkipReport report;
+    FrameSkipCounts counts;
+    frame_skip_counts((decoder == NULL) ? NULL : decoder->acmod, counts);
+    long senones = counts.senones_scored + counts.senones_reused;
+    report.frames = counts.frames;
+    report.skippedFrames = counts.skipped;
+    report.skipRate = counts.frames ? (float) counts.skipped / counts.frames : 0;
+    report.reusedSenones = senones ? (float) counts.senones_reused / senones : 0;
+    report.auditedFrames = counts.audited;
+    report.scoreError = counts.score_error;
+    report.newScoreError = counts.new_score_error;
+    report.bestSenoneAgreement = counts.audited ? (float) counts.best_agreed / counts.audited : 1;
+    return report;
+  }
+
+  OperatingPoint Recognizer::getOperatingPoint() {
+    OperatingPoint point;
+    beam_settings_t current;
+    if ((decoder == NULL) || (beams_get(decoder->search, &current) < 0))
+      current = beam_base;
+    point.targetRtf = latency.targetRtf();
+    point.rtf = latency.rtf();
+    point.frameMs = latency.frameMs();
+    point.scale = latency.scale();
+    point.beam = current.beam;
+    point.wbeam = current.wbeam;
+    point.pbeam = current.pbeam;
+    point.maxhmmpf = current.maxhmmpf;
+    point.maxwpf = current.maxwpf;
+    return point;
+  }
 
   ReturnType Recognizer::switchGrammar(int id) {
     return switchSearch(id);
   }
 
   ReturnType Recognizer::switchSearch(int id) {
-    if (decoder == NULL) return BAD_STATE;
-    if ((id < 0) || (id >= grammar_names.size())) return BAD_ARGUMENT;
+    TraceScope trace(tracer, TRACE_SWITCH_SEARCH);
+    trace.args().i32(id);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    if ((id < 0) || (id >= grammar_names.size())) return trace.end(BAD_ARGUMENT);
+    if (updateGrammar(id) != SUCCESS) return trace.end(RUNTIME_ERROR);
     if(ps_set_search(decoder, grammar_names.at(id).c_str())) {
-      return RUNTIME_ERROR;
+      return trace.end(RUNTIME_ERROR);
     }
+    dropSearches();
+    return trace.end(SUCCESS);
+  }
+
+  /*******************************************
+   *
+   * The searches set together are stepped by a multi search (see
+   * multisearch.h), installed as the decoder's search at start()
+   * so that the front end, the acoustic scoring, the rollovers
+   * and the latency budget all go through it unchanged. It is
+   * built at start(), once the grammars edited since are updated.
+   * The first search is also selected the usual way, for
+   * everything that looks the current search up by name.
+   *
+   *****************************************/
+  ReturnType Recognizer::setSearches(const Integers& ids) {
+    TraceScope trace(tracer, TRACE_SET_SEARCHES);
+    trace.args().i32(ids.size());
+    for (int i = 0; i < ids.size(); ++i) trace.args().i32(ids.at(i));
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if (ids.size() == 0) return trace.end(BAD_ARGUMENT);
+    for (int i = 0; i < ids.size(); ++i) {
+      if ((ids.at(i) < 0) || (ids.at(i) >= grammar_names.size())
+	  || (std::find(ids.begin(), ids.begin() + i, ids.at(i)) != ids.begin() + i))
+	return trace.end(BAD_ARGUMENT);
+      if (updateGrammar(ids.at(i)) != SUCCESS) return trace.end(RUNTIME_ERROR);
+    }
+    if (ps_set_search(decoder, grammar_names.at(ids.at(0)).c_str()))
+      return trace.end(RUNTIME_ERROR);
+    dropSearches();
+    if (ids.size() > 1) joint_searches = ids;
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::getSearchHyps(SearchHyps& hyps) {
+    if (decoder == NULL) return BAD_STATE;
+    hyps = search_hyps;
+    return SUCCESS;
+  }
+
+  ReturnType Recognizer::startSearches() {
+    std::vector<ps_search_t *> searches;
+    for (int i = 0; i < joint_searches.size(); ++i) {
+      ps_search_t *s = NULL;
+      if ((updateGrammar(joint_searches.at(i)) != SUCCESS)
+	  || (hash_table_lookup(decoder->searches, grammar_names.at(joint_searches.at(i)).c_str(), (void **) &s) < 0))
+	return RUNTIME_ERROR;
+      searches.push_back(s);
+    }
+    if (multi_search) ps_search_free(multi_search);
+    multi_search = multi_search_init(decoder, &searches[0], searches.size());
+    decoder->search = multi_search;
+    // The phone loop lookahead is for a single ngram search
+    decoder->pl_window = 0;
     return SUCCESS;
   }
 
+  // Back to the search selected by name, with the configured
+  // lookahead
+  void Recognizer::dropSearches() {
+    joint_searches.clear();
+    if (multi_search == NULL) return;
+    if (decoder) {
+      if (decoder->search == multi_search)
+	decoder->search = multi_search_get(multi_search, 0);
+      decoder->pl_window = cmd_ln_int32_r(decoder->config, "-pl_window");
+    }
+    ps_search_free(multi_search);
+    multi_search = NULL;
+  }
+
+  // Hypothesis of the current search and, by id, of each of the
+  // searches decoding the utterance
+  void Recognizer::updateHyp() {
+    int32 score = 0;
+    const char* h = ps_get_hyp(decoder, &score);
+    current_hyp = (h == NULL) ? "" : h;
+    search_hyps.clear();
+    if (multi_search && (decoder->search == multi_search)) {
+      for (int i = 0; i < joint_searches.size(); ++i) {
+	SearchHyp item;
+	item.id = joint_searches.at(i);
+	item.score = 0;
+	h = ps_search_hyp(multi_search_get(multi_search, i), &item.score);
+	item.hyp = (h == NULL) ? "" : h;
+	search_hyps.push_back(item);
+      }
+      return;
+    }
+    const char *name = ps_get_search(decoder);
+    for (int i = 0; name && (i < grammar_names.size()); ++i) {
+      if (grammar_names.at(i) != name) continue;
+      SearchHyp item;
+      item.id = i;
+      item.hyp = current_hyp;
+      item.score = score;
+      search_hyps.push_back(item);
+    }
+  }
+
   ReturnType Recognizer::start() {
-    if ((decoder == NULL) || (is_recording)) return BAD_STATE;
+    TraceScope trace(tracer, TRACE_START);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    // Edits made after switching to the grammar
+    const char *current_search = stale_grammars.empty() ? NULL : ps_get_search(decoder);
+    for (int i = 0; current_search && (i < grammar_names.size()); ++i)
+      if ((grammar_names.at(i) == current_search) && (updateGrammar(i) != SUCCESS))
+	return trace.end(RUNTIME_ERROR);
+    if ((joint_searches.size() > 0) && (startSearches() != SUCCESS))
+      return trace.end(RUNTIME_ERROR);
+    // Searches start from the pruning of the latency budget,
+    // or from the configuration if there is none
+    beams_apply(decoder->search, &beam_base, latency.scale());
     if ((ps_start_utt(decoder) < 0) || (ps_start_stream(decoder) < 0)) {
-      return RUNTIME_ERROR;
+      return trace.end(RUNTIME_ERROR);
     }
     current_hyp = "";
+    search_hyps.clear();
+    clearUtteranceResults();
+    frame_skip_reset(decoder->acmod);
+    feature_store_frames = 0;
+    feature_store_complete = true;
+    rollover.reset();
+    history.clear();
+    utterance_offset = 0;
+    skip_frames = 0;
+    events.clear();
+    keywords_reported.clear();
+    words_final = 0;
+    word_events_end = -1;
+    word_skip_frames = 0;
+    previous_words.clear();
+    utterance_start_bytes = heapInUse();
+    accountMemory("utterance", 0);
     is_recording = true;
-    return SUCCESS;
+    return trace.end(SUCCESS);
   }
 
   ReturnType Recognizer::stop() {
-    if ((decoder == NULL) || (!is_recording)) return BAD_STATE;
+    TraceScope trace(tracer, TRACE_STOP);
+    if ((decoder == NULL) || (!is_recording)) return trace.end(BAD_STATE);
     if (ps_end_utt(decoder) < 0) {
-      return RUNTIME_ERROR;
+      return trace.end(RUNTIME_ERROR);
     }
-    const char* h = ps_get_hyp(decoder, NULL);
-    current_hyp = (h == NULL) ? "" : h;
+    updateHyp();
+    if (rollover.enabled()) recordHistory(ps_get_n_frames(decoder));
+    if (events_max > 0) collectEvents(true, ps_get_n_frames(decoder));
+    accountMemory("utterance", heapInUse() - utterance_start_bytes);
     is_recording = false;
+    trace.end(SUCCESS, current_hyp);
+    tracer.flush();
     return SUCCESS;
   }
 
   ReturnType Recognizer::process(const std::vector<int16_t>& buffer) {
-    if ((decoder == NULL) || (!is_recording)) return BAD_STATE;
+    TraceScope trace(tracer, TRACE_PROCESS);
+    trace.args().samples(buffer);
+    if ((decoder == NULL) || (!is_recording)) return trace.end(BAD_STATE);
     if (buffer.size() == 0)
-      return RUNTIME_ERROR;
-    ps_process_raw(decoder, (short int *) &buffer[0], buffer.size(), 0, 0);
-    const char* h = ps_get_hyp(decoder, NULL);
-    current_hyp = (h == NULL) ? "" : h;
+      return trace.end(RUNTIME_ERROR);
+    double t = clock_ms();
+    if (feature_store_max > 0) {
+      if (processFrames(buffer) != SUCCESS) return trace.end(RUNTIME_ERROR);
+    }
+    else
+      ps_process_raw(decoder, (short int *) &buffer[0], buffer.size(), 0, 0);
+    if (latency.update(clock_ms() - t, buffer.size() * 1000.0 / samprate))
+      beams_apply(decoder->search, &beam_base, latency.scale());
+    if (rollover.update(&buffer[0], buffer.size()) && (rollOver() != SUCCESS))
+      return trace.end(RUNTIME_ERROR);
+    updateHyp();
+    if (events_max > 0) collectEvents(false, ps_get_n_frames(decoder));
+    accountMemory("utterance", heapInUse() - utterance_start_bytes);
+    return trace.end(SUCCESS, current_hyp);
+  }
+
+  /*******************************************
+   *
+   * With the feature store, process() runs the front end itself
+   * so that it can keep the frames it feeds to the decoder. The
+   * store stops growing at its limit, the utterance is then
+   * decoded as usual but cannot be used again.
+   *
+   *****************************************/
+  ReturnType Recognizer::setFeatureStore(int maxFrames) {
+    TraceScope trace(tracer, TRACE_SET_FEATURE_STORE);
+    trace.args().i32(maxFrames);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if (maxFrames < 0) return trace.end(BAD_ARGUMENT);
+    feature_store_max = maxFrames;
+    feature_store_frames = 0;
+    feature_store_complete = false;
+    if (maxFrames == 0) {
+      std::vector<mfcc_t>().swap(feature_store);
+      std::vector<mfcc_t>().swap(cep_scratch);
+      accountMemory("feature store", 0);
+      return trace.end(SUCCESS);
+    }
+    fe_t *fe = decoder->acmod->fe;
+    ncep = fe_get_output_size(fe);
+    feature_store.reserve(maxFrames * ncep);
+    // Cepstrum of digital silence, to pad windows of stored
+    // frames like featex pads windows of audio
+    std::vector<int16_t> zeros(samprate / 10, 0);
+    int32 nfr = 0;
+    size_t nsamp = zeros.size();
+    fe_process_frames(fe, NULL, &nsamp, NULL, &nfr, NULL);
+    std::vector<mfcc_t> cep((nfr + 1) * ncep);
+    std::vector<mfcc_t *> rows(nfr + 1);
+    for (int i = 0; i <= nfr; ++i) rows[i] = &cep[i * ncep];
+    const int16 *samples = &zeros[0];
+    nsamp = zeros.size();
+    fe_start_utt(fe);
+    fe_process_frames(fe, &samples, &nsamp, &rows[0], &nfr, NULL);
+    fe_end_utt(fe, rows[nfr], &nfr);
+    silence_frame.assign(rows[0], rows[0] + ncep);
+    accountMemory("feature store", feature_store.capacity() * sizeof(mfcc_t));
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::processFrames(const std::vector<int16_t>& buffer) {
+    fe_t *fe = decoder->acmod->fe;
+    const int16 *samples = (const int16 *) &buffer[0];
+    size_t nsamp = buffer.size();
+    int32 nfr = 0;
+    fe_process_frames(fe, NULL, &nsamp, NULL, &nfr, NULL);
+    if (cep_scratch.size() < (nfr + 1) * ncep) cep_scratch.resize((nfr + 1) * ncep);
+    std::vector<mfcc_t *> rows(nfr + 1);
+    for (int i = 0; i <= nfr; ++i) rows[i] = &cep_scratch[i * ncep];
+    nsamp = buffer.size();
+    nfr++;
+    if (fe_process_frames(fe, &samples, &nsamp, &rows[0], &nfr, NULL) < 0) return RUNTIME_ERROR;
+    if (feature_store_complete && (feature_store_frames + nfr <= feature_store_max)) {
+      feature_store.insert(feature_store.end(), cep_scratch.begin(), cep_scratch.begin() + nfr * ncep);
+      feature_store_frames += nfr;
+    }
+    else
+      feature_store_complete = false;
+    if ((nfr > 0) && (ps_process_cep(decoder, &rows[0], nfr, FALSE, FALSE) < 0)) return RUNTIME_ERROR;
+    return SUCCESS;
+  }
+
+  // Row pointers to the frames of the last utterance, if it was
+  // fully stored
+  bool Recognizer::storedFrames(std::vector<mfcc_t *>& rows) {
+    if (is_recording || !feature_store_complete || (feature_store_frames == 0)) return false;
+    rows.resize(feature_store_frames);
+    for (int i = 0; i < feature_store_frames; ++i) rows[i] = &feature_store[i * ncep];
+    return true;
+  }
+
+  // Decodes stored frames through copies in cep_scratch, a block
+  // at a time, since the front end normalizes them in place
+  ReturnType Recognizer::processStoredFrames(const std::vector<mfcc_t *>& rows) {
+    std::vector<mfcc_t *> copies(std::min((int) rows.size(), STORED_BLOCK_FRAMES));
+    if (cep_scratch.size() < copies.size() * ncep) cep_scratch.resize(copies.size() * ncep);
+    for (int i = 0; i < rows.size(); i += copies.size()) {
+      int nfr = std::min(copies.size(), rows.size() - i);
+      for (int j = 0; j < nfr; ++j) {
+	copies[j] = &cep_scratch[j * ncep];
+	memcpy(copies[j], rows[i + j], ncep * sizeof(mfcc_t));
+      }
+      if (ps_process_cep(decoder, &copies[0], nfr, FALSE, FALSE) < 0) return RUNTIME_ERROR;
+    }
+    return SUCCESS;
+  }
+
+  /*******************************************
+   *
+   * Decodes the stored utterance again with the given search,
+   * which stays selected. The front end adaptation is left as it
+   * was after the utterance, so that it does not learn the same
+   * audio twice.
+   *
+   *****************************************/
+  ReturnType Recognizer::reprocess(int id) {
+    TraceScope trace(tracer, TRACE_REPROCESS);
+    trace.args().i32(id);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    std::vector<mfcc_t *> rows;
+    if (!storedFrames(rows)) return trace.end(BAD_STATE);
+    ReturnType r = switchSearch(id);
+    if (r != SUCCESS) return trace.end(r);
+    Feats state;
+    exportAdaptationState(state);
+    clearUtteranceResults();
+    beams_apply(decoder->search, &beam_base, latency.scale());
+    if ((ps_start_utt(decoder) < 0)
+	|| (processStoredFrames(rows) != SUCCESS)
+	|| (ps_end_utt(decoder) < 0))
+      return trace.end(RUNTIME_ERROR);
+    restoreAdaptationState(state);
+    updateHyp();
+    return trace.end(SUCCESS, current_hyp);
+  }
+
+  /*******************************************
+   *
+   * The continuous mode bounds what a search accumulates over an
+   * utterance (backpointers, detections, frame counters) by
+   * ending the utterance and starting a new one at a quiet point,
+   * or after a fixed number of frames. The front end and its
+   * adaptation state run on across rollovers, like the audio.
+   * A rollover in the middle of speech feeds the last second of
+   * audio again to the new utterance, so that words cut at the
+   * boundary are decoded whole; words the new utterance finds
+   * within that overlap were already recorded and are skipped.
+   *
+   *****************************************/
+  ReturnType Recognizer::setContinuous(int maxFrames, int silenceFrames, int historySize) {
+    TraceScope trace(tracer, TRACE_SET_CONTINUOUS);
+    trace.args().i32(maxFrames).i32(silenceFrames).i32(historySize);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if ((maxFrames < 0) || (silenceFrames < 0) || (historySize < 0)
+	|| ((maxFrames > 0) && (historySize == 0)))
+      return trace.end(BAD_ARGUMENT);
+    int frate = cmd_ln_int32_r(cmd_line, "-frate");
+    rollover.setFrameSamples(samprate / frate);
+    rollover.configure(maxFrames, silenceFrames, std::min(CONTINUOUS_OVERLAP_FRAMES, maxFrames / 2));
+    history_max = historySize;
+    history.clear();
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::getHistory(Segmentation& seg) {
+    if (decoder == NULL) return BAD_STATE;
+    seg.assign(history.begin(), history.end());
+    return SUCCESS;
+  }
+
+  // The overlap is decoded again by the next utterance, so the words
+  // ending in it, possibly cut by the rollover, are left to that one
+  ReturnType Recognizer::rollOver() {
+    if (ps_end_utt(decoder) < 0) return RUNTIME_ERROR;
+    int overlap_frames = rollover.overlapFrames();
+    int cut_frame = ps_get_n_frames(decoder) - overlap_frames;
+    recordHistory(cut_frame);
+    if (events_max > 0) {
+      updateHyp();
+      collectEvents(true, cut_frame);
+      keywords_reported.clear();
+      words_final = 0;
+      previous_words.clear();
+    }
+    utterance_offset += cut_frame;
+    clearUtteranceResults();
+    beams_apply(decoder->search, &beam_base, latency.scale());
+    if (ps_start_utt(decoder) < 0) return RUNTIME_ERROR;
+    feature_store_frames = 0;
+    feature_store_complete = true;
+    rollover.reset();
+    utterance_start_bytes = heapInUse();
+    const std::vector<int16_t>& overlap = rollover.overlap();
+    if (overlap.size() > 0) {
+      if (feature_store_max > 0) {
+	if (processFrames(overlap) != SUCCESS) return RUNTIME_ERROR;
+      }
+      else
+	ps_process_raw(decoder, (short int *) &overlap[0], overlap.size(), 0, 0);
+    }
+    // Key phrases ending in the overlap were spotted already, as were
+    // the words reported as stable before the rollover
+    skip_frames = overlap_frames;
+    word_skip_frames = std::max(0, word_events_end - utterance_offset + 1);
+    return SUCCESS;
+  }
+
+  // Appends the words of the utterance that just ended, skipping
+  // fillers and the words ending at or after the given frame
+  void Recognizer::recordHistory(int end_frame) {
+    int32 sf = 0, ef = 0;
+    for (ps_seg_t *itor = ps_seg_iter(decoder); itor; itor = ps_seg_next(itor)) {
+      const char *word = ps_seg_word(itor);
+      ps_seg_frames(itor, &sf, &ef);
+      if ((ef >= end_frame) || !isRealWord(word))
+	continue;
+      SegItem item;
+      item.word = word;
+      item.start = utterance_offset + sf;
+      item.end = utterance_offset + ef;
+      ps_seg_prob(itor, &item.ascr, &item.lscr, &sf);
+      history.push_back(item);
+      if (history.size() > history_max) history.pop_front();
+    }
+  }
+
+  // False for fillers, sentence markers and silence. Key phrases
+  // are not dictionary words and count as real
+  bool Recognizer::isRealWord(const char *word) {
+    s3wid_t wid = dict_wordid(decoder->dict, word);
+    return (wid == BAD_S3WID) || dict_real_word(decoder->dict, wid);
+  }
+
+  /*******************************************
+   *
+   * Events are derived from the segmentation after each call to
+   * process(), so they come with the exact frames the search
+   * assigned, whatever the size of the buffers. Key phrases are
+   * reported once each, when spotted. Words of other searches are
+   * reported when they stay the same over two calls and ended at
+   * least EVENT_STABLE_FRAMES ago, and the rest of them at the end
+   * of the utterance, which comes last.
+   *
+   *****************************************/
+  ReturnType Recognizer::setEventQueue(int maxEvents) {
+    TraceScope trace(tracer, TRACE_SET_EVENT_QUEUE);
+    trace.args().i32(maxEvents);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if (maxEvents < 0) return trace.end(BAD_ARGUMENT);
+    events_max = maxEvents;
+    events.clear();
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::getEvents(Events& output) {
+    if (decoder == NULL) return BAD_STATE;
+    output.assign(events.begin(), events.end());
+    events.clear();
     return SUCCESS;
   }
 
+  void Recognizer::pushEvent(EventType type, const std::string& text, int start, int end, int score) {
+    Event e;
+    e.type = type;
+    e.text = text;
+    e.start = utterance_offset + start;
+    e.end = utterance_offset + end;
+    e.score = score;
+    events.push_back(e);
+    if (events.size() > events_max) events.pop_front();
+  }
+
+  // With several searches, key phrases come from all the kws
+  // searches and words from the first other search. Words ending at
+  // or after end_frame are left out.
+  void Recognizer::collectEvents(bool final, int end_frame) {
+    std::vector<ps_search_t *> searches(1, decoder->search);
+    if (multi_search && (decoder->search == multi_search))
+      for (int i = 0; i < multi_search_n(multi_search); ++i)
+	searches.push_back(multi_search_get(multi_search, i));
+    int n_frames = ps_get_n_frames(decoder);
+    int32 sf = 0, ef = 0, ascr = 0, lscr = 0, lback = 0;
+    Segmentation words;
+    bool words_found = false;
+    for (int i = (searches.size() > 1) ? 1 : 0; i < searches.size(); ++i) {
+      if (searches.at(i) == NULL) continue;
+      bool kws = (0 == strcmp(ps_search_type(searches.at(i)), PS_SEARCH_TYPE_KWS));
+      if (!kws && words_found) continue;
+      words_found = words_found || !kws;
+      for (ps_seg_t *itor = ps_search_seg_iter(searches.at(i)); itor; itor = ps_seg_next(itor)) {
+	const char *word = ps_seg_word(itor);
+	ps_seg_frames(itor, &sf, &ef);
+	if ((ef >= end_frame) || !isRealWord(word)) continue;
+	// Reported with the last utterance after a rollover
+	if (ef < (kws ? skip_frames : word_skip_frames)) continue;
+	int32 prob = ps_seg_prob(itor, &ascr, &lscr, &lback);
+	if (kws) {
+	  if (keywords_reported.insert(std::make_pair(std::string(word), (int) ef)).second)
+	    pushEvent(KEYWORD_SPOTTED, word, sf, ef, prob);
+	  continue;
+	}
+	SegItem item;
+	item.word = word;
+	item.start = sf;
+	item.end = ef;
+	item.ascr = ascr;
+	item.lscr = lscr;
+	words.push_back(item);
+      }
+    }
+    while ((words_final < words.size())
+	   && (final || ((words_final < previous_words.size())
+			 && (words.at(words_final).word == previous_words.at(words_final).word)
+			 && (words.at(words_final).start == previous_words.at(words_final).start)
+			 && (words.at(words_final).end + EVENT_STABLE_FRAMES <= n_frames)))) {
+      const SegItem& item = words.at(words_final++);
+      pushEvent(WORD_FINAL, item.word, item.start, item.end, 0);
+      word_events_end = utterance_offset + item.end;
+    }
+    previous_words.swap(words);
+    if (final) pushEvent(UTTERANCE_END, current_hyp, 0, n_frames, 0);
+  }
+
   /*
   	NEW FEATURE EXTRACTION FOR PRONUNCIATION EVALUATION
   */
   ReturnType Recognizer::pronFeatex(const std::vector<int16_t>& buffer, const std::string& word, Feats& feats) {
-  	if (decoder != NULL)
-  		feats = featex(decoder, buffer, word);
+  	TraceScope trace(tracer, TRACE_PRON_FEATEX);
+  	trace.args().samples(buffer).str(word);
+  	// featex decodes with its own searches, which discards
+  	// the lattice of the last utterance
+  	clearUtteranceResults();
+  	phone_words.clear();
+  	phone_scores.clear();
+  	word_scores.clear();
+  	if (decoder != NULL) {
+  		FrameSkipPause skip_pause(decoder->acmod);
+  		resolveWords(word, " \t\r\n");
+  		int heap_before = heapInUse() - featex_arena.capacity();
+  		std::vector<mfcc_t *> rows;
+  		if (buffer.size() > 0)
+  			feats = featex(decoder, buffer, word, featex_arena, &phone_words);
+  		else if (storedFrames(rows))
+  			feats = featex(decoder, &rows[0], rows.size(), &silence_frame[0], word, featex_arena, &phone_words);
+  		else
+  			return trace.end(BAD_STATE);
+  		if (pron_model.loaded())
+  			pron_model.score(feats, phone_words, phone_scores, word_scores);
+  		accountMemory("featex", heapInUse() - heap_before);
+  	}
   	else
-  		return BAD_STATE;
+  		return trace.end(BAD_STATE);
 
-  	return SUCCESS;
+  	std::ostringstream count;
+  	count << feats.size();
+  	return trace.end(SUCCESS, count.str());
+  }
+
+  ReturnType Recognizer::loadPronModel(const std::string& model) {
+    TraceScope trace(tracer, TRACE_LOAD_PRON_MODEL);
+    trace.args().str(model);
+    int heap_before = heapInUse() - (int) pron_model.bytes();
+    if (pron_model.load(model, FEATEX_PHONE_FEATS) < 0) {
+      accountMemory("pron model", 0);
+      return trace.end(BAD_ARGUMENT);
+    }
+    accountMemory("pron model", heapInUse() - heap_before);
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::getPronScores(Feats& phones, Feats& words) {
+    if (!pron_model.loaded()) return BAD_STATE;
+    phones = phone_scores;
+    words = word_scores;
+    return SUCCESS;
+  }
+
+  /*******************************************
+   *
+   * Background jobs make the work of pronFeatex or wordAlign in
+   * steps of bounded time: JOB_ALIGN_FRAMES frames of alignment,
+   * or the scores of one phone. They run on a decoder of their
+   * own, so that utterances can be decoded on the recognizer's
+   * decoder between two runJob calls. That decoder is loaded
+   * from the same configuration by the first job, and kept for
+   * the next ones, which only give it the words added since. It
+   * holds a second acoustic model until reInit or the end of the
+   * recognizer.
+   *
+   *****************************************/
+  ReturnType Recognizer::startJob(JobType type, const std::vector<int16_t>& buffer, const std::string& text) {
+    TraceScope trace(tracer, TRACE_START_JOB);
+    trace.args().i32(type).samples(buffer).str(text);
+    if (decoder == NULL) return trace.end(BAD_STATE);
+    if ((type != FEATEX_JOB) && (type != ALIGN_JOB)) return trace.end(BAD_ARGUMENT);
+    dropJob();
+    std::vector<mfcc_t *> rows;
+    if ((buffer.size() == 0) && !storedFrames(rows)) return trace.end(BAD_STATE);
+    resolveWords(text, " \t\r\n");
+    if (job_decoder == NULL) {
+      int heap_before = heapInUse();
+      job_decoder = newDecoder();
+      if (job_decoder == NULL) return trace.end(RUNTIME_ERROR);
+      job_words = 0;
+      accountMemory("job decoder", heapInUse() - heap_before);
+    }
+    for (; job_words < added_words.size(); ++job_words)
+      if (ps_add_word(job_decoder, added_words.at(job_words).word.c_str(),
+		      added_words.at(job_words).pronunciation.c_str(), job_words == added_words.size() - 1) < 0)
+	return trace.end(RUNTIME_ERROR);
+
+    // The stored frames are overwritten by the next utterance
+    job_heap_start = heapInUse();
+    job_audio = buffer;
+    if (buffer.size() == 0) {
+      job_cep.assign(feature_store.begin(), feature_store.begin() + rows.size() * ncep);
+      job_rows.resize(rows.size());
+      for (int i = 0; i < rows.size(); ++i) job_rows[i] = &job_cep[i * ncep];
+    }
+    const int16 *audio = (buffer.size() > 0) ? &job_audio[0] : NULL;
+    mfcc_t **frames = (buffer.size() > 0) ? NULL : &job_rows[0];
+    // Stored frames are padded with the silence frame, which only
+    // exists once the feature store was set
+    const mfcc_t *silence = silence_frame.empty() ? NULL : &silence_frame[0];
+    if (type == FEATEX_JOB)
+      featex_job.start(job_decoder, audio ? &job_audio : NULL, frames, job_rows.size(), silence,
+		       text, job_arena, &job_phone_words);
+    else {
+      dict_t *job_dict = job_decoder->dict;
+      job_al = ps_alignment_init(job_decoder->d2p);
+      ps_alignment_add_word(job_al, dict_wordid(job_dict, "<s>"), 0);
+      std::istringstream words(text);
+      std::string w;
+      while (words >> w) {
+	s3wid_t wid = dict_wordid(job_dict, w.c_str());
+	if (wid < 0) {
+	  dropJob();
+	  return trace.end(BAD_ARGUMENT);
+	}
+	ps_alignment_add_word(job_al, wid, 0);
+      }
+      ps_alignment_add_word(job_al, dict_wordid(job_dict, "</s>"), 0);
+      ps_alignment_populate(job_al);
+      if (align_job.start(job_decoder, job_al, audio, job_audio.size(), frames, job_rows.size()) < 0) {
+	dropJob();
+	return trace.end(RUNTIME_ERROR);
+      }
+    }
+    job_status.type = type;
+    job_status.running = true;
+    accountMemory("job", heapInUse() - job_heap_start);
+    return trace.end(SUCCESS);
+  }
+
+  ReturnType Recognizer::runJob(int ms) {
+    TraceScope trace(tracer, TRACE_RUN_JOB);
+    trace.args().i32(ms);
+    // There is nothing left to do once the job is done
+    if (!job_status.running) return trace.end(job_status.done ? SUCCESS : BAD_STATE);
+    double start = clock_ms();
+    bool finished;
+    do {
+      if (job_status.type == FEATEX_JOB)
+	finished = featex_job.step(JOB_ALIGN_FRAMES) != 0;
+      else
+	finished = align_job.step(JOB_ALIGN_FRAMES) != 0;
+      job_status.steps++;
+    } while (!finished && (clock_ms() - start < ms));
+    job_status.elapsedMs += clock_ms() - start;
+    job_status.progress = (job_status.type == FEATEX_JOB) ? featex_job.progress() : align_job.progress();
+    if (finished) finishJob();
+    accountMemory("job", heapInUse() - job_heap_start);
+    return trace.end(SUCCESS);
+  }
+
+  // Results of a finished job replace those of pronFeatex or
+  // wordAlign
+  void Recognizer::finishJob() {
+    if (job_status.type == FEATEX_JOB) {
+      job_feats = featex_job.features();
+      phone_words = job_phone_words;
+      phone_scores.clear();
+      word_scores.clear();
+      if (pron_model.loaded())
+	pron_model.score(job_feats, phone_words, phone_scores, word_scores);
+    }
+    else {
+      // The search refers to the acoustic model of the job
+      // decoder, only the alignment is kept
+      if (search) ps_search_free(search);
+      if (al) ps_alignment_free(al);
+      ps_search_free(align_job.release());
+      search = NULL;
+      al = job_al;
+      job_al = NULL;
+    }
+    featex_job.reset();
+    std::vector<int16_t>().swap(job_audio);
+    std::vector<mfcc_t>().swap(job_cep);
+    std::vector<mfcc_t *>().swap(job_rows);
+    job_status.running = false;
+    job_status.done = true;
+    job_status.progress = 1;
+  }
+
+  void Recognizer::dropJob() {
+    featex_job.reset();
+    align_job.reset();
+    if (job_al) ps_alignment_free(job_al);
+    job_al = NULL;
+    std::vector<int16_t>().swap(job_audio);
+    std::vector<mfcc_t>().swap(job_cep);
+    std::vector<mfcc_t *>().swap(job_rows);
+    Feats().swap(job_feats);
+    JobStatus idle = {FEATEX_JOB, false, false, 0, 0, 0};
+    job_status = idle;
+    accountMemory("job", 0);
+  }
+
+  ReturnType Recognizer::cancelJob() {
+    TraceScope trace(tracer, TRACE_CANCEL_JOB);
+    if (!job_status.running) return trace.end(BAD_STATE);
+    dropJob();
+    return trace.end(SUCCESS);
+  }
+
+  void Recognizer::freeJobDecoder() {
+    if (job_decoder) ps_free(job_decoder);
+    job_decoder = NULL;
+    job_words = 0;
+    if (memory_usage.find("job decoder") != memory_usage.end())
+      accountMemory("job decoder", 0);
+  }
+
+  JobStatus Recognizer::getJobStatus() {
+    return job_status;
+  }
+
+  ReturnType Recognizer::getJobFeats(Feats& feats) {
+    if (!job_status.done || (job_status.type != FEATEX_JOB)) return BAD_STATE;
+    feats = job_feats;
+    return SUCCESS;
+  }
+
+  /*******************************************
+   *
+   * Transcribes each clip from start to end with the given
+   * search. The recognizer's own decoder is one of the workers,
+   * the others are decoders loaded from the same configuration,
+   * with the same added words and the same search, and kept for
+   * the next batch. Each decoder holds per-frame state in its
+   * acoustic model, so workers cannot share one. In JavaScript
+   * there are no threads, the calling thread would decode every
+   * chunk anyway, so the recognizer's decoder is the only worker.
+   * Language models added at runtime can only be decoded with one
+   * worker, the one of the configuration is loaded by each decoder.
+   *
+   *****************************************/
+  ReturnType Recognizer::transcribeBatch(const AudioBuffers& clips, int id, int numWorkers, BatchResults& results) {
+    TraceScope trace(tracer, TRACE_TRANSCRIBE_BATCH);
+    trace.args().i32(clips.size());
+    for (int i = 0; i < clips.size(); ++i) trace.args().samples(clips.at(i));
+    trace.args().i32(id).i32(numWorkers);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    if ((id < 0) || (id >= grammar_names.size()) || (numWorkers < 1)) return trace.end(BAD_ARGUMENT);
+#ifdef __EMSCRIPTEN__
+    numWorkers = 1;
+#endif
+    numWorkers = std::min(numWorkers, affordableWorkers());
+    // Clips are scored in full, like the other workers
+    FrameSkipPause skip_pause(decoder->acmod);
+    for (int i = 0; i < clips.size(); ++i)
+      if (clips.at(i).size() == 0) return trace.end(BAD_ARGUMENT);
+    const char *current_search = ps_get_search(decoder);
+    std::string previous_search = (current_search == NULL) ? "" : current_search;
+    if (updateGrammar(id) != SUCCESS) return trace.end(RUNTIME_ERROR);
+    // Language models keep scratch state while scoring, and the ones
+    // added at runtime would be shared by the workers' threads
+    if ((numWorkers > 1) && (id > 0) && ps_get_lm(decoder, grammar_names.at(id).c_str()))
+      return trace.end(BAD_ARGUMENT);
+    ReturnType r = prepareBatchWorkers(id, numWorkers);
+    if (r != SUCCESS) return trace.end(r);
+    if (ps_set_search(decoder, grammar_names.at(id).c_str())) return trace.end(RUNTIME_ERROR);
+    // The batch decodes with the recognizer's decoder
+    clearUtteranceResults();
+    std::vector<ps_decoder_t *> decoders(1, decoder);
+    decoders.insert(decoders.end(), batch_workers.begin(), batch_workers.begin() + numWorkers - 1);
+    int rv = batch_transcribe(decoders, clips, results, BATCH_MAX_CHUNK);
+    if (previous_search.size() > 0) ps_set_search(decoder, previous_search.c_str());
+    std::string hyps;
+    for (int i = 0; i < results.size(); ++i) hyps += (i ? "\n" : "") + results.at(i).hyp;
+    return trace.end((rv < 0) ? RUNTIME_ERROR : SUCCESS, hyps);
+  }
+
+  // Each worker loads the acoustic model and the dictionary again,
+  // which take as much as getMemoryReport gives for the recognizer's
+  // decoder, so there are only as many as fit in -batch_mem besides
+  // the recognizer's own
+  int Recognizer::affordableWorkers() {
+    MemoryReport report;
+    getMemoryReport(report);
+    long worker_bytes = 0;
+    for (int i = 0; i < report.size(); ++i)
+      if ((report.at(i).component == "acoustic model") || (report.at(i).component == "dictionary")
+	  || (report.at(i).component == "dict2pid"))
+	worker_bytes += report.at(i).bytes;
+    long budget = (long) cmd_ln_int32_r(cmd_line, "-batch_mem") << 20;
+    if (worker_bytes <= 0) return INT_MAX;
+    return 1 + (int) std::min((long) INT_MAX - 1, budget / worker_bytes);
+  }
+
+  // Models stored in half precision are expanded for the time of
+  // loading, the decoder keeps its own copy of the parameters
+  ps_decoder_t * Recognizer::newDecoder() {
+    std::vector<std::string> expanded;
+    const char *hmm = cmd_ln_str_r(cmd_line, "-hmm");
+    if (hmm && (hmm_expand_half(hmm, expanded) < 0)) {
+      hmm_remove_expanded(expanded);
+      return NULL;
+    }
+    ps_decoder_t *result = ps_init(cmd_line);
+    hmm_remove_expanded(expanded);
+    return result;
+  }
+
+  ReturnType Recognizer::prepareBatchWorkers(int id, int numWorkers) {
+    int heap_before = heapInUse();
+    while (batch_workers.size() < numWorkers - 1) {
+      ps_decoder_t *worker = newDecoder();
+      if (worker == NULL) return RUNTIME_ERROR;
+      batch_workers.push_back(worker);
+      for (int i = 0; i < added_words.size(); ++i)
+	if (ps_add_word(worker, added_words.at(i).word.c_str(), added_words.at(i).pronunciation.c_str(), i == added_words.size() - 1) < 0)
+	  return RUNTIME_ERROR;
+      // New decoders get every search set so far again
+      batch_searches.clear();
+    }
+    const char *name = grammar_names.at(id).c_str();
+    if ((batch_workers.size() > 0) && (batch_searches.find(name) == batch_searches.end())) {
+      // The default search comes from the configuration, which
+      // the workers were loaded with
+      if (id > 0) {
+	fsg_model_t *fsg = ps_get_fsg(decoder, name);
+	const char *kws = ps_get_kws(decoder, name);
+	for (int i = 0; i < batch_workers.size(); ++i) {
+	  int rv = -1;
+	  if (fsg) rv = ps_set_fsg(batch_workers.at(i), name, fsg);
+	  else if (kws) rv = ps_set_keyphrase(batch_workers.at(i), name, kws);
+	  if (rv < 0) return RUNTIME_ERROR;
+	}
+      }
+      batch_searches.insert(name);
+    }
+    for (int i = 0; i < batch_workers.size(); ++i)
+      if (ps_set_search(batch_workers.at(i), name)) return RUNTIME_ERROR;
+    if (heapInUse() > heap_before)
+      accountMemory("batch decoders", memory_usage["batch decoders"].bytes + heapInUse() - heap_before);
+    return SUCCESS;
+  }
+
+  void Recognizer::freeBatchWorkers() {
+    for (int i = 0; i < batch_workers.size(); ++i)
+      ps_free(batch_workers.at(i));
+    batch_workers.clear();
+    batch_searches.clear();
+    if (memory_usage.find("batch decoders") != memory_usage.end())
+      accountMemory("batch decoders", 0);
   }
 
   /*
@@ -153,93 +1552,82 @@ namespace pocketsphinxjs {
   	OLD FEATURE EXTRACTION FUNCTION
   */
   ReturnType Recognizer::wordAlign(const std::vector<int16_t>& buffer, const std::string& word) {
+  	TraceScope trace(tracer, TRACE_WORD_ALIGN);
+  	trace.args().samples(buffer).str(word);
 
   	const char * wordc = word.c_str();
   	printf("\nDecoding word ==> %s\n", wordc);
 
-  	size_t bufsize = 2048;
-
 
     if (decoder == NULL){
     	printf("Decoder is NULL\n");
-    	return BAD_STATE;
+    	return trace.end(BAD_STATE);
     }
-    if (buffer.size() == 0){
+    // Alignment scores are features, every frame is scored
+    FrameSkipPause skip_pause(decoder->acmod);
+    resolveWords(word, " \t\r\n");
+    // Without audio, the last utterance of the feature store
+    std::vector<mfcc_t *> rows;
+    if ((buffer.size() == 0) && !storedFrames(rows)){
   	  printf("%s\n", "Buffer IS EMPTY");
-      return RUNTIME_ERROR;
+      return trace.end(RUNTIME_ERROR);
     }
     //ps_process_raw(decoder, (short int *) &buffer[0], buffer.size(), 0, 0);
     //const char* h = ps_get_hyp(decoder, NULL);
     //current_hyp = (h == NULL) ? "" : h;
 
-    int16 buf[bufsize];
-    size_t nread;
-    int16 const *bptr;
-    int nfr;
-
     dict = decoder->dict;
     d2p = decoder->d2p;
     acmod = decoder->acmod;
 
   	std::cout << "Word to decode: " << wordc << "\n";
 
+    // Release the alignment of a previous call
+    if (search) ps_search_free(search);
+    if (al) ps_alignment_free(al);
+    search = NULL;
+    int heap_before = heapInUse();
+
+    // The text may hold several words separated by spaces
     al = ps_alignment_init(d2p);
     ps_alignment_add_word(al, dict_wordid(dict, "<s>"), 0);
-    ps_alignment_add_word(al, dict_wordid(dict, wordc), 0);
+    std::istringstream words(word);
+    std::string w;
+    while (words >> w) {
+      s3wid_t wid = dict_wordid(dict, w.c_str());
+      if (wid < 0) {
+        ps_alignment_free(al);
+        al = NULL;
+        return trace.end(BAD_ARGUMENT);
+      }
+      ps_alignment_add_word(al, wid, 0);
+    }
     ps_alignment_add_word(al, dict_wordid(dict, "</s>"), 0);
     ps_alignment_populate(al);
 
-    search = state_align_search_init("state_align", cmd_line, acmod, al);
-
-    acmod_start_utt(acmod);
-    ps_search_start(search);
-
-    size_t arrsize = buffer.size();
-
-  	printf("Buffer size: %u\n", arrsize);
-
-    size_t start = 0, end = bufsize;
-
-    while (start < end && end <= arrsize) {
-	  	printf("start : %u, end : %u\n", start, end);
-
-    	memset(buf, 0, sizeof(int16) * bufsize);
-    	
-    	for (int i = start, j = 0; i < end; i++, j++) {
-    		buf[j] = buffer[i];
-    	}
-    	nread = end - start;
-    	bptr = buf; 
-        while ((nfr = acmod_process_raw(acmod, &bptr, &nread, FALSE)) > 0) {
-            while (acmod->n_feat_frame > 0) {
-                ps_search_step(search, acmod->output_frame);
-                acmod_advance(acmod);
-            }
-        	printf("processed %d frames\n", nfr);
-        }
-
-        start += bufsize;
-        end += bufsize;
-        if (end > arrsize) {
-        	end = arrsize;
-        }
+    if (buffer.size() > 0)
+      search = align_utterance(decoder, al, &buffer[0], buffer.size(), NULL, 0);
+    else
+      search = align_utterance(decoder, al, NULL, 0, &rows[0], rows.size());
+    if (search == NULL) {
+      ps_alignment_free(al);
+      al = NULL;
+      return trace.end(RUNTIME_ERROR);
     }
 
-    acmod_end_utt(acmod);
-    ps_search_finish(search);
-
     printf("aligned %d words, %d phones, and %d states\n", 
         ps_alignment_n_words(al), ps_alignment_n_phones(al),
         ps_alignment_n_states(al));
+    accountMemory("alignment", heapInUse() - heap_before);
 
-    return SUCCESS;
+    return trace.end(SUCCESS);
   }
 
   /*
   	Function to get word alignment segmentation - OLD FEATEX CODE
   */
   ReturnType Recognizer::getWordAlignSeg(Segmentation& seg) {
-    if (decoder == NULL) return BAD_STATE;
+    if ((decoder == NULL) || (al == NULL)) return BAD_STATE;
     seg.clear();
 
     // METADATA
@@ -267,13 +1655,17 @@ namespace pocketsphinxjs {
     return SUCCESS;
   }
 
+  // Traced, as words read from -lazy_dict are added to the decoder
   std::string Recognizer::lookupWord(const std::string& word) {
+    TraceScope trace(tracer, TRACE_LOOKUP_WORD);
+    trace.args().str(word);
     std::string output = "";
-    if (word.size() > 0) {
+    if ((decoder != NULL) && (word.size() > 0) && resolveWord(word)) {
       char * result = ps_lookup_word(decoder, word.c_str());
       if (result != NULL)
 	output = result;
     }
+    trace.end(SUCCESS, output);
     return output;
   }
 
@@ -307,11 +1699,260 @@ namespace pocketsphinxjs {
     return SUCCESS;
   }
 
+  ReturnType Recognizer::getNbest(Nbest& nbest, int n) {
+    if ((decoder == NULL) || (is_recording)) return BAD_STATE;
+    if (n <= 0) return BAD_ARGUMENT;
+    // The iterator is kept between calls so that asking for more
+    // hypotheses only runs the A* search further
+    if ((nbest_cache.size() < n) && (!nbest_exhausted)) {
+      if ((nbest_itor == NULL) && (nbest_cache.size() == 0))
+	nbest_itor = ps_nbest(decoder);
+      while ((nbest_itor != NULL) && (nbest_cache.size() < n)) {
+	int32 score = 0;
+	const char* h = ps_nbest_hyp(nbest_itor, &score);
+	if (h != NULL) {
+	  NbestItem item;
+	  item.hyp = h;
+	  item.score = score;
+	  nbest_cache.push_back(item);
+	}
+	nbest_itor = ps_nbest_next(nbest_itor);
+      }
+      if (nbest_itor == NULL) nbest_exhausted = true;
+    }
+    nbest.assign(nbest_cache.begin(), nbest_cache.begin() + std::min((size_t) n, nbest_cache.size()));
+    return SUCCESS;
+  }
+
+  ReturnType Recognizer::getLattice(Lattice& lattice) {
+    if ((decoder == NULL) || (is_recording)) return BAD_STATE;
+    ReturnType r = computeLattice();
+    if (r != SUCCESS) return r;
+    lattice = lattice_cache;
+    return SUCCESS;
+  }
+
+  ReturnType Recognizer::getConfidences(Feats& confidences) {
+    if ((decoder == NULL) || (is_recording)) return BAD_STATE;
+    ReturnType r = computeLattice();
+    if (r != SUCCESS) return r;
+    confidences = confidence_cache;
+    return SUCCESS;
+  }
+
+  /*******************************************
+   *
+   * Packs the lattice of the last utterance, computes the link
+   * posteriors and derives one confidence per hypothesis segment
+   * as the posterior mass of the lattice links carrying the same
+   * word across the middle frame of the segment.
+   * Does nothing if the lattice is already cached.
+   *
+   *****************************************/
+  ReturnType Recognizer::computeLattice() {
+    if (lattice_ready) return SUCCESS;
+    int heap_before = heapInUse();
+    ps_lattice_t *dag = ps_get_lattice(decoder);
+    if (dag == NULL) return RUNTIME_ERROR;
+    logmath_t *lmath = ps_lattice_get_logmath(dag);
+    // Only n-gram searches have a language model to rescore with
+    ngram_model_t *lm = ps_get_lm(decoder, ps_get_search(decoder));
+    ps_lattice_posterior(dag, lm, cmd_ln_float32_r(ps_get_config(decoder), "-ascale"));
+
+    lattice_cache = Lattice();
+    // Edges follow the nodes in the order of the iterator, so that
+    // the lattice is the same from one run to the next. The map,
+    // ordered by address, is only used for lookups.
+    std::vector<ps_latnode_t*> node_list;
+    std::map<ps_latnode_t*, int> node_index;
+    std::map<std::string, int> word_index;
+    for (ps_latnode_iter_t *it = ps_latnode_iter(dag); it; it = ps_latnode_iter_next(it)) {
+      ps_latnode_t *node = ps_latnode_iter_node(it);
+      int16 fef = 0, lef = 0;
+      int sf = ps_latnode_times(node, &fef, &lef);
+      std::string w = ps_latnode_baseword(dag, node);
+      if (word_index.find(w) == word_index.end()) {
+	word_index[w] = lattice_cache.words.size();
+	lattice_cache.words.push_back(w);
+      }
+      node_index[node] = lattice_cache.numNodes();
+      node_list.push_back(node);
+      lattice_cache.nodes.push_back(sf);
+      lattice_cache.nodes.push_back(fef);
+      lattice_cache.nodes.push_back(lef);
+      lattice_cache.nodes.push_back(word_index[w]);
+    }
+    for (int n = 0; n < node_list.size(); ++n) {
+      for (ps_latlink_iter_t *it = ps_latnode_exits(node_list.at(n)); it; it = ps_latlink_iter_next(it)) {
+	ps_latlink_t *link = ps_latlink_iter_link(it);
+	ps_latnode_t *src = NULL;
+	ps_latnode_t *dest = ps_latlink_nodes(link, &src);
+	int16 sf = 0;
+	int32 ascr = 0;
+	int32 post = ps_latlink_prob(dag, link, &ascr);
+	lattice_cache.edges.push_back(n);
+	lattice_cache.edges.push_back((dest == NULL) ? -1 : node_index[dest]);
+	lattice_cache.edges.push_back(ps_latlink_times(link, &sf));
+	lattice_cache.edges.push_back(ascr);
+	lattice_cache.posteriors.push_back(logmath_exp(lmath, post));
+      }
+    }
+
+    confidence_cache.clear();
+    for (ps_seg_t *seg = ps_seg_iter(decoder); seg; seg = ps_seg_next(seg)) {
+      int32 sf = 0, ef = 0;
+      ps_seg_frames(seg, &sf, &ef);
+      int32 mid = (sf + ef) / 2;
+      std::string w = ps_seg_word(seg);
+      std::string::size_type alt = w.find('(');
+      if (alt != std::string::npos) w = w.substr(0, alt);
+      float conf = 0.0;
+      std::map<std::string, int>::iterator wi = word_index.find(w);
+      if (wi != word_index.end()) {
+	for (int e = 0; e < lattice_cache.numEdges(); ++e) {
+	  const int32_t *src = &lattice_cache.nodes[4 * lattice_cache.edges[4 * e]];
+	  if ((src[3] == wi->second) && (src[0] <= mid) && (lattice_cache.edges[4 * e + 2] >= mid))
+	    conf += lattice_cache.posteriors[e];
+	}
+      }
+      confidence_cache.push_back(std::min(conf, 1.0f));
+    }
+    lattice_ready = true;
+    accountMemory("lattice", heapInUse() - heap_before);
+    return SUCCESS;
+  }
+
+  ReturnType Recognizer::getMemoryReport(MemoryReport& report) {
+    if (decoder == NULL) return BAD_STATE;
+    int dict2pid_bytes = dict2pidBytes();
+    accountMemory("dictionary", dictionaryBytes());
+    accountMemory("dict2pid", dict2pid_bytes);
+    // Whatever ps_init allocated beyond the dictionary and its
+    // tables is the acoustic model and the default searches
+    accountMemory("acoustic model", std::max(0, init_bytes - init_dictionary_bytes - dict2pid_bytes));
+    if (is_recording)
+      accountMemory("utterance", heapInUse() - utterance_start_bytes);
+    accountMemory("heap in use", heapInUse());
+    report.clear();
+    for (std::map<std::string, MemoryItem>::iterator i = memory_usage.begin(); i != memory_usage.end(); ++i)
+      report.push_back(i->second);
+    return SUCCESS;
+  }
+
+  /*******************************************
+   *
+   * Releases everything that was allocated for the last
+   * utterance: lattice, N-best, alignment, featex scratch
+   * memory, their caches, and the lattices and histories of
+   * the searches. The decoder reuses its other search buffers
+   * on the next utterance, and the one of background jobs is
+   * kept for the next job, so after a reset a long running
+   * recognizer stays at the footprint of a single utterance.
+   *
+   *****************************************/
+  ReturnType Recognizer::resetUtterance() {
+    TraceScope trace(tracer, TRACE_RESET_UTTERANCE);
+    if ((decoder == NULL) || (is_recording)) return trace.end(BAD_STATE);
+    clearUtteranceResults();
+    StringsListType().swap(lattice_cache.words);
+    std::vector<int32_t>().swap(lattice_cache.nodes);
+    std::vector<int32_t>().swap(lattice_cache.edges);
+    std::vector<float>().swap(lattice_cache.posteriors);
+    Feats().swap(confidence_cache);
+    Nbest().swap(nbest_cache);
+    if (search) ps_search_free(search);
+    if (al) ps_alignment_free(al);
+    search = NULL;
+    al = NULL;
+    featex_arena.release();
+    if (!job_status.running) {
+      dropJob();
+      job_arena.release();
+    }
+    Feats().swap(phone_scores);
+    Feats().swap(word_scores);
+    feature_store_frames = 0;
+    feature_store_complete = false;
+    releaseSearchUtterance(decoder->search);
+    accountMemory("lattice", 0);
+    accountMemory("alignment", 0);
+    accountMemory("featex", 0);
+    // What the release left of the heap grown since start()
+    accountMemory("utterance", heapInUse() - utterance_start_bytes);
+    return trace.end(SUCCESS);
+  }
+
+  void Recognizer::accountMemory(const std::string& component, int bytes) {
+    MemoryItem& item = memory_usage[component];
+    if (item.component.size() == 0) {
+      item.component = component;
+      item.peakBytes = 0;
+    }
+    item.bytes = std::max(0, bytes);
+    item.peakBytes = std::max(item.peakBytes, item.bytes);
+  }
+
+  void Recognizer::registerSearchMemory(int id, int bytes) {
+    std::ostringstream component;
+    component << "search " << id;
+    accountMemory(component.str(), bytes);
+  }
+
+  // Estimate of the dictionary size from its entries
+  int Recognizer::dictionaryBytes() {
+    dict_t *d = decoder->dict;
+    int bytes = d->max_words * sizeof(dictword_t);
+    for (int i = 0; i < d->n_word; ++i)
+      bytes += strlen(d->word[i].word) + 1 + d->word[i].pronlen * sizeof(s3cipid_t) + 4 * sizeof(void*);
+    return bytes;
+  }
+
+  // The cross-word tables only depend on the phone set: diphone
+  // tables indexed by three phones, and for each pair of phones
+  // a right context set, with its senone sequences and phone map
+  int Recognizer::dict2pidBytes() {
+    dict2pid_t *d2p = decoder->d2p;
+    int n_ci = bin_mdef_n_ciphone(decoder->acmod->mdef);
+    int bytes = 2 * (n_ci * n_ci * n_ci * sizeof(s3ssid_t) + n_ci * (n_ci + 1) * sizeof(void*));
+    bytes += 2 * (n_ci * n_ci * sizeof(xwdssid_t) + n_ci * sizeof(void*));
+    for (int b = 0; b < n_ci; ++b)
+      for (int c = 0; c < n_ci; ++c)
+	bytes += (d2p->rssid[b][c].n_ssid + d2p->lrssid[b][c].n_ssid) * sizeof(s3ssid_t)
+	  + 2 * n_ci * sizeof(s3cipid_t);
+    return bytes;
+  }
+
+  int heapInUse() {
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+    return (int) info.uordblks;
+  }
+
+  void Recognizer::clearUtteranceResults() {
+    if (nbest_itor) ps_nbest_free(nbest_itor);
+    nbest_itor = NULL;
+    nbest_exhausted = false;
+    nbest_cache.clear();
+    lattice_cache = Lattice();
+    confidence_cache.clear();
+    lattice_ready = false;
+  }
+
   void Recognizer::cleanup() {
+    clearUtteranceResults();
+    freeBatchWorkers();
+    dropSearches();
+    dropJob();
+    freeJobDecoder();
+    job_arena.release();
     if (decoder) ps_free(decoder);
     if (logmath) logmath_free(logmath);
     if (search) ps_search_free(search);
     if (al) ps_alignment_free(al);
+    lazy_dict.close();
     decoder = NULL;
     logmath = NULL;
     search = NULL;
@@ -347,6 +1988,34 @@ namespace pocketsphinxjs {
 	ARG_BOOLEAN,
 	"no",
 	"Print word times in file transcription." },
+      { "-lazy_dict",
+	ARG_STRING,
+	NULL,
+	"Dictionary file read word by word when words are used, instead of -dict." },
+      { "-align_window",
+	ARG_INT32,
+	"0",
+	"Phones searched on each side of the best one in forced alignment, 0 to search all." },
+      { "-align_beam",
+	ARG_FLOAT64,
+	"1e-60",
+	"Beam of the windowed forced alignment." },
+      { "-frame_skip",
+	ARG_FLOAT32,
+	"0",
+	"Cepstral change below which a frame reuses the senone scores of the last frame scored, 0 to score every frame." },
+      { "-frame_skip_max",
+	ARG_INT32,
+	"2",
+	"Frames in a row that can reuse senone scores." },
+      { "-batch_mem",
+	ARG_INT32,
+	"512",
+	"Megabytes the extra decoders of transcribeBatch can take, each as much as the acoustic model and dictionary." },
+      { "-trace",
+	ARG_STRING,
+	NULL,
+	"File recording the calls made to the recognizer, for pocketsphinx_replay." },
       CMDLN_EMPTY_OPTION
     };
     grammar_names.push_back("_default");
@@ -378,11 +2047,61 @@ namespace pocketsphinxjs {
       delete [] argv;
       return RUNTIME_ERROR;
     }
-    decoder = ps_init(cmd_line);
+    freeBatchWorkers();
+    // Joint searches are those of the previous decoder
+    dropSearches();
+    // The job decoder was loaded from the previous configuration
+    dropJob();
+    freeJobDecoder();
+    job_arena.release();
+    added_words.clear();
+    grammar_transitions.clear();
+    stale_grammars.clear();
+    removed_links.clear();
+    grammar_removals.clear();
+    feature_store_max = 0;
+    feature_store_frames = 0;
+    feature_store_complete = false;
+    std::vector<mfcc_t>().swap(feature_store);
+    rollover.configure(0, 0, 0);
+    history.clear();
+    history_max = 0;
+    events_max = 0;
+    events.clear();
+    lm_set = NULL;
+    lm_set_index = -1;
+    lm_set_bytes = 0;
+    memory_usage.clear();
+    memset(&beam_base, 0, sizeof(beam_base));
+    int heap_before = heapInUse();
+    decoder = newDecoder();
     delete [] argv;
     if (decoder == NULL) {
       return RUNTIME_ERROR;
     }
+    // Only the recognizer's decoder skips frames, the ones
+    // of jobs and batches score every frame
+    float frame_skip = cmd_ln_float32_r(cmd_line, "-frame_skip");
+    if ((frame_skip > 0)
+	&& (frame_skip_init(decoder->acmod, frame_skip, cmd_ln_int32_r(cmd_line, "-frame_skip_max")) < 0))
+      return RUNTIME_ERROR;
+    init_bytes = heapInUse() - heap_before;
+    lazy_dict.close();
+    const char *lazy_dict_file = cmd_ln_str_r(cmd_line, "-lazy_dict");
+    if (lazy_dict_file && (lazy_dict.open(lazy_dict_file) < 0))
+      return RUNTIME_ERROR;
+    accountMemory("lazy dictionary", lazy_dict.bytes());
+    // The same file goes on recording across reInit
+    const char *trace_file = cmd_ln_str_r(cmd_line, "-trace");
+    if (trace_file == NULL)
+      tracer.close();
+    else if ((!tracer.isOpen() || (tracer.path() != trace_file)) && (tracer.open(trace_file) < 0))
+      return RUNTIME_ERROR;
+    beams_from_config(cmd_line, ps_get_logmath(decoder), &beam_base);
+    samprate = cmd_ln_float32_r(cmd_line, "-samprate");
+    latency.setFrameRate(cmd_ln_int32_r(cmd_line, "-frate"));
+    latency.configure(0, 1);
+    init_dictionary_bytes = dictionaryBytes();
     logmath = logmath_init(1.0001, 0, 0);
     if (logmath == NULL) {
       return RUNTIME_ERROR;
@@ -6,9 +6,12 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <deque>
 #include <sstream>
 #include <iostream>
+#ifdef __EMSCRIPTEN__
 #include <emscripten/bind.h>
+#endif /* __EMSCRIPTEN__ */
 #include "pocketsphinx.h"
 
 // For state alignment
@@ -17,6 +20,16 @@
 #include "pocketsphinx_internal.h"
 
 #include "featex.h"
+#include "align.h"
+#include "batch.h"
+#include "latency.h"
+#include "halfmodel.h"
+#include "continuous.h"
+#include "lazydict.h"
+#include "trace.h"
+#include "multisearch.h"
+#include "pronmodel.h"
+#include "frameskip.h"
 
 namespace pocketsphinxjs {
 
@@ -41,6 +54,9 @@ namespace pocketsphinxjs {
     std::vector<Transition> transitions;
   };
 
+  // Transitions of a grammar by word, as (from, to) states
+  typedef std::multimap<std::string, std::pair<int, int> > WordTransitions;
+
   typedef std::map<std::string, std::string> Dictionary;
   
   struct Word {
@@ -69,6 +85,115 @@ namespace pocketsphinxjs {
 
   typedef std::vector<float> Feats;
 
+  enum EventType {
+    KEYWORD_SPOTTED,
+    WORD_FINAL,
+    UTTERANCE_END
+  };
+
+  // Something the decoder committed to during process() or stop().
+  // Frames are counted from start(), text is the key phrase, the
+  // word or the hypothesis of the utterance. The score is the
+  // detection probability of key phrases, 0 otherwise
+  struct Event {
+    EventType type;
+    std::string text;
+    int start;
+    int end;
+    int score;
+  };
+
+  typedef std::vector<Event> Events;
+
+  enum JobType {
+    FEATEX_JOB,
+    ALIGN_JOB
+  };
+
+  // State of the background job, see startJob. Progress goes
+  // from 0 to 1, steps and elapsedMs count the work done so far
+  struct JobStatus {
+    JobType type;
+    bool running;
+    bool done;
+    float progress;
+    int steps;
+    float elapsedMs;
+  };
+
+  struct NbestItem {
+    std::string hyp;
+    int score;
+  };
+
+  typedef std::vector<NbestItem> Nbest;
+
+  // Hypothesis of one of the searches decoding the utterance,
+  // with its path score
+  struct SearchHyp {
+    int id;
+    std::string hyp;
+    int score;
+  };
+
+  typedef std::vector<SearchHyp> SearchHyps;
+
+  // Resident heap bytes attributed to one component, with the
+  // highest value seen since the recognizer was initialized
+  struct MemoryItem {
+    std::string component;
+    int bytes;
+    int peakBytes;
+  };
+
+  typedef std::vector<MemoryItem> MemoryReport;
+
+  // Pruning in use with the real-time factor it achieves,
+  // beams are in the log domain of the search
+  struct OperatingPoint {
+    float targetRtf;
+    float rtf;
+    float frameMs;
+    float scale;
+    int beam;
+    int wbeam;
+    int pbeam;
+    int maxhmmpf;
+    int maxwpf;
+  };
+
+  // Frames of the utterance that reused the senone scores of an
+  // earlier frame, and what audits of those frames found: mean
+  // difference of the reused scores and of the scores computed on
+  // the frame, and how often the best senone was the same as when
+  // scored in full
+  struct FrameSkipReport {
+    int frames;
+    int skippedFrames;
+    float skipRate;
+    float reusedSenones;
+    int auditedFrames;
+    float scoreError;
+    float newScoreError;
+    float bestSenoneAgreement;
+  };
+
+  // Compact copy of a word lattice. Nodes are packed as
+  // (start frame, first end frame, last end frame, word index)
+  // and edges as (source node, destination node, end frame,
+  // acoustic score), with one posterior probability per edge.
+  struct Lattice {
+    StringsListType words;
+    std::vector<int32_t> nodes;
+    std::vector<int32_t> edges;
+    std::vector<float> posteriors;
+    int numNodes() const { return nodes.size() / 4; }
+    int numEdges() const { return edges.size() / 4; }
+    std::string word(int i) const {
+      return ((i < 0) || (i >= words.size())) ? "" : words.at(i);
+    }
+  };
+
   class Recognizer {
 
   public:
@@ -78,21 +203,111 @@ namespace pocketsphinxjs {
     ReturnType addWords(const std::vector<Word>&);
     ReturnType addGrammar(Integers&, const Grammar&);
     ReturnType addKeyword(Integers&, const std::string&);
+    // Grammars from a JSGF source, or from a blob packed by
+    // tools/fsg_pack.js given as a typed array
+    ReturnType addGrammarJsgf(Integers&, const std::string&);
+    ReturnType addGrammarBinary(Integers&, const std::string&);
+    // Language models sharing one search and one word mapping,
+    // selected or interpolated by name between utterances
+    ReturnType addLanguageModel(Integers&, const std::string&, const std::string&);
+    ReturnType selectLanguageModel(const std::string&);
+    ReturnType interpolateLanguageModels(const StringsListType&, const Feats&);
+    // In place edits of a grammar added with addGrammar, the
+    // search is updated once, when it is next used
+    ReturnType addTransitions(int, const std::vector<Transition>&);
+    ReturnType removeTransitions(int, const std::vector<Transition>&);
+    ReturnType removeWord(int, const std::string&);
     // Kept for backward compatibility, use switchSearch
     // instead
     ReturnType switchGrammar(int);
     ReturnType switchSearch(int);
+    // Searches decoding the next utterances together, each frame
+    // being scored once for all of them. The first one gives
+    // getHyp and the other results, getSearchHyps gives the
+    // hypothesis of each. switchSearch goes back to one search
+    ReturnType setSearches(const Integers&);
+    ReturnType getSearchHyps(SearchHyps&);
     std::string getHyp();
     ReturnType getHypseg(Segmentation&);
+
+    // Second-pass results, computed on first request after
+    // stop() and cached until the next start()
+    ReturnType getNbest(Nbest&, int);
+    ReturnType getLattice(Lattice&);
+    ReturnType getConfidences(Feats&);
+
+    // Memory accounting, and release of everything held for
+    // the last utterance
+    ReturnType getMemoryReport(MemoryReport&);
+    ReturnType resetUtterance();
     
     ReturnType start();
     ReturnType stop();
     ReturnType process(const std::vector<int16_t>&);
     
+    // Keeps the cepstral frames of the next utterances, up to the
+    // given number of frames, 0 to disable. wordAlign and
+    // pronFeatex then work on the last utterance when given no
+    // audio, and reprocess decodes it again with another search
+    ReturnType setFeatureStore(int);
+    ReturnType reprocess(int);
+
+    // Always-on listening: the utterance is ended and a new one
+    // started after the given number of frames, or earlier after
+    // the given number of quiet frames, 0 for no rollover. Words
+    // of the utterances ended since start() are kept in a history
+    // of the given size, with frames counted from start()
+    ReturnType setContinuous(int, int, int);
+    ReturnType getHistory(Segmentation&);
+
+    // Queue of events of up to the given size, 0 to disable it.
+    // getEvents moves the queued events to the vector, oldest
+    // first; events are dropped, oldest first, if not taken
+    ReturnType setEventQueue(int);
+    ReturnType getEvents(Events&);
+
     // Feature extraction for pronunciation evaluation
     ReturnType wordAlign(const std::vector<int16_t>&, const std::string&);
     ReturnType getWordAlignSeg(Segmentation&);
     ReturnType pronFeatex(const std::vector<int16_t>&, const std::string&, Feats&);
+    // Scoring model packed by tools/pron_model_pack.js, run by
+    // pronFeatex on its features, an empty model removes it.
+    // getPronScores gives the scores of the last pronFeatex, per
+    // phone with features and per word of the sentence
+    ReturnType loadPronModel(const std::string&);
+    ReturnType getPronScores(Feats&, Feats&);
+    // pronFeatex (FEATEX_JOB) or wordAlign (ALIGN_JOB) as a
+    // background job, on the given audio or the last utterance.
+    // runJob runs it for about the given milliseconds, at least
+    // one step, and utterances can be decoded in between. Once
+    // done, getJobFeats, getPronScores or getWordAlignSeg give
+    // its results. A new job replaces the one in progress
+    ReturnType startJob(JobType, const std::vector<int16_t>&, const std::string&);
+    ReturnType runJob(int);
+    ReturnType cancelJob();
+    JobStatus getJobStatus();
+    ReturnType getJobFeats(Feats&);
+
+    // Front-end adaptation state (CMN and AGC estimates) as a
+    // vector of floats, to restore it in another session. It is
+    // kept across start() and reInit with the same features
+    ReturnType exportAdaptationState(Feats&);
+    ReturnType importAdaptationState(const Feats&);
+
+    // Adapts pruning so that process() keeps up with the given
+    // real-time factor, never below the given fraction of the
+    // configured beams. A target of 0 restores the configuration
+    ReturnType setLatencyBudget(float, float);
+    OperatingPoint getOperatingPoint();
+
+    // Frame skipping since start(), with -frame_skip
+    FrameSkipReport getFrameSkipStats();
+
+    // Offline transcription of many clips with the given search,
+    // spread over the given number of decoders (one in JavaScript).
+    // Decoders besides the recognizer's each load the model again,
+    // there are only as many as -batch_mem can hold
+    ReturnType transcribeBatch(const AudioBuffers&, int, int, BatchResults&);
 
     ReturnType testprint();
 
@@ -102,8 +317,40 @@ namespace pocketsphinxjs {
     
   private:
     ReturnType init(const Config&);
+    ps_decoder_t *newDecoder();
+    int affordableWorkers();
+    ReturnType searchAdded(Integers&, int);
+    bool resolveWord(const std::string&);
+    void resolveWords(const std::string&, const char *);
     bool isValidParameter(const std::string&, const std::string&);
     void cleanup();
+    ReturnType computeLattice();
+    void clearUtteranceResults();
+    void accountMemory(const std::string&, int);
+    void registerSearchMemory(int, int);
+    int dictionaryBytes();
+    int dict2pidBytes();
+    ReturnType prepareBatchWorkers(int, int);
+    ReturnType editableGrammar(int, fsg_model_t **);
+    ReturnType processFrames(const std::vector<int16_t>&);
+    bool storedFrames(std::vector<mfcc_t *>&);
+    ReturnType processStoredFrames(const std::vector<mfcc_t *>&);
+    void removeTransition(int, fsg_model_t *, const Transition&);
+    ReturnType updateGrammar(int);
+    ReturnType rollOver();
+    ReturnType startSearches();
+    void dropSearches();
+    void updateHyp();
+    void recordHistory(int);
+    bool isRealWord(const char *);
+    void collectEvents(bool, int);
+    void pushEvent(EventType, const std::string&, int, int, int);
+    void freeBatchWorkers();
+    void finishJob();
+    void dropJob();
+    void freeJobDecoder();
+    ReturnType restoreAdaptationState(const Feats&);
+    void traceInit(const Config&, ReturnType, double);
     StringsListType grammar_names;
     bool is_fsg;
     bool is_recording;
@@ -119,6 +366,111 @@ namespace pocketsphinxjs {
     std::string default_language_model;
     std::string default_dictionary;
 
+    // Cached second-pass results of the last utterance
+    bool lattice_ready;
+    Lattice lattice_cache;
+    Feats confidence_cache;
+    Nbest nbest_cache;
+    ps_nbest_t * nbest_itor;
+    bool nbest_exhausted;
+
+    // Heap usage per component, see getMemoryReport
+    std::map<std::string, MemoryItem> memory_usage;
+    int init_bytes;
+    int init_dictionary_bytes;
+    int utterance_start_bytes;
+
+    // Scratch memory of pronFeatex, kept between calls
+    FeatexArena featex_arena;
+    // Scoring of the features, see loadPronModel
+    PronModel pron_model;
+    std::vector<int> phone_words;
+    Feats phone_scores;
+    Feats word_scores;
+
+    // Word index of the grammars, those edited since their search
+    // was last updated, the links removed since, which the search
+    // still points to, and the removals since the grammar was last
+    // compacted
+    std::map<int, WordTransitions> grammar_transitions;
+    std::set<int> stale_grammars;
+    std::map<int, std::vector<fsg_link_t *> > removed_links;
+    std::map<int, int> grammar_removals;
+
+    // Model set of addLanguageModel, owned by its search
+    ngram_model_t * lm_set;
+    int lm_set_index;
+    int lm_set_bytes;
+
+    // Pruning of the configuration, scaled to the latency budget
+    beam_settings_t beam_base;
+    LatencyController latency;
+    int samprate;
+
+    // Cepstral frames of the last utterance, see setFeatureStore
+    int feature_store_max;
+    int feature_store_frames;
+    bool feature_store_complete;
+    std::vector<mfcc_t> feature_store;
+    std::vector<mfcc_t> silence_frame;
+    std::vector<mfcc_t> cep_scratch;
+    int ncep;
+
+    // Continuous mode, see setContinuous
+    RolloverController rollover;
+    std::deque<SegItem> history;
+    int history_max;
+    int utterance_offset;
+    int skip_frames;
+
+    // Event queue, with what was reported of the utterance
+    std::deque<Event> events;
+    int events_max;
+    std::set<std::pair<std::string, int> > keywords_reported;
+    int words_final;
+    Segmentation previous_words;
+    // End of the last word reported, counted from the first
+    // utterance, and the frames at the start of the utterance whose
+    // words were reported before the rollover
+    int word_events_end;
+    int word_skip_frames;
+
+    // Searches set with setSearches, and the search running them
+    // for the current utterance, rebuilt by start()
+    Integers joint_searches;
+    ps_search_t *multi_search;
+    SearchHyps search_hyps;
+
+    // Index of the -lazy_dict file, see resolveWord
+    LazyDictionary lazy_dict;
+
+    // Calls recorded with -trace, see trace.h
+    TraceWriter tracer;
+
+    // Words added since init, replayed on the batch decoders
+    std::vector<Word> added_words;
+    // Extra decoders of transcribeBatch, kept until the words or
+    // the configuration change, and the searches set on them
+    std::vector<ps_decoder_t *> batch_workers;
+    StringsSetType batch_searches;
+
+    // Background job, run on a decoder of its own, loaded for the
+    // time of the job with the words added so far, and on its own
+    // copy of the audio or of the stored frames
+    ps_decoder_t *job_decoder;
+    int job_words;
+    JobStatus job_status;
+    int job_heap_start;
+    std::vector<int16_t> job_audio;
+    std::vector<mfcc_t> job_cep;
+    std::vector<mfcc_t *> job_rows;
+    FeatexArena job_arena;
+    FeatexJob featex_job;
+    std::vector<int> job_phone_words;
+    Feats job_feats;
+    AlignJob align_job;
+    ps_alignment_t *job_al;
+
     // state alignment variables
     cmd_ln_t * cmd_line;
     dict_t *dict;
@@ -153,7 +505,17 @@ namespace pocketsphinxjs {
  * transitions.delete();
  * var id = ids.get(0);
  * ids.delete();
+ * transitions = new Module.VectorTransitions();
+ * transitions.push_back({from: 1, to: 2, word: "WORLD"});
+ * recognizer.removeTransitions(id, transitions);
+ * recognizer.removeWord(id, "HELLO");
+ * transitions.delete();
  * var length = 100;
+ * recognizer.setLatencyBudget(0.8, 0.3);
+ * var state = new Module.Feats();
+ * recognizer.exportAdaptationState(state); // after a few utterances
+ * recognizer.importAdaptationState(state); // in a later session
+ * state.delete();
  * recognizer.start();
  * var buffer = new Module.AudioBuffer();
  * for (var i = 0 ; i < length ; i++)
@@ -163,11 +525,58 @@ namespace pocketsphinxjs {
  * recognizer.process(buffer);
  * buffer.delete();
  * recognizer.stop();
+ * // With recognizer.setSearches(ids) before start(), where ids
+ * // holds a key phrase and a grammar, getSearchHyps(hyps) gives
+ * // the hypothesis of each.
+ * // With recognizer.setFeatureStore(3000) before start():
+ * // recognizer.reprocess(otherId);
+ * // recognizer.wordAlign(new Module.AudioBuffer(), "HELLO WORLD");
+ * // or, a slice at a time between process() calls:
+ * // recognizer.startJob(Module.JobType.ALIGN_JOB, new Module.AudioBuffer(), "HELLO WORLD");
+ * // while (!recognizer.getJobStatus().done) recognizer.runJob(10);
+ * // With recognizer.setContinuous(3000, 50, 100) before start(),
+ * // process() can run for hours, getHistory(segmentation) gives
+ * // the last 100 words.
+ * var nbest = new Module.Nbest();
+ * recognizer.getNbest(nbest, 5);
+ * nbest.delete();
+ * var lattice = new Module.Lattice();
+ * recognizer.getLattice(lattice);
+ * var edges = lattice.edges().slice(); // Int32Array, 4 values per edge
+ * lattice.delete();
+ * recognizer.addLanguageModel(ids, "dictation", "dictation.lm");
+ * recognizer.addLanguageModel(ids, "address", "address.lm");
+ * recognizer.switchSearch(ids.get(0));
+ * recognizer.selectLanguageModel("address");
+ * var clips = new Module.AudioBuffers();
+ * clips.push_back(buffer1);
+ * clips.push_back(buffer2);
+ * var results = new Module.BatchResults();
+ * recognizer.transcribeBatch(clips, id, 4, results);
+ * var text = results.get(1).hyp;
+ * results.delete();
+ * clips.delete();
  * recognizer.delete();
  *
  *********************************************/
 
+#ifdef __EMSCRIPTEN__
+
 namespace ps = pocketsphinxjs;
+
+// Lattice arrays are handed to JavaScript as typed array views
+// on the module heap, they must be copied if kept after the
+// Lattice object is modified or deleted
+inline emscripten::val latticeNodes(const ps::Lattice& l) {
+  return emscripten::val(emscripten::typed_memory_view(l.nodes.size(), l.nodes.data()));
+}
+inline emscripten::val latticeEdges(const ps::Lattice& l) {
+  return emscripten::val(emscripten::typed_memory_view(l.edges.size(), l.edges.data()));
+}
+inline emscripten::val latticePosteriors(const ps::Lattice& l) {
+  return emscripten::val(emscripten::typed_memory_view(l.posteriors.size(), l.posteriors.data()));
+}
+
 EMSCRIPTEN_BINDINGS(recognizer) {
 
   emscripten::enum_<ps::ReturnType>("ReturnType")
@@ -176,6 +585,15 @@ EMSCRIPTEN_BINDINGS(recognizer) {
     .value("BAD_ARGUMENT", ps::BAD_ARGUMENT)
     .value("RUNTIME_ERROR", ps::RUNTIME_ERROR);
 
+  emscripten::enum_<ps::EventType>("EventType")
+    .value("KEYWORD_SPOTTED", ps::KEYWORD_SPOTTED)
+    .value("WORD_FINAL", ps::WORD_FINAL)
+    .value("UTTERANCE_END", ps::UTTERANCE_END);
+
+  emscripten::enum_<ps::JobType>("JobType")
+    .value("FEATEX_JOB", ps::FEATEX_JOB)
+    .value("ALIGN_JOB", ps::ALIGN_JOB);
+
   emscripten::value_array<ps::Word>("Word")
     .element(&ps::Word::word)
     .element(&ps::Word::pronunciation);
@@ -197,6 +615,61 @@ EMSCRIPTEN_BINDINGS(recognizer) {
     .field("logp", &ps::Transition::logp)
     .field("word", &ps::Transition::word);
 
+  emscripten::value_object<ps::MemoryItem>("MemoryItem")
+    .field("component", &ps::MemoryItem::component)
+    .field("bytes", &ps::MemoryItem::bytes)
+    .field("peakBytes", &ps::MemoryItem::peakBytes);
+
+  emscripten::value_object<ps::OperatingPoint>("OperatingPoint")
+    .field("targetRtf", &ps::OperatingPoint::targetRtf)
+    .field("rtf", &ps::OperatingPoint::rtf)
+    .field("frameMs", &ps::OperatingPoint::frameMs)
+    .field("scale", &ps::OperatingPoint::scale)
+    .field("beam", &ps::OperatingPoint::beam)
+    .field("wbeam", &ps::OperatingPoint::wbeam)
+    .field("pbeam", &ps::OperatingPoint::pbeam)
+    .field("maxhmmpf", &ps::OperatingPoint::maxhmmpf)
+    .field("maxwpf", &ps::OperatingPoint::maxwpf);
+
+  emscripten::value_object<ps::FrameSkipReport>("FrameSkipReport")
+    .field("frames", &ps::FrameSkipReport::frames)
+    .field("skippedFrames", &ps::FrameSkipReport::skippedFrames)
+    .field("skipRate", &ps::FrameSkipReport::skipRate)
+    .field("reusedSenones", &ps::FrameSkipReport::reusedSenones)
+    .field("auditedFrames", &ps::FrameSkipReport::auditedFrames)
+    .field("scoreError", &ps::FrameSkipReport::scoreError)
+    .field("newScoreError", &ps::FrameSkipReport::newScoreError)
+    .field("bestSenoneAgreement", &ps::FrameSkipReport::bestSenoneAgreement);
+
+  emscripten::value_object<BatchItem>("BatchItem")
+    .field("hyp", &BatchItem::hyp)
+    .field("seconds", &BatchItem::seconds)
+    .field("elapsedMs", &BatchItem::elapsedMs)
+    .field("chunks", &BatchItem::chunks);
+
+  emscripten::value_object<ps::Event>("Event")
+    .field("type", &ps::Event::type)
+    .field("text", &ps::Event::text)
+    .field("start", &ps::Event::start)
+    .field("end", &ps::Event::end)
+    .field("score", &ps::Event::score);
+
+  emscripten::value_object<ps::JobStatus>("JobStatus")
+    .field("type", &ps::JobStatus::type)
+    .field("running", &ps::JobStatus::running)
+    .field("done", &ps::JobStatus::done)
+    .field("progress", &ps::JobStatus::progress)
+    .field("steps", &ps::JobStatus::steps)
+    .field("elapsedMs", &ps::JobStatus::elapsedMs);
+
+  emscripten::value_object<ps::SearchHyp>("SearchHyp")
+    .field("id", &ps::SearchHyp::id)
+    .field("hyp", &ps::SearchHyp::hyp)
+    .field("score", &ps::SearchHyp::score);
+
+  emscripten::value_object<ps::NbestItem>("NbestItem")
+    .field("hyp", &ps::NbestItem::hyp)
+    .field("score", &ps::NbestItem::score);
 
   emscripten::register_vector<int16_t>("AudioBuffer");
   emscripten::register_vector<ps::Transition>("VectorTransitions");
@@ -204,7 +677,23 @@ EMSCRIPTEN_BINDINGS(recognizer) {
   emscripten::register_vector<ps::ConfigItem>("Config");
   emscripten::register_vector<ps::SegItem>("Segmentation");
   emscripten::register_vector<int>("Integers");
+  emscripten::register_vector<std::string>("StringList");
   emscripten::register_vector<float>("Feats");
+  emscripten::register_vector<ps::SearchHyp>("SearchHyps");
+  emscripten::register_vector<ps::NbestItem>("Nbest");
+  emscripten::register_vector<ps::Event>("Events");
+  emscripten::register_vector<ps::MemoryItem>("MemoryReport");
+  emscripten::register_vector<std::vector<int16_t> >("AudioBuffers");
+  emscripten::register_vector<BatchItem>("BatchResults");
+
+  emscripten::class_<ps::Lattice>("Lattice")
+    .constructor<>()
+    .function("numNodes", &ps::Lattice::numNodes)
+    .function("numEdges", &ps::Lattice::numEdges)
+    .function("word", &ps::Lattice::word)
+    .function("nodes", &latticeNodes)
+    .function("edges", &latticeEdges)
+    .function("posteriors", &latticePosteriors);
 
   emscripten::value_object<ps::Grammar>("Grammar")
     .field("start", &ps::Grammar::start)
@@ -219,18 +708,54 @@ EMSCRIPTEN_BINDINGS(recognizer) {
     .function("addWords", &ps::Recognizer::addWords)
     .function("addGrammar", &ps::Recognizer::addGrammar)
     .function("addKeyword", &ps::Recognizer::addKeyword)
+    .function("addGrammarJsgf", &ps::Recognizer::addGrammarJsgf)
+    .function("addGrammarBinary", &ps::Recognizer::addGrammarBinary)
+    .function("addLanguageModel", &ps::Recognizer::addLanguageModel)
+    .function("selectLanguageModel", &ps::Recognizer::selectLanguageModel)
+    .function("interpolateLanguageModels", &ps::Recognizer::interpolateLanguageModels)
+    .function("addTransitions", &ps::Recognizer::addTransitions)
+    .function("removeTransitions", &ps::Recognizer::removeTransitions)
+    .function("removeWord", &ps::Recognizer::removeWord)
     .function("switchGrammar", &ps::Recognizer::switchGrammar)
     .function("switchSearch", &ps::Recognizer::switchSearch)
+    .function("setSearches", &ps::Recognizer::setSearches)
+    .function("getSearchHyps", &ps::Recognizer::getSearchHyps)
     .function("getHyp", &ps::Recognizer::getHyp)
     .function("getHypseg", &ps::Recognizer::getHypseg)
+    .function("getNbest", &ps::Recognizer::getNbest)
+    .function("getLattice", &ps::Recognizer::getLattice)
+    .function("getConfidences", &ps::Recognizer::getConfidences)
+    .function("getMemoryReport", &ps::Recognizer::getMemoryReport)
+    .function("resetUtterance", &ps::Recognizer::resetUtterance)
     .function("getWordAlignSeg", &ps::Recognizer::getWordAlignSeg)
     .function("start", &ps::Recognizer::start)
     .function("stop", &ps::Recognizer::stop)
     .function("lookupWord", &ps::Recognizer::lookupWord)
     .function("process", &ps::Recognizer::process)
     .function("wordAlign", &ps::Recognizer::wordAlign)
+    .function("setFeatureStore", &ps::Recognizer::setFeatureStore)
+    .function("reprocess", &ps::Recognizer::reprocess)
+    .function("setContinuous", &ps::Recognizer::setContinuous)
+    .function("getHistory", &ps::Recognizer::getHistory)
+    .function("setEventQueue", &ps::Recognizer::setEventQueue)
+    .function("getEvents", &ps::Recognizer::getEvents)
     .function("testprint", &ps::Recognizer::testprint)
-    .function("pronFeatex", &ps::Recognizer::pronFeatex);
+    .function("pronFeatex", &ps::Recognizer::pronFeatex)
+    .function("loadPronModel", &ps::Recognizer::loadPronModel)
+    .function("getPronScores", &ps::Recognizer::getPronScores)
+    .function("startJob", &ps::Recognizer::startJob)
+    .function("runJob", &ps::Recognizer::runJob)
+    .function("cancelJob", &ps::Recognizer::cancelJob)
+    .function("getJobStatus", &ps::Recognizer::getJobStatus)
+    .function("getJobFeats", &ps::Recognizer::getJobFeats)
+    .function("exportAdaptationState", &ps::Recognizer::exportAdaptationState)
+    .function("importAdaptationState", &ps::Recognizer::importAdaptationState)
+    .function("setLatencyBudget", &ps::Recognizer::setLatencyBudget)
+    .function("getOperatingPoint", &ps::Recognizer::getOperatingPoint)
+    .function("getFrameSkipStats", &ps::Recognizer::getFrameSkipStats)
+    .function("transcribeBatch", &ps::Recognizer::transcribeBatch);
 }
 
+#endif /* __EMSCRIPTEN__ */
+
 #endif /* _PSRECOGNIZER_H_ */
@@ -0,0 +1,182 @@
+/**
+ * @file trace.cpp Recording of Recognizer calls, for offline replay
+ */
+
+#include <string.h>
+
+#include "trace.h"
+
+static const char *call_names[] = {
+    "?", "init", "addWords", "addGrammar", "addGrammarJsgf", "addGrammarBinary",
+    "addKeyword", "switchSearch", "start", "process", "stop", "wordAlign",
+    "pronFeatex", "setFeatureStore", "setContinuous", "setEventQueue", "reprocess",
+    "setSearches", "loadPronModel", "startJob", "runJob", "cancelJob", "addTransitions",
+    "removeTransitions", "removeWord", "addLanguageModel", "selectLanguageModel",
+    "interpolateLanguageModels", "setLatencyBudget", "importAdaptationState",
+    "transcribeBatch", "resetUtterance", "lookupWord"
+};
+
+const char *trace_call_name(int call) {
+    if ((call < 0) || (call >= (int) (sizeof(call_names) / sizeof(call_names[0]))))
+        return call_names[0];
+    return call_names[call];
+}
+
+static void put_u32(std::string& data, uint32_t value) {
+    char bytes[4] = {(char) value, (char) (value >> 8), (char) (value >> 16), (char) (value >> 24)};
+    data.append(bytes, 4);
+}
+
+static uint32_t get_u32(const char *bytes) {
+    const unsigned char *b = (const unsigned char *) bytes;
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+}
+
+TraceArgs& TraceArgs::i32(int32_t value) {
+    if (enabled) put_u32(data, value);
+    return *this;
+}
+
+TraceArgs& TraceArgs::f32(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    return i32((int32_t) bits);
+}
+
+TraceArgs& TraceArgs::str(const std::string& value) {
+    if (enabled) {
+        put_u32(data, value.size());
+        data.append(value);
+    }
+    return *this;
+}
+
+TraceArgs& TraceArgs::samples(const std::vector<int16_t>& audio) {
+    if (enabled) {
+        put_u32(data, audio.size());
+        data.reserve(data.size() + 2 * audio.size());
+        for (size_t i = 0; i < audio.size(); ++i) {
+            char bytes[2] = {(char) audio[i], (char) (audio[i] >> 8)};
+            data.append(bytes, 2);
+        }
+    }
+    return *this;
+}
+
+bool TraceArgsReader::i32(int32_t& value) {
+    if (data.size() - pos < 4) return false;
+    value = (int32_t) get_u32(data.data() + pos);
+    pos += 4;
+    return true;
+}
+
+bool TraceArgsReader::f32(float& value) {
+    int32_t bits;
+    if (!i32(bits)) return false;
+    memcpy(&value, &bits, 4);
+    return true;
+}
+
+bool TraceArgsReader::str(std::string& value) {
+    int32_t n;
+    if (!i32(n) || (n < 0) || (data.size() - pos < (size_t) n)) return false;
+    value.assign(data, pos, n);
+    pos += n;
+    return true;
+}
+
+bool TraceArgsReader::samples(std::vector<int16_t>& audio) {
+    int32_t n;
+    if (!i32(n) || (n < 0) || ((data.size() - pos) / 2 < (size_t) n)) return false;
+    const unsigned char *b = (const unsigned char *) data.data() + pos;
+    audio.resize(n);
+    for (int32_t i = 0; i < n; ++i)
+        audio[i] = (int16_t) (b[2 * i] | (b[2 * i + 1] << 8));
+    pos += 2 * n;
+    return true;
+}
+
+int TraceWriter::open(const char *path) {
+    close();
+    file = fopen(path, "wb");
+    if (file == NULL) return -1;
+    file_path = path;
+    std::string header("PSTR");
+    put_u32(header, TRACE_VERSION);
+    fwrite(header.data(), 1, header.size(), file);
+    return 0;
+}
+
+void TraceWriter::close() {
+    if (file) fclose(file);
+    file = NULL;
+}
+
+void TraceWriter::write(int call, const TraceArgs& args, int result, double ms, const std::string& output) {
+    if (file == NULL) return;
+    float duration = (float) ms;
+    uint32_t duration_bits;
+    memcpy(&duration_bits, &duration, 4);
+    std::string head(1, (char) call);
+    put_u32(head, args.bytes().size());
+    std::string tail;
+    put_u32(tail, result);
+    put_u32(tail, duration_bits);
+    put_u32(tail, output.size());
+    tail.append(output);
+    fwrite(head.data(), 1, head.size(), file);
+    fwrite(args.bytes().data(), 1, args.bytes().size(), file);
+    fwrite(tail.data(), 1, tail.size(), file);
+}
+
+void TraceWriter::flush() {
+    if (file) fflush(file);
+}
+
+int TraceReader::open(const char *path) {
+    close();
+    file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    char header[8];
+    if ((fread(header, 1, 8, file) != 8) || memcmp(header, "PSTR", 4)
+        || (get_u32(header + 4) != TRACE_VERSION)) {
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+void TraceReader::close() {
+    if (file) fclose(file);
+    file = NULL;
+}
+
+// Reads a string of the given size, without trusting the size
+// before the bytes are there
+static bool read_bytes(FILE *file, uint32_t n, std::string& out) {
+    char buf[4096];
+    out.clear();
+    while (n > 0) {
+        size_t chunk = n < sizeof(buf) ? n : sizeof(buf);
+        if (fread(buf, 1, chunk, file) != chunk) return false;
+        out.append(buf, chunk);
+        n -= chunk;
+    }
+    return true;
+}
+
+int TraceReader::next(TraceRecord& record) {
+    if (file == NULL) return -1;
+    int call = fgetc(file);
+    if (call == EOF) return 0;
+    char word[12];
+    float duration;
+    record.call = call;
+    if ((fread(word, 1, 4, file) != 4) || !read_bytes(file, get_u32(word), record.args)
+        || (fread(word, 1, 12, file) != 12)) return -1;
+    record.result = (int32_t) get_u32(word);
+    uint32_t duration_bits = get_u32(word + 4);
+    memcpy(&duration, &duration_bits, 4);
+    record.ms = duration;
+    return read_bytes(file, get_u32(word + 8), record.output) ? 1 : -1;
+}
@@ -0,0 +1,158 @@
+/**
+ * @file trace.h Recording of Recognizer calls, for offline replay
+ *
+ * A trace starts with "PSTR" and a version, as int32, followed by
+ * one record per call:
+ *
+ *   uint8 call, uint32 size of the arguments, the arguments,
+ *   int32 result, float32 duration in milliseconds, string output
+ *
+ * Arguments are written in the order of the call, int32 and
+ * float32 as is, strings and audio as an uint32 count followed by
+ * the bytes or the int16 samples. The output is what the call produced, such
+ * as the hypothesis, so that a replay can check it gets the same.
+ * Everything is little-endian.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "clock.h"
+
+#define TRACE_VERSION 1
+
+enum TraceCall {
+    TRACE_INIT = 1,
+    TRACE_ADD_WORDS,
+    TRACE_ADD_GRAMMAR,
+    TRACE_ADD_GRAMMAR_JSGF,
+    TRACE_ADD_GRAMMAR_BINARY,
+    TRACE_ADD_KEYWORD,
+    TRACE_SWITCH_SEARCH,
+    TRACE_START,
+    TRACE_PROCESS,
+    TRACE_STOP,
+    TRACE_WORD_ALIGN,
+    TRACE_PRON_FEATEX,
+    TRACE_SET_FEATURE_STORE,
+    TRACE_SET_CONTINUOUS,
+    TRACE_SET_EVENT_QUEUE,
+    TRACE_REPROCESS,
+    TRACE_SET_SEARCHES,
+    TRACE_LOAD_PRON_MODEL,
+    TRACE_START_JOB,
+    TRACE_RUN_JOB,
+    TRACE_CANCEL_JOB,
+    TRACE_ADD_TRANSITIONS,
+    TRACE_REMOVE_TRANSITIONS,
+    TRACE_REMOVE_WORD,
+    TRACE_ADD_LANGUAGE_MODEL,
+    TRACE_SELECT_LANGUAGE_MODEL,
+    TRACE_INTERPOLATE_LANGUAGE_MODELS,
+    TRACE_SET_LATENCY_BUDGET,
+    TRACE_IMPORT_ADAPTATION_STATE,
+    TRACE_TRANSCRIBE_BATCH,
+    TRACE_RESET_UTTERANCE,
+    TRACE_LOOKUP_WORD
+};
+
+/** Name of a call, for reports. */
+const char *trace_call_name(int call);
+
+/** Arguments of a call, ignored when the trace is off. */
+class TraceArgs {
+public:
+    explicit TraceArgs(bool enabled = true): enabled(enabled) {}
+    TraceArgs& i32(int32_t value);
+    TraceArgs& f32(float value);
+    TraceArgs& str(const std::string& value);
+    TraceArgs& samples(const std::vector<int16_t>& audio);
+    const std::string& bytes() const { return data; }
+private:
+    bool enabled;
+    std::string data;
+};
+
+/** Reads arguments back, in the order they were written. */
+class TraceArgsReader {
+public:
+    explicit TraceArgsReader(const std::string& bytes): data(bytes), pos(0) {}
+    bool i32(int32_t& value);
+    bool f32(float& value);
+    bool str(std::string& value);
+    bool samples(std::vector<int16_t>& audio);
+private:
+    const std::string& data;
+    size_t pos;
+};
+
+class TraceWriter {
+public:
+    TraceWriter(): file(NULL) {}
+    ~TraceWriter() { close(); }
+    /** Starts a new trace, returns -1 if the file cannot be written. */
+    int open(const char *path);
+    void close();
+    bool isOpen() const { return file != NULL; }
+    const std::string& path() const { return file_path; }
+    void write(int call, const TraceArgs& args, int result, double ms, const std::string& output);
+    /** Makes what was written so far readable. */
+    void flush();
+private:
+    TraceWriter(const TraceWriter&);
+    TraceWriter& operator=(const TraceWriter&);
+    FILE *file;
+    std::string file_path;
+};
+
+struct TraceRecord {
+    int call;
+    std::string args;
+    int result;
+    float ms;
+    std::string output;
+};
+
+class TraceReader {
+public:
+    TraceReader(): file(NULL) {}
+    ~TraceReader() { close(); }
+    /** Returns -1 if the file cannot be read or is not a trace. */
+    int open(const char *path);
+    void close();
+    /** Returns 1 with the next record, 0 at the end, -1 if truncated. */
+    int next(TraceRecord& record);
+private:
+    TraceReader(const TraceReader&);
+    TraceReader& operator=(const TraceReader&);
+    FILE *file;
+};
+
+/**
+ * One recorded call. The arguments are collected as the call
+ * starts, and the record is written by end(), with the time since
+ * the scope was created.
+ */
+class TraceScope {
+public:
+    TraceScope(TraceWriter& writer, int call)
+        : writer(writer), call(call), arguments(writer.isOpen()), start(writer.isOpen() ? clock_ms() : 0) {}
+    TraceArgs& args() { return arguments; }
+    template <typename R> R end(R result, const std::string& output = "") {
+        if (writer.isOpen())
+            writer.write(call, arguments, (int) result, clock_ms() - start, output);
+        return result;
+    }
+private:
+    TraceWriter& writer;
+    int call;
+    TraceArgs arguments;
+    double start;
+};
+
+#endif /* __TRACE_H__ */
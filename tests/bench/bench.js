@@ -0,0 +1,307 @@
+/***************************************
+*
+* Headless benchmark suite for pocketsphinx.js
+*
+* Decodes the test fixtures under each search type and reports
+* real-time factor, per-frame latency percentiles, heap usage and
+* startup time as JSON, then compares them with the stored
+* baseline. See tests/README.md for usage.
+*
+***************************************/
+
+var fs = require('fs');
+var path = require('path');
+var vm = require('vm');
+
+var SAMPLE_RATE = 16000;
+var FRAME_SHIFT = 160;
+var CHUNK_SIZE = 1024;
+var TRANSCRIPT = "WINDOWS SUCKS AND LINUX IS GREAT";
+var KEYPHRASE = "LINUX";
+// Hypotheses of scenarios that must match what is said in the fixtures
+var FIXTURE_HYPS = {fsg: TRANSCRIPT};
+// Largest difference of a pronFeatex feature from the reference,
+// relative to the reference value (absolute below 1)
+var PARITY_TOLERANCE = 0.05;
+var fixturesDir = path.join(__dirname, '..', 'js', 'fixtures');
+var baselineFile = path.join(__dirname, 'baseline.json');
+
+function parseArgs(argv) {
+    var opts = {module: path.join(__dirname, '..', '..', 'build', 'pocketsphinx.js'),
+		runs: 3, out: null, lm: null, dict: null, compare: null,
+		parity: null, exportFixtures: null, updateBaseline: false};
+    for (var i = 0 ; i < argv.length ; i++) {
+	switch(argv[i]) {
+	case '--module': opts.module = argv[++i]; break;
+	case '--runs': opts.runs = parseInt(argv[++i]); break;
+	case '--out': opts.out = argv[++i]; break;
+	case '--lm': opts.lm = argv[++i]; break;
+	case '--dict': opts.dict = argv[++i]; break;
+	case '--compare': opts.compare = argv[++i]; break;
+	case '--parity': opts.parity = argv[++i]; break;
+	case '--export-fixtures': opts.exportFixtures = argv[++i]; break;
+	case '--update-baseline': opts.updateBaseline = true; break;
+	default:
+	    console.error("Unknown option " + argv[i]);
+	    process.exit(2);
+	}
+    }
+    return opts;
+}
+
+function loadFixtures() {
+    vm.runInThisContext(fs.readFileSync(path.join(fixturesDir, 'audio.js'), 'utf8'));
+    vm.runInThisContext(fs.readFileSync(path.join(fixturesDir, 'grammars.js'), 'utf8'));
+}
+
+// Writes the fixtures in plain formats for the native benchmark
+function exportFixtures(dir) {
+    if (!fs.existsSync(dir)) fs.mkdirSync(dir);
+    var samples = new Int16Array(audio);
+    fs.writeFileSync(path.join(dir, 'audio.raw'), Buffer.from(samples.buffer));
+    fs.writeFileSync(path.join(dir, 'words.dict'),
+		     wordList.map(function(w) {return w[0] + " " + w[1];}).join("\n") + "\n");
+    var g = grammarOses;
+    var lines = [g.numStates + " " + g.start + " " + g.end];
+    g.transitions.forEach(function(t) {
+	lines.push(t.from + " " + t.to + " " + (t.logp || 0) + " " + (t.word || ""));
+    });
+    fs.writeFileSync(path.join(dir, 'oses.fsg'), lines.join("\n") + "\n");
+    fs.writeFileSync(path.join(dir, 'transcript.txt'), TRANSCRIPT + "\n");
+    fs.writeFileSync(path.join(dir, 'keyphrase.txt'), KEYPHRASE + "\n");
+}
+
+function percentile(values, p) {
+    if (values.length == 0) return null;
+    var sorted = values.slice().sort(function(a, b) {return a - b;});
+    return sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))];
+}
+
+function median(values) {
+    return percentile(values, 0.5);
+}
+
+// Top of the emscripten heap, the allocator never gives memory
+// back to sbrk so this is also the high-water mark
+function heapTop(Module) {
+    if (Module.HEAPU32 && Module.DYNAMICTOP_PTR)
+	return Module.HEAPU32[Module.DYNAMICTOP_PTR >> 2];
+    return null;
+}
+
+function makeScenarios(Module, opts) {
+    function addWords(recognizer) {
+	var words = new Module.VectorWords();
+	wordList.forEach(function(w) {words.push_back(w);});
+	recognizer.addWords(words);
+	words.delete();
+    }
+    function decode(recognizer, buffers, latencies) {
+	recognizer.start();
+	buffers.forEach(function(b) {
+	    var t = now();
+	    recognizer.process(b);
+	    latencies.push((now() - t) / Math.max(1, b.size() / FRAME_SHIFT));
+	});
+	recognizer.stop();
+	return recognizer.getHyp();
+    }
+    return [
+	{name: 'fsg',
+	 setup: function(recognizer) {
+	     addWords(recognizer);
+	     var transitions = new Module.VectorTransitions();
+	     grammarOses.transitions.forEach(function(t) {
+		 transitions.push_back({from: t.from, to: t.to, logp: t.logp || 0, word: t.word || ""});
+	     });
+	     var ids = new Module.Integers();
+	     recognizer.addGrammar(ids, {numStates: grammarOses.numStates, start: grammarOses.start,
+					 end: grammarOses.end, transitions: transitions});
+	     transitions.delete();
+	     ids.delete();
+	 },
+	 run: decode},
+	{name: 'kws',
+	 setup: function(recognizer) {
+	     addWords(recognizer);
+	     var ids = new Module.Integers();
+	     recognizer.addKeyword(ids, KEYPHRASE);
+	     ids.delete();
+	 },
+	 run: decode},
+	{name: 'ngram',
+	 config: opts.lm ? [["-lm", opts.lm]].concat(opts.dict ? [["-dict", opts.dict]] : []) : null,
+	 setup: function(recognizer) {if (!opts.dict) addWords(recognizer);},
+	 run: decode},
+	{name: 'align',
+	 setup: addWords,
+	 run: function(recognizer, buffers, latencies, whole) {
+	     var t = now();
+	     recognizer.wordAlign(whole, TRANSCRIPT);
+	     latencies.push((now() - t) / (whole.size() / FRAME_SHIFT));
+	     return TRANSCRIPT;
+	 }},
+	{name: 'featex',
+	 setup: addWords,
+	 run: function(recognizer, buffers, latencies, whole) {
+	     var feats = new Module.Feats();
+	     var t = now();
+	     recognizer.pronFeatex(whole, TRANSCRIPT, feats);
+	     latencies.push((now() - t) / (whole.size() / FRAME_SHIFT));
+	     var n = feats.size();
+	     this.features = [];
+	     for (var i = 0 ; i < n ; i++) this.features.push(feats.get(i));
+	     feats.delete();
+	     return n + " features";
+	 }}
+    ];
+}
+
+function now() {
+    var t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+}
+
+function runBenchmarks(Module, opts, moduleLoadMs) {
+    var whole = new Module.AudioBuffer();
+    audio.forEach(function(s) {whole.push_back(s);});
+    var buffers = [];
+    for (var i = 0 ; i < audio.length ; i += CHUNK_SIZE) {
+	var b = new Module.AudioBuffer();
+	audio.slice(i, i + CHUNK_SIZE).forEach(function(s) {b.push_back(s);});
+	buffers.push(b);
+    }
+    var audioSeconds = audio.length / SAMPLE_RATE;
+    var report = {engine: 'node', date: new Date().toISOString(), runs: opts.runs,
+		  audioSeconds: audioSeconds, moduleLoadMs: moduleLoadMs, scenarios: {}};
+    makeScenarios(Module, opts).forEach(function(scenario) {
+	if (scenario.config === null) {
+	    report.scenarios[scenario.name] = {skipped: "needs --lm"};
+	    return;
+	}
+	var rtfs = [], startups = [], latencies = [], hyp = null;
+	for (var run = 0 ; run < opts.runs ; run++) {
+	    var config = new Module.Config();
+	    (scenario.config || []).forEach(function(c) {config.push_back(c);});
+	    var t = now();
+	    var recognizer = new Module.Recognizer(config);
+	    scenario.setup(recognizer);
+	    startups.push(now() - t);
+	    config.delete();
+	    t = now();
+	    hyp = scenario.run(recognizer, buffers, latencies, whole);
+	    rtfs.push((now() - t) / 1000 / audioSeconds);
+	    recognizer.delete();
+	}
+	report.scenarios[scenario.name] = {
+	    rtf: median(rtfs),
+	    frameLatencyMs: {p50: percentile(latencies, 0.5),
+			     p90: percentile(latencies, 0.9),
+			     p99: percentile(latencies, 0.99)},
+	    peakHeapBytes: heapTop(Module),
+	    startupMs: median(startups),
+	    hyp: hyp
+	};
+	if (scenario.features) report.scenarios[scenario.name].features = scenario.features;
+    });
+    buffers.forEach(function(b) {b.delete();});
+    whole.delete();
+    return report;
+}
+
+// Returns the list of regressions of report against the baseline
+// stored for the same engine
+function compare(report, baseline) {
+    var regressions = [];
+    var reference = baseline[report.engine];
+    if (!reference) return regressions;
+    var limits = baseline.thresholds;
+    Object.keys(reference.scenarios).forEach(function(name) {
+	var ref = reference.scenarios[name], cur = report.scenarios[name];
+	if (!cur || ref.skipped || cur.skipped) return;
+	var metrics = {rtf: [cur.rtf, ref.rtf],
+		       frameLatencyP90: [cur.frameLatencyMs.p90, ref.frameLatencyMs.p90],
+		       peakHeapBytes: [cur.peakHeapBytes, ref.peakHeapBytes],
+		       startupMs: [cur.startupMs, ref.startupMs]};
+	Object.keys(metrics).forEach(function(m) {
+	    var c = metrics[m][0], r = metrics[m][1];
+	    if (c === null || r === null || r === undefined || !limits[m]) return;
+	    if (c > r * limits[m])
+		regressions.push(name + ": " + m + " " + c.toFixed(4) + " exceeds baseline " +
+				 r.toFixed(4) + " x " + limits[m]);
+	});
+	if (ref.hyp !== cur.hyp)
+	    regressions.push(name + ": hypothesis changed from \"" + ref.hyp + "\" to \"" + cur.hyp + "\"");
+    });
+    return regressions;
+}
+
+// Returns the differences in results between report and a reference
+// report, typically from a build with full precision models: the
+// hypotheses must be the same (unless sameHyps is false, when
+// compare() already checks them) and the features close. Hypotheses
+// are also checked against the fixtures, with or without reference.
+function parity(report, reference, sameHyps) {
+    var differences = [];
+    Object.keys(FIXTURE_HYPS).forEach(function(name) {
+	var cur = report.scenarios[name];
+	if (cur && !cur.skipped && (cur.hyp !== FIXTURE_HYPS[name]))
+	    differences.push(name + ": hypothesis \"" + cur.hyp + "\" differs from fixture \"" + FIXTURE_HYPS[name] + "\"");
+    });
+    if (!reference) return differences;
+    Object.keys(reference.scenarios).forEach(function(name) {
+	var ref = reference.scenarios[name], cur = report.scenarios[name];
+	if (!cur || ref.skipped || cur.skipped) return;
+	if (sameHyps && (ref.hyp !== cur.hyp))
+	    differences.push(name + ": hypothesis \"" + cur.hyp + "\" differs from reference \"" + ref.hyp + "\"");
+	if (!ref.features || !cur.features) return;
+	ref.features.forEach(function(r, i) {
+	    var c = cur.features[i];
+	    if (Math.abs(c - r) > PARITY_TOLERANCE * Math.max(1, Math.abs(r)))
+		differences.push(name + ": feature " + i + " is " + c + ", reference " + r);
+	});
+    });
+    return differences;
+}
+
+function finish(report, opts) {
+    var json = JSON.stringify(report, null, 2);
+    if (opts.out) fs.writeFileSync(opts.out, json + "\n");
+    else console.log(json);
+    var baseline = JSON.parse(fs.readFileSync(baselineFile, 'utf8'));
+    if (opts.updateBaseline) {
+	baseline[report.engine] = report;
+	fs.writeFileSync(baselineFile, JSON.stringify(baseline, null, 2) + "\n");
+	return 0;
+    }
+    // Without --parity, results are checked against the baseline,
+    // which must have been stored for the engine
+    if (!opts.parity && !baseline[report.engine]) {
+	console.error("No " + report.engine + " baseline in " + baselineFile +
+		      ", store one with --update-baseline");
+	return 1;
+    }
+    var reference = opts.parity ? JSON.parse(fs.readFileSync(opts.parity, 'utf8')) : baseline[report.engine];
+    var regressions = compare(report, baseline).concat(parity(report, reference, !!opts.parity));
+    regressions.forEach(function(r) {console.error("REGRESSION " + r);});
+    return regressions.length > 0 ? 1 : 0;
+}
+
+var opts = parseArgs(process.argv.slice(2));
+loadFixtures();
+if (opts.exportFixtures) {
+    exportFixtures(opts.exportFixtures);
+} else if (opts.compare) {
+    process.exitCode = finish(JSON.parse(fs.readFileSync(opts.compare, 'utf8')), opts);
+} else {
+    var loadStart = now();
+    global.Module = {
+	print: function() {},
+	printErr: function() {},
+	onRuntimeInitialized: function() {
+	    var report = runBenchmarks(Module, opts, now() - loadStart);
+	    process.exitCode = finish(report, opts);
+	}
+    };
+    require(path.resolve(opts.module));
+}
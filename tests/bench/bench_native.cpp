@@ -0,0 +1,214 @@
+/**
+ * @file bench_native.cpp Native benchmark driver for the Recognizer
+ *
+ * Runs the same scenarios as bench.js on fixtures exported with
+ * `node bench.js --export-fixtures DIR` and prints the report as
+ * JSON, which `node bench.js --compare` checks against the baseline.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <fstream>
+#include "psRecognizer.h"
+
+namespace ps = pocketsphinxjs;
+
+static const int SAMPLE_RATE = 16000;
+static const int FRAME_SHIFT = 160;
+static const size_t CHUNK_SIZE = 1024;
+
+struct Fixtures {
+  std::vector<int16_t> audio;
+  std::vector<ps::Word> words;
+  ps::Grammar grammar;
+  std::string transcript;
+  std::string keyphrase;
+};
+
+struct Options {
+  std::string fixtures;
+  std::string lm;
+  std::string dict;
+  std::string out;
+  int runs;
+};
+
+struct Result {
+  bool skipped;
+  double rtf;
+  std::vector<double> latencies;
+  double startupMs;
+  long peakHeapBytes;
+  std::string hyp;
+};
+
+static double nowMs() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// Heap in use from the memory report of the recognizer, whose peak
+// only covers the scenario, unlike the peak resident size of the
+// process. It is sampled after each call.
+static void sampleHeap(ps::Recognizer& r, long& peak) {
+  ps::MemoryReport report;
+  r.getMemoryReport(report);
+  for (size_t i = 0; i < report.size(); ++i)
+    if (report[i].component == "heap in use") peak = std::max(peak, (long) report[i].peakBytes);
+}
+
+static std::string readLine(const std::string& file) {
+  std::ifstream in(file.c_str());
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+
+static bool loadFixtures(const std::string& dir, Fixtures& f) {
+  std::ifstream raw((dir + "/audio.raw").c_str(), std::ios::binary);
+  if (!raw) return false;
+  int16_t sample;
+  while (raw.read((char*) &sample, sizeof(sample))) f.audio.push_back(sample);
+
+  std::ifstream dict((dir + "/words.dict").c_str());
+  std::string line;
+  while (std::getline(dict, line)) {
+    std::string::size_type sep = line.find(' ');
+    if (sep == std::string::npos) continue;
+    ps::Word w;
+    w.word = line.substr(0, sep);
+    w.pronunciation = line.substr(sep + 1);
+    f.words.push_back(w);
+  }
+
+  std::ifstream fsg((dir + "/oses.fsg").c_str());
+  fsg >> f.grammar.numStates >> f.grammar.start >> f.grammar.end;
+  std::getline(fsg, line);
+  while (std::getline(fsg, line)) {
+    std::istringstream fields(line);
+    ps::Transition t;
+    t.word = "";
+    if (fields >> t.from >> t.to >> t.logp) {
+      fields >> t.word;
+      f.grammar.transitions.push_back(t);
+    }
+  }
+  f.transcript = readLine(dir + "/transcript.txt");
+  f.keyphrase = readLine(dir + "/keyphrase.txt");
+  return f.audio.size() > 0;
+}
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.size() == 0) return 0;
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, (size_t) (p * values.size()))];
+}
+
+static std::string decode(ps::Recognizer& r, const Fixtures& f, std::vector<double>& latencies, long& peak) {
+  r.start();
+  for (size_t i = 0; i < f.audio.size(); i += CHUNK_SIZE) {
+    std::vector<int16_t> chunk(f.audio.begin() + i, f.audio.begin() + std::min(i + CHUNK_SIZE, f.audio.size()));
+    double t = nowMs();
+    r.process(chunk);
+    latencies.push_back((nowMs() - t) / std::max(1.0, (double) chunk.size() / FRAME_SHIFT));
+    sampleHeap(r, peak);
+  }
+  r.stop();
+  return r.getHyp();
+}
+
+static Result runScenario(const std::string& name, const Fixtures& f, const Options& opts) {
+  Result res;
+  res.peakHeapBytes = 0;
+  res.skipped = (name == "ngram") && (opts.lm.size() == 0);
+  if (res.skipped) return res;
+  std::vector<double> rtfs, startups;
+  double seconds = (double) f.audio.size() / SAMPLE_RATE;
+  for (int run = 0; run < opts.runs; ++run) {
+    ps::Config config;
+    if (name == "ngram") {
+      ps::ConfigItem lm = {"-lm", opts.lm};
+      config.push_back(lm);
+      if (opts.dict.size()) {
+	ps::ConfigItem dict = {"-dict", opts.dict};
+	config.push_back(dict);
+      }
+    }
+    double t = nowMs();
+    ps::Recognizer r(config);
+    if ((name != "ngram") || (opts.dict.size() == 0)) r.addWords(f.words);
+    ps::Integers ids;
+    if (name == "fsg") r.addGrammar(ids, f.grammar);
+    if (name == "kws") r.addKeyword(ids, f.keyphrase);
+    startups.push_back(nowMs() - t);
+    sampleHeap(r, res.peakHeapBytes);
+
+    t = nowMs();
+    if (name == "align") {
+      r.wordAlign(f.audio, f.transcript);
+      res.latencies.push_back((nowMs() - t) / ((double) f.audio.size() / FRAME_SHIFT));
+      res.hyp = f.transcript;
+    } else if (name == "featex") {
+      ps::Feats feats;
+      r.pronFeatex(f.audio, f.transcript, feats);
+      res.latencies.push_back((nowMs() - t) / ((double) f.audio.size() / FRAME_SHIFT));
+      std::ostringstream n;
+      n << feats.size() << " features";
+      res.hyp = n.str();
+    } else {
+      res.hyp = decode(r, f, res.latencies, res.peakHeapBytes);
+    }
+    rtfs.push_back((nowMs() - t) / 1000 / seconds);
+    sampleHeap(r, res.peakHeapBytes);
+  }
+  res.rtf = percentile(rtfs, 0.5);
+  res.startupMs = percentile(startups, 0.5);
+  return res;
+}
+
+int main(int argc, char *argv[]) {
+  Options opts;
+  opts.runs = 3;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--fixtures") opts.fixtures = argv[i + 1];
+    else if (arg == "--lm") opts.lm = argv[i + 1];
+    else if (arg == "--dict") opts.dict = argv[i + 1];
+    else if (arg == "--runs") opts.runs = atoi(argv[i + 1]);
+    else if (arg == "--out") opts.out = argv[i + 1];
+    else {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  Fixtures f;
+  if ((opts.fixtures.size() == 0) || !loadFixtures(opts.fixtures, f)) {
+    fprintf(stderr, "Usage: %s --fixtures DIR [--out FILE] [--runs N] [--lm LM [--dict DICT]]\n", argv[0]);
+    return 2;
+  }
+  // The decoder prints its own traces on stdout, so the
+  // report is best written to a file
+  FILE *out = opts.out.size() ? fopen(opts.out.c_str(), "w") : stdout;
+  if (out == NULL) return 2;
+
+  const char *names[] = {"fsg", "kws", "ngram", "align", "featex"};
+  fprintf(out, "{\n  \"engine\": \"native\",\n  \"runs\": %d,\n  \"audioSeconds\": %f,\n  \"scenarios\": {",
+	 opts.runs, (double) f.audio.size() / SAMPLE_RATE);
+  for (int i = 0; i < 5; ++i) {
+    Result r = runScenario(names[i], f, opts);
+    fprintf(out, "%s\n    \"%s\": ", (i > 0) ? "," : "", names[i]);
+    if (r.skipped) {
+      fprintf(out, "{\"skipped\": \"needs --lm\"}");
+      continue;
+    }
+    fprintf(out, "{\"rtf\": %f, \"frameLatencyMs\": {\"p50\": %f, \"p90\": %f, \"p99\": %f}, "
+	   "\"peakHeapBytes\": %ld, \"startupMs\": %f, \"hyp\": \"%s\"}",
+	   r.rtf, percentile(r.latencies, 0.5), percentile(r.latencies, 0.9),
+	   percentile(r.latencies, 0.99), r.peakHeapBytes, r.startupMs, r.hyp.c_str());
+  }
+  fprintf(out, "\n  }\n}\n");
+  if (out != stdout) fclose(out);
+  return 0;
+}
@@ -59,3 +59,22 @@ var grammarOses = {numStates: 7, start: 0, end: 6,
 				 {from: 5, to: 3, word: "S", logp: 0},
 				 {from: 3, to: 1, word: "X", logp: 0},
 				 {from: 6, to: 0, word: "AND", logp: 0}]};
+
+// The same grammar in JSGF
+var jsgfOses = "#JSGF V1.0;\ngrammar oses;\n" +
+    "<os> = WINDOWS | LINUX | MAC O S X;\n" +
+    "<opinion> = <os> (IS NOT* (GOOD | GREAT) | ROCKS | SUCKS);\n" +
+    "public <oses> = <opinion> (AND <opinion>)*;\n";
+
+// Unigram language models in ARPA format, to be written
+// to the virtual file system
+function unigramLm(words) {
+    var lm = "\\data\\\nngram 1=" + (words.length + 2) + "\n\n\\1-grams:\n";
+    lm += "-1.0 <s>\n-1.0 </s>\n";
+    for (var i = 0 ; i < words.length ; i++)
+	lm += (-Math.log(words.length) / Math.LN10).toFixed(4) + " " + words[i] + "\n";
+    return lm + "\n\\end\\\n";
+}
+
+var lmOses = unigramLm(["WINDOWS", "LINUX", "MAC", "IS", "NOT", "GOOD", "GREAT", "ROCKS", "SUCKS", "AND"]);
+var lmDigits = unigramLm(["ONE", "TWO", "THREE", "FOUR", "FIVE", "SIX", "SEVEN", "EIGHT", "NINE", "ZERO"]);
@@ -682,3 +682,665 @@ QUnit.test( "Recognizing multiple utterances", function(assert) {
     assert.equal(segmentation.get(0).start, 0, "Value stored in Segmentation should be the correct one for the second utterance");
     assert.equal(segmentation.get(0).end, 13, "Value stored in Segmentation should be the correct one for the second utterance");
 });
+
+QUnit.test( "N-best, lattice and confidences", function(assert) {
+
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+
+    recognizer.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    recognizer.addGrammar(ids, {numStates: grammarOses.numStates,
+				start: grammarOses.start, end: grammarOses.end,
+				transitions: transitions});
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+
+    var nbest = new Module.Nbest();
+    var lattice = new Module.Lattice();
+    var confidences = new Module.Feats();
+    recognizer.start();
+    assert.equal(recognizer.getNbest(nbest, 3), Module.ReturnType.BAD_STATE, "N-best should not be available while recording");
+    assert.equal(recognizer.process(buffer), Module.ReturnType.SUCCESS, "Recognizer should process successfully");
+    assert.equal(recognizer.stop(), Module.ReturnType.SUCCESS, "Recognizer should stop successfully");
+    assert.equal(recognizer.getNbest(nbest, 0), Module.ReturnType.BAD_ARGUMENT, "N-best should reject an empty request");
+    assert.equal(recognizer.getNbest(nbest, 3), Module.ReturnType.SUCCESS, "N-best should be computed successfully");
+    assert.ok(nbest.size() > 0 && nbest.size() <= 3, "N-best should hold at most the requested number of hypotheses");
+    assert.equal(recognizer.getLattice(lattice), Module.ReturnType.SUCCESS, "Lattice should be computed successfully");
+    assert.ok(lattice.numNodes() > 0, "Lattice should have nodes");
+    assert.equal(lattice.nodes().length, 4 * lattice.numNodes(), "Nodes should be packed by four");
+    assert.equal(lattice.edges().length, 4 * lattice.numEdges(), "Edges should be packed by four");
+    assert.equal(lattice.posteriors().length, lattice.numEdges(), "There should be one posterior per edge");
+    assert.equal(recognizer.getConfidences(confidences), Module.ReturnType.SUCCESS, "Confidences should be computed successfully");
+    assert.equal(recognizer.getHypseg(segmentation), Module.ReturnType.SUCCESS);
+    assert.equal(confidences.size(), segmentation.size(), "There should be one confidence per segment");
+    for (var i = 0 ; i < confidences.size() ; i++)
+	assert.ok(confidences.get(i) >= 0 && confidences.get(i) <= 1, "Confidences should be probabilities");
+    nbest.delete();
+    lattice.delete();
+    confidences.delete();
+});
+
+QUnit.test( "Memory report and utterance reset", function(assert) {
+    var report = new Module.MemoryReport();
+    var components = function() {
+	var c = {};
+	for (var i = 0 ; i < report.size() ; i++) c[report.get(i).component] = report.get(i);
+	return c;
+    };
+    words.push_back(["A", "AH"]);
+    recognizer.addWords(words);
+    transitions.push_back({from: 0, to: 0, logp: 0, word: "A"});
+    recognizer.addGrammar(ids, {numStates: 1, start: 0, end: 0, transitions: transitions});
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    recognizer.start();
+    recognizer.process(buffer);
+    assert.equal(recognizer.resetUtterance(), Module.ReturnType.BAD_STATE, "Utterance should not be reset while recording");
+    recognizer.stop();
+    assert.equal(recognizer.getMemoryReport(report), Module.ReturnType.SUCCESS, "Memory report should be computed successfully");
+    var c = components();
+    assert.ok(c["acoustic model"].bytes > 0, "Acoustic model should use memory");
+    assert.ok(c["dictionary"].bytes > 0, "Dictionary should use memory");
+    assert.ok(c["search " + ids.get(0)] != undefined, "Grammar should be accounted for");
+    assert.ok(c["heap in use"].peakBytes >= c["heap in use"].bytes, "Peak should not be below current usage");
+    assert.equal(recognizer.resetUtterance(), Module.ReturnType.SUCCESS, "Utterance should be reset successfully");
+    recognizer.getMemoryReport(report);
+    c = components();
+    assert.ok(c["utterance"].bytes < c["utterance"].peakBytes, "Utterance memory should be released");
+    assert.equal(recognizer.getWordAlignSeg(segmentation), Module.ReturnType.BAD_STATE, "There should be no alignment after a reset");
+    // The heap should not grow from one reset utterance to the next
+    var heap = [];
+    for (var run = 0 ; run < 3 ; run++) {
+	recognizer.start();
+	recognizer.process(buffer);
+	recognizer.stop();
+	recognizer.resetUtterance();
+	recognizer.getMemoryReport(report);
+	heap.push(components()["heap in use"].bytes);
+    }
+    assert.ok(heap[2] - heap[0] < c["utterance"].peakBytes / 4, "Heap should not grow across utterances");
+    report.delete();
+});
+
+QUnit.test( "Batch transcription", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    recognizer.addGrammar(ids, {numStates: grammarOses.numStates,
+				start: grammarOses.start, end: grammarOses.end,
+				transitions: transitions});
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var clips = new Module.AudioBuffers();
+    var results = new Module.BatchResults();
+    for (var i = 0 ; i < 3 ; i++) clips.push_back(buffer);
+    assert.equal(recognizer.transcribeBatch(clips, ids.get(0), 0, results), Module.ReturnType.BAD_ARGUMENT, "Batch should need at least one worker");
+    assert.equal(recognizer.transcribeBatch(clips, ids.get(0), 2, results), Module.ReturnType.SUCCESS, "Batch should be transcribed successfully");
+    assert.equal(results.size(), 3, "There should be one result per clip");
+    for (var i = 0 ; i < results.size() ; i++) {
+	assert.equal(results.get(i).hyp, "WINDOWS SUCKS AND LINUX IS GREAT", "Each clip should be recognized correctly");
+	assert.ok(results.get(i).chunks >= 1, "Each clip should be decoded in at least one chunk");
+    }
+    recognizer.start();
+    recognizer.process(buffer);
+    assert.equal(recognizer.transcribeBatch(clips, ids.get(0), 2, results), Module.ReturnType.BAD_STATE, "Batch should not run while recording");
+    recognizer.stop();
+    // Without memory for more decoders, the recognizer's does it all
+    var config = new Module.Config();
+    config.push_back(["-batch_mem", "0"]);
+    var x = new Module.Recognizer(config);
+    config.delete();
+    x.addWords(words);
+    x.addGrammar(ids, {numStates: grammarOses.numStates,
+		       start: grammarOses.start, end: grammarOses.end,
+		       transitions: transitions});
+    assert.equal(x.transcribeBatch(clips, ids.get(0), 4, results), Module.ReturnType.SUCCESS, "Batch should fall back to one decoder");
+    assert.equal(results.size(), 3, "There should be one result per clip");
+    var report = new Module.MemoryReport();
+    x.getMemoryReport(report);
+    for (var i = 0 ; i < report.size() ; i++)
+	if (report.get(i).component == "batch decoders")
+	    assert.equal(report.get(i).bytes, 0, "No decoder should be loaded beyond the budget");
+    report.delete();
+    x.delete();
+    clips.delete();
+    results.delete();
+});
+
+QUnit.test( "Language model set", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    Module.FS_createDataFile("/", "oses.lm", lmOses, true, true);
+    Module.FS_createDataFile("/", "digits.lm", lmDigits, true, true);
+    assert.equal(recognizer.selectLanguageModel("oses"), Module.ReturnType.BAD_ARGUMENT, "There should be no model before one is added");
+    assert.equal(recognizer.addLanguageModel(ids, "oses", "/missing.lm"), Module.ReturnType.RUNTIME_ERROR, "A missing file should not be added");
+    assert.equal(recognizer.addLanguageModel(ids, "oses", "/oses.lm"), Module.ReturnType.SUCCESS, "A model should be added successfully");
+    var id = ids.get(0);
+    assert.equal(recognizer.addLanguageModel(ids, "digits", "/digits.lm"), Module.ReturnType.SUCCESS, "A second model should be added successfully");
+    assert.equal(ids.get(0), id, "Models of the set should share one search");
+    assert.equal(recognizer.addLanguageModel(ids, "digits", "/digits.lm"), Module.ReturnType.BAD_ARGUMENT, "Names should be unique");
+    assert.equal(recognizer.switchSearch(id), Module.ReturnType.SUCCESS, "The search of the set should be usable");
+    assert.equal(recognizer.selectLanguageModel("oses"), Module.ReturnType.SUCCESS, "A model should be selected by name");
+    assert.equal(recognizer.selectLanguageModel("cities"), Module.ReturnType.BAD_ARGUMENT, "Unknown models cannot be selected");
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    recognizer.start();
+    assert.equal(recognizer.selectLanguageModel("digits"), Module.ReturnType.BAD_STATE, "Models should not be switched while recording");
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.ok(recognizer.getHyp().indexOf("LINUX") >= 0, "We should get an hyp from the selected model");
+    var names = new Module.StringList();
+    var weights = new Module.Feats();
+    names.push_back("oses");
+    weights.push_back(3);
+    assert.equal(recognizer.interpolateLanguageModels(names, weights), Module.ReturnType.BAD_ARGUMENT, "All models should be weighted");
+    names.push_back("digits");
+    weights.push_back(1);
+    assert.equal(recognizer.interpolateLanguageModels(names, weights), Module.ReturnType.SUCCESS, "Models should be interpolated successfully");
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.ok(recognizer.getHyp().indexOf("LINUX") >= 0, "We should get an hyp with interpolated models");
+    names.delete();
+    weights.delete();
+});
+
+QUnit.test( "Editing grammars", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    recognizer.addGrammar(ids, {numStates: grammarOses.numStates,
+				start: grammarOses.start, end: grammarOses.end,
+				transitions: transitions});
+    var id = ids.get(0);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var edits = new Module.VectorTransitions();
+    edits.push_back({from: 0, to: 1, logp: 0, word: "UNKNOWNWORD"});
+    assert.equal(recognizer.addTransitions(id, edits), Module.ReturnType.BAD_ARGUMENT, "Words should be in the dictionary");
+    edits.delete();
+    edits = new Module.VectorTransitions();
+    edits.push_back({from: 0, to: grammarOses.numStates, logp: 0, word: "LINUX"});
+    assert.equal(recognizer.addTransitions(id, edits), Module.ReturnType.BAD_ARGUMENT, "States should be in the grammar");
+    assert.equal(recognizer.removeWord(id + 1, "LINUX"), Module.ReturnType.BAD_ARGUMENT, "The grammar should exist");
+    assert.equal(recognizer.removeWord(id, "LINUX"), Module.ReturnType.SUCCESS, "A word should be removed successfully");
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.ok(recognizer.getHyp().indexOf("LINUX") < 0, "A removed word should not be recognized");
+    edits.delete();
+    edits = new Module.VectorTransitions();
+    edits.push_back({from: 0, to: 1, logp: 0, word: "LINUX"});
+    assert.equal(recognizer.addTransitions(id, edits), Module.ReturnType.SUCCESS, "Transitions should be added successfully");
+    assert.equal(recognizer.switchSearch(id), Module.ReturnType.SUCCESS);
+    recognizer.start();
+    assert.equal(recognizer.removeTransitions(id, edits), Module.ReturnType.BAD_STATE, "Grammars should not be edited while recording");
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.equal(recognizer.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "A restored word should be recognized again");
+    assert.equal(recognizer.removeTransitions(id, edits), Module.ReturnType.SUCCESS, "Transitions should be removed successfully");
+    edits.delete();
+    // Removed transitions should not be kept by the rebuilt search
+    var report = new Module.MemoryReport();
+    var searchBytes = function() {
+	recognizer.getMemoryReport(report);
+	for (var i = 0 ; i < report.size() ; i++)
+	    if (report.get(i).component == "search " + id) return report.get(i).bytes;
+	return -1;
+    };
+    assert.equal(recognizer.switchSearch(id), Module.ReturnType.SUCCESS);
+    var before = searchBytes();
+    for (var run = 0 ; run < 5 ; run++) {
+	edits = new Module.VectorTransitions();
+	edits.push_back({from: run, to: run + 1, logp: 0, word: "IS"});
+	recognizer.addTransitions(id, edits);
+	assert.equal(recognizer.switchSearch(id), Module.ReturnType.SUCCESS, "Edited grammar should be rebuilt successfully");
+	recognizer.removeTransitions(id, edits);
+	assert.equal(recognizer.switchSearch(id), Module.ReturnType.SUCCESS, "Edited grammar should be rebuilt successfully");
+	edits.delete();
+    }
+    assert.ok(searchBytes() <= before, "Grammar should not grow with edits");
+    report.delete();
+});
+
+QUnit.test( "Compact grammars", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    assert.equal(recognizer.addGrammarJsgf(ids, "#JSGF V1.0;\ngrammar bad;\npublic <bad> = (ONE"), Module.ReturnType.RUNTIME_ERROR, "Malformed JSGF should be rejected");
+    assert.equal(recognizer.addGrammarJsgf(ids, jsgfOses), Module.ReturnType.SUCCESS, "JSGF grammar should be added successfully");
+    var jsgfId = ids.get(0);
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.equal(recognizer.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "JSGF grammar should recognize the correct utterance");
+    var packed = packGrammar(grammarOses);
+    assert.equal(recognizer.addGrammarBinary(ids, packed.subarray(0, packed.length - 4)), Module.ReturnType.BAD_ARGUMENT, "Truncated blob should be rejected");
+    assert.equal(recognizer.addGrammarBinary(ids, packed), Module.ReturnType.SUCCESS, "Packed grammar should be added successfully");
+    assert.notEqual(ids.get(0), jsgfId, "Each grammar should have its own id");
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.equal(recognizer.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "Packed grammar should recognize the correct utterance");
+    assert.equal(recognizer.removeWord(jsgfId, "LINUX"), Module.ReturnType.SUCCESS, "JSGF grammar should be editable");
+    assert.equal(recognizer.switchSearch(jsgfId), Module.ReturnType.SUCCESS);
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.ok(recognizer.getHyp().indexOf("LINUX") < 0, "A removed word should not be recognized");
+});
+
+QUnit.test( "Lazy dictionary", function(assert) {
+    var dict = "";
+    for (var i = 0; i < wordList.length; i++) dict += wordList[i][0] + " " + wordList[i][1] + "\n";
+    Module.FS_createDataFile("/", "lazy.dict", dict, true, true);
+    var config = new Module.Config();
+    config.push_back(["-lazy_dict", "/missing.dict"]);
+    var x = new Module.Recognizer(config);
+    assert.equal(x.lookupWord("LINUX"), "", "A missing dictionary should fail initialization");
+    x.delete();
+    config.delete();
+    config = new Module.Config();
+    config.push_back(["-lazy_dict", "/lazy.dict"]);
+    x = new Module.Recognizer(config);
+    config.delete();
+    var report = new Module.MemoryReport();
+    var dictionaryBytes = function() {
+	x.getMemoryReport(report);
+	for (var i = 0 ; i < report.size() ; i++)
+	    if (report.get(i).component == "dictionary") return report.get(i).bytes;
+	return -1;
+    };
+    var initial = dictionaryBytes();
+    assert.equal(x.lookupWord("PARIS"), "P AE R IH S", "Words should be read from the file when used");
+    assert.equal(x.lookupWord("PARIS(2)"), "P EH R IH S", "Alternate pronunciations should be read too");
+    assert.equal(x.lookupWord("UNKNOWNWORD"), "", "Unknown words should not be found");
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    assert.equal(x.addGrammar(ids, {numStates: grammarOses.numStates,
+				     start: grammarOses.start, end: grammarOses.end,
+				     transitions: transitions}), Module.ReturnType.SUCCESS, "Grammar should be added successfully");
+    assert.ok(dictionaryBytes() > initial, "The dictionary should grow with the words used");
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    x.start();
+    x.process(buffer);
+    x.stop();
+    assert.equal(x.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "Recognizer should recognize the correct utterance");
+    assert.equal(x.lookupWord("SHANGHAI"), "SH AE NG HH AY", "Words outside the grammar should still be found");
+    report.delete();
+    x.delete();
+});
+
+QUnit.test( "Word events", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    recognizer.addGrammar(ids, {numStates: grammarOses.numStates,
+				start: grammarOses.start, end: grammarOses.end,
+				transitions: transitions});
+    var events = new Module.Events();
+    var chunk = 1600, words_seen = [], ends = 0, last_end = -1;
+    assert.equal(recognizer.setEventQueue(64), Module.ReturnType.SUCCESS, "Event queue should be set successfully");
+    for (var i = 0 ; i < chunk ; i++) buffer.push_back(0);
+    recognizer.start();
+    for (var start = 0 ; start + chunk <= audio.length ; start += chunk) {
+	for (var i = 0 ; i < chunk ; i++) buffer.set(i, audio[start + i]);
+	recognizer.process(buffer);
+	recognizer.getEvents(events);
+	for (var i = 0 ; i < events.size() ; i++) words_seen.push(events.get(i).text);
+    }
+    assert.ok(words_seen.length > 0, "Some words should be final before the end");
+    recognizer.stop();
+    recognizer.getEvents(events);
+    for (var i = 0 ; i < events.size() ; i++) {
+	var e = events.get(i);
+	if (e.type == Module.EventType.WORD_FINAL) words_seen.push(e.text);
+	else ends++;
+	assert.ok(e.end >= last_end, "Events should be in order");
+	last_end = e.end;
+    }
+    assert.equal(ends, 1, "There should be one end of utterance");
+    assert.equal(events.get(events.size() - 1).text, recognizer.getHyp(), "The end should carry the hypothesis");
+    assert.equal(words_seen.join(" "), "WINDOWS SUCKS AND LINUX IS GREAT", "Each word should be reported once, in order");
+    events.delete();
+});
+
+QUnit.test( "Latency budget", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    recognizer.addGrammar(ids, {numStates: grammarOses.numStates,
+				start: grammarOses.start, end: grammarOses.end,
+				transitions: transitions});
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    assert.equal(recognizer.setLatencyBudget(-1, 0.5), Module.ReturnType.BAD_ARGUMENT, "Target should not be negative");
+    assert.equal(recognizer.setLatencyBudget(0.5, 0), Module.ReturnType.BAD_ARGUMENT, "Beams should not be scaled to nothing");
+    var configured = recognizer.getOperatingPoint();
+    assert.equal(configured.scale, 1, "Beams should start from the configuration");
+    // An impossible target forces pruning down to its bound
+    assert.equal(recognizer.setLatencyBudget(1e-6, 0.5), Module.ReturnType.SUCCESS, "Budget should be set successfully");
+    recognizer.start();
+    for (var i = 0 ; i < 20 ; i++) recognizer.process(buffer);
+    recognizer.stop();
+    var point = recognizer.getOperatingPoint();
+    assert.ok(point.rtf > 0, "Real-time factor should be measured");
+    assert.equal(point.scale, 0.5, "Pruning should stop at its bound");
+    assert.ok(point.beam > configured.beam, "Beam should be tighter");
+    assert.equal(recognizer.setLatencyBudget(0, 1), Module.ReturnType.SUCCESS, "Budget should be removed successfully");
+    assert.equal(recognizer.getOperatingPoint().beam, configured.beam, "Beams should be back to the configuration");
+});
+
+QUnit.test( "Adaptation state", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    recognizer.addGrammar(ids, {numStates: grammarOses.numStates,
+				start: grammarOses.start, end: grammarOses.end,
+				transitions: transitions});
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var initial = new Module.Feats();
+    var adapted = new Module.Feats();
+    var restored = new Module.Feats();
+    assert.equal(recognizer.exportAdaptationState(initial), Module.ReturnType.SUCCESS, "State should be exported successfully");
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    recognizer.exportAdaptationState(adapted);
+    assert.equal(adapted.size(), initial.size(), "State should keep its size");
+    var changed = false;
+    for (var i = 0 ; i < adapted.size() ; i++) changed = changed || (adapted.get(i) != initial.get(i));
+    assert.ok(changed, "State should adapt to the audio");
+    var truncated = new Module.Feats();
+    truncated.push_back(adapted.get(0));
+    assert.equal(recognizer.importAdaptationState(truncated), Module.ReturnType.BAD_ARGUMENT, "A malformed state should be rejected");
+    truncated.delete();
+    assert.equal(recognizer.importAdaptationState(initial), Module.ReturnType.SUCCESS, "State should be imported successfully");
+    assert.equal(recognizer.importAdaptationState(adapted), Module.ReturnType.SUCCESS, "State should be imported successfully");
+    recognizer.exportAdaptationState(restored);
+    for (var i = 0 ; i < adapted.size() ; i++)
+	assert.equal(restored.get(i), adapted.get(i), "Imported state should be exported back unchanged");
+    initial.delete();
+    adapted.delete();
+    restored.delete();
+});
+
+QUnit.test( "Feature store", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    recognizer.addGrammar(ids, {numStates: grammarOses.numStates,
+				start: grammarOses.start, end: grammarOses.end,
+				transitions: transitions});
+    var id = ids.get(0);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var empty = new Module.AudioBuffer();
+    var feats = new Module.Feats();
+    assert.equal(recognizer.setFeatureStore(-1), Module.ReturnType.BAD_ARGUMENT, "Store size should not be negative");
+    assert.equal(recognizer.reprocess(id), Module.ReturnType.BAD_STATE, "There should be nothing to reprocess yet");
+    // Too small for the utterance
+    assert.equal(recognizer.setFeatureStore(10), Module.ReturnType.SUCCESS, "Store should be set successfully");
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    assert.equal(recognizer.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "Recognition should not depend on the store");
+    assert.equal(recognizer.reprocess(id), Module.ReturnType.BAD_STATE, "A truncated utterance should not be reprocessed");
+    assert.equal(recognizer.setFeatureStore(3000), Module.ReturnType.SUCCESS, "Store should be set successfully");
+    recognizer.start();
+    recognizer.process(buffer);
+    assert.equal(recognizer.reprocess(id), Module.ReturnType.BAD_STATE, "Nothing should be reprocessed while recording");
+    recognizer.stop();
+    assert.equal(recognizer.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "Recognizer should recognize the correct utterance");
+    assert.equal(recognizer.reprocess(id), Module.ReturnType.SUCCESS, "Stored utterance should be reprocessed successfully");
+    assert.equal(recognizer.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "Reprocessing should give the same hypothesis");
+    assert.equal(recognizer.wordAlign(empty, "WINDOWS SUCKS"), Module.ReturnType.SUCCESS, "Stored utterance should be aligned successfully");
+    assert.equal(recognizer.getWordAlignSeg(segmentation), Module.ReturnType.SUCCESS);
+    assert.ok(segmentation.size() > 1, "Alignment should have phones");
+    assert.equal(recognizer.pronFeatex(empty, "WINDOWS SUCKS", feats), Module.ReturnType.SUCCESS, "Features should be extracted from the stored utterance");
+    assert.ok(feats.size() > 0, "There should be features");
+    // The stored frames should come out of each pass unchanged
+    var segments = function() {
+	var s = [];
+	for (var i = 0 ; i < segmentation.size() ; i++)
+	    s.push([segmentation.get(i).word, segmentation.get(i).start, segmentation.get(i).end]);
+	return s;
+    };
+    recognizer.reprocess(id);
+    recognizer.getHypseg(segmentation);
+    var first = segments();
+    assert.equal(recognizer.reprocess(id), Module.ReturnType.SUCCESS, "Stored utterance should be reprocessed again successfully");
+    recognizer.getHypseg(segmentation);
+    assert.deepEqual(segments(), first, "Reprocessing again should give the same segmentation");
+    recognizer.wordAlign(empty, "WINDOWS SUCKS AND LINUX IS GREAT");
+    recognizer.getWordAlignSeg(segmentation);
+    var stored = segments();
+    recognizer.wordAlign(empty, "WINDOWS SUCKS AND LINUX IS GREAT");
+    recognizer.getWordAlignSeg(segmentation);
+    assert.deepEqual(segments(), stored, "Aligning the store again should give the same alignment");
+    recognizer.wordAlign(buffer, "WINDOWS SUCKS AND LINUX IS GREAT");
+    recognizer.getWordAlignSeg(segmentation);
+    var aligned = segments();
+    assert.equal(aligned.length, stored.length, "Aligning the store and the audio should give the same phones");
+    for (var i = 0 ; (i < aligned.length) && (i < stored.length) ; i++) {
+	assert.equal(stored[i][0], aligned[i][0], "Aligning the store and the audio should give the same phones");
+	assert.ok(Math.abs(stored[i][1] - aligned[i][1]) <= 2, "Aligning the store and the audio should give the same frames");
+    }
+    assert.equal(recognizer.setFeatureStore(0), Module.ReturnType.SUCCESS, "Store should be disabled successfully");
+    assert.equal(recognizer.pronFeatex(empty, "WINDOWS SUCKS", feats), Module.ReturnType.BAD_STATE, "There should be no stored utterance left");
+    empty.delete();
+    feats.delete();
+});
+QUnit.test( "Windowed alignment", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    var config = new Module.Config();
+    config.push_back(["-align_window", "10"]);
+    var x = new Module.Recognizer(config);
+    config.delete();
+    x.addWords(words);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var sentence = "WINDOWS SUCKS AND LINUX IS GREAT";
+    var windowed = new Module.Segmentation();
+    assert.equal(recognizer.wordAlign(buffer, sentence), Module.ReturnType.SUCCESS, "Sentence should be aligned over all states");
+    assert.equal(recognizer.getWordAlignSeg(segmentation), Module.ReturnType.SUCCESS);
+    assert.equal(x.wordAlign(buffer, sentence), Module.ReturnType.SUCCESS, "Sentence should be aligned in a window");
+    assert.equal(x.getWordAlignSeg(windowed), Module.ReturnType.SUCCESS);
+    assert.equal(windowed.size(), segmentation.size(), "Both alignments should have the same phones");
+    var moved = 0;
+    for (var i = 1 ; i < windowed.size() ; i++)
+	if (Math.abs(windowed.get(i).start - segmentation.get(i).start) > 0.03) moved++;
+    assert.ok(moved <= 2, "Phones should start at the same frames");
+    windowed.delete();
+    x.delete();
+});
+QUnit.test( "Session trace", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    var config = new Module.Config();
+    config.push_back(["-trace", "/session.trace"]);
+    var x = new Module.Recognizer(config);
+    config.delete();
+    x.addWords(words);
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    x.addGrammar(ids, {numStates: grammarOses.numStates,
+		       start: grammarOses.start, end: grammarOses.end,
+		       transitions: transitions});
+    assert.equal(x.selectLanguageModel("TRACEDMODEL"), Module.ReturnType.BAD_ARGUMENT);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    assert.equal(x.start(), Module.ReturnType.SUCCESS, "Recognizer should start while recording a trace");
+    x.process(buffer);
+    assert.equal(x.stop(), Module.ReturnType.SUCCESS);
+    assert.equal(x.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "Recording should not change the hypothesis");
+    var trace = FS.readFile("/session.trace");
+    assert.equal(String.fromCharCode(trace[0], trace[1], trace[2], trace[3]), "PSTR", "Trace should start with its header");
+    assert.ok(trace.length > 2 * audio.length, "Trace should have the audio");
+    var text = "";
+    for (var i = 0 ; i < trace.length - 2 * audio.length ; i++) text += String.fromCharCode(trace[i]);
+    assert.ok(text.indexOf("TRACEDMODEL") > 0, "Calls that fail should be recorded too");
+    x.delete();
+});
+QUnit.test( "Pronunciation scores", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var sentence = "WINDOWS SUCKS AND LINUX IS GREAT";
+    var feats = new Module.Feats();
+    var phones = new Module.Feats();
+    var wordScores = new Module.Feats();
+    assert.equal(recognizer.getPronScores(phones, wordScores), Module.ReturnType.BAD_STATE, "There should be no model yet");
+    // Logistic regression on the substitution and insertion/deletion scores
+    var model = {mean: [0, 0, 0, 0], scale: [1, 1, 1, 1], output: {weights: [0, 0, 1, 1], bias: 0}};
+    var packed = packPronModel(model);
+    assert.equal(recognizer.loadPronModel(packed.subarray(0, 12)), Module.ReturnType.BAD_ARGUMENT, "A truncated model should be rejected");
+    assert.equal(recognizer.loadPronModel(packed), Module.ReturnType.SUCCESS, "Model should be loaded successfully");
+    assert.equal(recognizer.pronFeatex(buffer, sentence, feats), Module.ReturnType.SUCCESS);
+    assert.equal(recognizer.getPronScores(phones, wordScores), Module.ReturnType.SUCCESS, "Scores should be retrieved successfully");
+    assert.equal(phones.size(), (feats.size() - 1) / 4, "Each phone with features should have a score");
+    assert.equal(wordScores.size(), sentence.split(" ").length, "Each word should have a score");
+    for (var i = 0 ; i < phones.size() ; i++) {
+	var expected = 1 / (1 + Math.exp(-(feats.get(4 * i + 2) + feats.get(4 * i + 3))));
+	assert.ok(Math.abs(phones.get(i) - expected) < 1e-5, "Phone scores should follow the model");
+    }
+    assert.equal(recognizer.loadPronModel(""), Module.ReturnType.SUCCESS, "Model should be removed successfully");
+    assert.equal(recognizer.getPronScores(phones, wordScores), Module.ReturnType.BAD_STATE, "There should be no model left");
+    feats.delete();
+    phones.delete();
+    wordScores.delete();
+});
+
+QUnit.test( "Background jobs", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    recognizer.addWords(words);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var sentence = "WINDOWS SUCKS AND LINUX IS GREAT";
+    var feats = new Module.Feats();
+    var jobFeats = new Module.Feats();
+    var seg = new Module.Segmentation();
+    assert.equal(recognizer.runJob(10), Module.ReturnType.BAD_STATE, "There should be no job yet");
+    assert.equal(recognizer.pronFeatex(buffer, sentence, feats), Module.ReturnType.SUCCESS);
+    assert.equal(recognizer.startJob(Module.JobType.FEATEX_JOB, buffer, sentence), Module.ReturnType.SUCCESS, "Job should start successfully");
+    var status = recognizer.getJobStatus();
+    assert.ok(status.running && !status.done, "Job should be running");
+    assert.equal(recognizer.getJobFeats(jobFeats), Module.ReturnType.BAD_STATE, "Features should wait for the end of the job");
+    var progress = 0;
+    while (!status.done) {
+	assert.equal(recognizer.runJob(1), Module.ReturnType.SUCCESS, "Job should run successfully");
+	// Live decoding goes on between slices
+	recognizer.start();
+	recognizer.process(buffer);
+	recognizer.stop();
+	status = recognizer.getJobStatus();
+	assert.ok(status.progress >= progress, "Progress should not go back");
+	progress = status.progress;
+    }
+    assert.ok(status.steps > 1, "Job should run in several steps");
+    assert.equal(progress, 1, "A finished job should be complete");
+    var jobDecoderBytes = function() {
+	var report = new Module.MemoryReport();
+	recognizer.getMemoryReport(report);
+	var bytes = 0;
+	for (var i = 0 ; i < report.size() ; i++)
+	    if (report.get(i).component == "job decoder") bytes += report.get(i).bytes;
+	report.delete();
+	return bytes;
+    };
+    var decoderBytes = jobDecoderBytes();
+    assert.ok(decoderBytes > 0, "Job decoder should be kept after the job");
+    assert.equal(recognizer.getJobFeats(jobFeats), Module.ReturnType.SUCCESS, "Features should be retrieved successfully");
+    assert.equal(jobFeats.size(), feats.size(), "Job should give the features of pronFeatex");
+    for (var i = 0 ; i < feats.size() ; i++)
+	assert.ok(Math.abs(jobFeats.get(i) - feats.get(i)) < 1e-5, "Job should give the features of pronFeatex");
+    assert.equal(recognizer.startJob(Module.JobType.ALIGN_JOB, buffer, "NOTAWORD"), Module.ReturnType.BAD_ARGUMENT, "Unknown words should be rejected");
+    assert.equal(recognizer.startJob(Module.JobType.ALIGN_JOB, buffer, sentence), Module.ReturnType.SUCCESS, "Job should start successfully");
+    assert.equal(recognizer.cancelJob(), Module.ReturnType.SUCCESS, "Job should be cancelled successfully");
+    assert.notOk(recognizer.getJobStatus().running, "Job should be dropped");
+    recognizer.startJob(Module.JobType.ALIGN_JOB, buffer, sentence);
+    while (!recognizer.getJobStatus().done) recognizer.runJob(5);
+    assert.equal(recognizer.getWordAlignSeg(seg), Module.ReturnType.SUCCESS, "Alignment should be retrieved successfully");
+    assert.ok(seg.size() > 1, "Alignment should have phones");
+    assert.equal(jobDecoderBytes(), decoderBytes, "Later jobs should run on the same job decoder");
+    var config = new Module.Config();
+    assert.equal(recognizer.reInit(config), Module.ReturnType.SUCCESS);
+    config.delete();
+    assert.equal(recognizer.startJob(Module.JobType.ALIGN_JOB, buffer, sentence), Module.ReturnType.BAD_ARGUMENT, "Words should be dropped with the configuration");
+    recognizer.addWords(words);
+    assert.equal(recognizer.startJob(Module.JobType.ALIGN_JOB, buffer, sentence), Module.ReturnType.SUCCESS, "Words added after reInit should be given to the job");
+    recognizer.cancelJob();
+    feats.delete();
+    jobFeats.delete();
+    seg.delete();
+});
+QUnit.test( "Frame skipping", function(assert) {
+    for (var i = 0; i < wordList.length; i++) {
+	words.push_back(wordList[i]);
+    }
+    for (var i = 0; i < grammarOses.transitions.length; i++) {
+	transitions.push_back(grammarOses.transitions[i]);
+    }
+    var grammar = {numStates: grammarOses.numStates,
+		   start: grammarOses.start, end: grammarOses.end,
+		   transitions: transitions};
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    assert.equal(recognizer.getFrameSkipStats().frames, 0, "Frames should not be counted without -frame_skip");
+    var config = new Module.Config();
+    // Every frame outside changes can be skipped
+    config.push_back(["-frame_skip", "1000"]);
+    config.push_back(["-frame_skip_max", "1"]);
+    var x = new Module.Recognizer(config);
+    config.delete();
+    x.addWords(words);
+    x.addGrammar(ids, grammar);
+    assert.equal(x.start(), Module.ReturnType.SUCCESS);
+    x.process(buffer);
+    assert.equal(x.stop(), Module.ReturnType.SUCCESS);
+    assert.equal(x.getHyp(), "WINDOWS SUCKS AND LINUX IS GREAT", "Skipping frames should keep the hypothesis");
+    var stats = x.getFrameSkipStats();
+    assert.ok(stats.frames > 0, "Frames should be counted");
+    assert.ok(stats.skippedFrames > 0, "Frames should be skipped");
+    assert.ok(stats.skippedFrames <= Math.ceil(stats.frames / 2), "No two frames in a row should be skipped");
+    assert.ok((stats.reusedSenones > 0) && (stats.reusedSenones < 1), "Some senone scores should be reused");
+    assert.ok(stats.auditedFrames > 0, "Skipped frames should be audited");
+    assert.ok(stats.bestSenoneAgreement >= 0 && stats.bestSenoneAgreement <= 1);
+    // Audits score the frame in full: senones computed on a skipped
+    // frame should be on the scale of the reused ones
+    assert.ok(stats.newScoreError <= stats.scoreError,
+              "Scores computed on a skipped frame should be as close to a full evaluation as the reused ones");
+    assert.ok(stats.bestSenoneAgreement >= 0.5, "The best senone should mostly stay the same");
+    x.delete();
+});
@@ -68,3 +68,111 @@ QUnit.test( "Spotting audio", function(assert) {
     assert.equal(recognizer.stop(), Module.ReturnType.SUCCESS, "Recognizer should stop successfully");
     assert.ok((recognizer.getHyp().length > 0), "Recognizer should have spotted word");
 });
+
+QUnit.test( "Continuous spotting", function(assert) {
+    var history = new Module.Segmentation();
+    var chunk = 1600;
+    var runs = 3;
+    words.push_back(["AH", "AH"]);
+    recognizer.addWords(words);
+    recognizer.addKeyword(ids, "AH");
+    assert.equal(recognizer.setContinuous(-1, 0, 10), Module.ReturnType.BAD_ARGUMENT, "Rollover should not be negative");
+    assert.equal(recognizer.setContinuous(100, 0, 0), Module.ReturnType.BAD_ARGUMENT, "History should not be empty");
+    assert.equal(recognizer.setContinuous(100, 20, 5), Module.ReturnType.SUCCESS, "Continuous mode should be set successfully");
+    for (var i = 0 ; i < chunk ; i++) buffer.push_back(0);
+    recognizer.start();
+    for (var run = 0 ; run < runs ; run++) {
+	for (var start = 0 ; start + chunk <= audio.length ; start += chunk) {
+	    for (var i = 0 ; i < chunk ; i++) buffer.set(i, audio[start + i]);
+	    assert.equal(recognizer.process(buffer), Module.ReturnType.SUCCESS, "Recognizer should process successfully");
+	}
+    }
+    assert.equal(recognizer.stop(), Module.ReturnType.SUCCESS, "Recognizer should stop successfully");
+    assert.equal(recognizer.getHistory(history), Module.ReturnType.SUCCESS, "History should be retrieved successfully");
+    assert.ok(history.size() > 0, "Spotted words should be in the history");
+    assert.ok(history.size() <= 5, "History should be bounded");
+    var frames = runs * audio.length / 160;
+    for (var i = 0 ; i < history.size() ; i++) {
+	assert.ok(history.get(i).end <= frames, "Frames should be counted from start");
+	if (i > 0) assert.ok(history.get(i).start >= history.get(i - 1).start, "History should be in order");
+	if (i > 0) assert.ok((history.get(i).word != history.get(i - 1).word) || (history.get(i).start > history.get(i - 1).end),
+			     "Words should not be repeated across rollovers");
+    }
+    assert.equal(recognizer.setContinuous(0, 0, 0), Module.ReturnType.SUCCESS, "Continuous mode should be turned off successfully");
+    history.delete();
+});
+
+QUnit.test( "Spotting events", function(assert) {
+    var events = new Module.Events();
+    words.push_back(["AH", "AH"]);
+    recognizer.addWords(words);
+    recognizer.addKeyword(ids, "AH");
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    assert.equal(recognizer.setEventQueue(-1), Module.ReturnType.BAD_ARGUMENT, "Queue size should not be negative");
+    assert.equal(recognizer.setEventQueue(64), Module.ReturnType.SUCCESS, "Event queue should be set successfully");
+    recognizer.start();
+    recognizer.process(buffer);
+    assert.equal(recognizer.getEvents(events), Module.ReturnType.SUCCESS, "Events should be retrieved successfully");
+    assert.ok(events.size() > 0, "Spotted key phrases should be queued");
+    for (var i = 0 ; i < events.size() ; i++) {
+	assert.equal(events.get(i).type, Module.EventType.KEYWORD_SPOTTED, "Events should be key phrases");
+	assert.equal(events.get(i).text, "AH", "Events should name the key phrase");
+	assert.ok(events.get(i).end >= events.get(i).start, "Events should have frames");
+    }
+    var spotted = events.size();
+    recognizer.getEvents(events);
+    assert.equal(events.size(), 0, "Events should be reported once");
+    recognizer.stop();
+    recognizer.getEvents(events);
+    assert.equal(events.get(events.size() - 1).type, Module.EventType.UTTERANCE_END, "The end of the utterance should come last");
+    assert.equal(spotted + events.size() - 1, recognizer.getHyp().split(" ").length, "Each spotted phrase should have one event");
+    events.delete();
+});
+
+QUnit.test( "Searches together", function(assert) {
+    var hyps = new Module.SearchHyps();
+    var transitions = new Module.VectorTransitions();
+    words.push_back(["AH", "AH"]);
+    recognizer.addWords(words);
+    recognizer.addKeyword(ids, "AH");
+    var keyword = ids.get(0);
+    transitions.push_back({from: 0, to: 1, logp: 0, word: "AH"});
+    transitions.push_back({from: 1, to: 1, logp: 0, word: "AH"});
+    recognizer.addGrammar(ids, {numStates: 2, start: 0, end: 1, transitions: transitions});
+    var grammar = ids.get(0);
+    for (var i = 0 ; i < audio.length ; i++) buffer.push_back(audio[i]);
+    var alone = [];
+    var searches = [keyword, grammar];
+    for (var i = 0 ; i < searches.length ; i++) {
+	recognizer.switchSearch(searches[i]);
+	recognizer.start();
+	recognizer.process(buffer);
+	recognizer.stop();
+	alone.push(recognizer.getHyp());
+    }
+    ids.resize(0, 0);
+    assert.equal(recognizer.setSearches(ids), Module.ReturnType.BAD_ARGUMENT, "There should be at least one search");
+    ids.push_back(keyword);
+    ids.push_back(keyword);
+    assert.equal(recognizer.setSearches(ids), Module.ReturnType.BAD_ARGUMENT, "Searches should not repeat");
+    ids.set(1, grammar);
+    assert.equal(recognizer.setSearches(ids), Module.ReturnType.SUCCESS, "Searches should be set successfully");
+    assert.equal(recognizer.start(), Module.ReturnType.SUCCESS, "Recognizer should start successfully");
+    assert.equal(recognizer.process(buffer), Module.ReturnType.SUCCESS, "Recognizer should process successfully");
+    assert.equal(recognizer.stop(), Module.ReturnType.SUCCESS, "Recognizer should stop successfully");
+    assert.equal(recognizer.getHyp(), alone[0], "The first search should give the hypothesis");
+    assert.equal(recognizer.getSearchHyps(hyps), Module.ReturnType.SUCCESS, "Hypotheses should be retrieved successfully");
+    assert.equal(hyps.size(), 2, "Each search should have its hypothesis");
+    for (var i = 0 ; i < hyps.size() ; i++) {
+	assert.equal(hyps.get(i).id, searches[i], "Hypotheses should be in the order of the searches");
+	assert.equal(hyps.get(i).hyp, alone[i], "Searches should decode as they do alone");
+    }
+    recognizer.switchSearch(grammar);
+    recognizer.start();
+    recognizer.process(buffer);
+    recognizer.stop();
+    recognizer.getSearchHyps(hyps);
+    assert.equal(hyps.size(), 1, "switchSearch should go back to one search");
+    transitions.delete();
+    hyps.delete();
+});
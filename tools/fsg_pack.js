@@ -0,0 +1,94 @@
+/***************************************
+*
+* Packs a grammar into the binary form of addGrammarBinary
+*
+* Usage: node tools/fsg_pack.js GRAMMAR OUTPUT
+*
+* GRAMMAR is either a JSON file with the object given to
+* addGrammar ({numStates, start, end, transitions}) or a grammar
+* in the Sphinx FSG text format (FSG_BEGIN, NUM_STATES, ...).
+* Words are stored once, and each transition as four integers,
+* see src/fsgblob.h for the layout. In a web page, the same
+* packing is available as packGrammar(grammar).
+*
+***************************************/
+
+var FSG_BLOB_VERSION = 1;
+// Base of the log probabilities of the recognizer's grammars
+var LOG_BASE = 1.0001;
+
+function utf8Bytes(s) {
+    var encoded = unescape(encodeURIComponent(s));
+    var bytes = [];
+    for (var i = 0 ; i < encoded.length ; i++) bytes.push(encoded.charCodeAt(i));
+    return bytes;
+}
+
+// Returns the packed grammar as a Uint8Array
+function packGrammar(grammar) {
+    var words = [], wordIndex = {}, table = [];
+    var arcs = grammar.transitions.map(function(t) {
+	var w = -1;
+	if (t.word) {
+	    if (!wordIndex.hasOwnProperty(t.word)) {
+		wordIndex[t.word] = words.length;
+		words.push(t.word);
+		table = table.concat(utf8Bytes(t.word), [0]);
+	    }
+	    w = wordIndex[t.word];
+	}
+	return [t.from, t.to, t.logp || 0, w];
+    });
+    while (table.length % 4) table.push(0);
+    var header = 8 * 4;
+    var out = new Uint8Array(header + table.length + arcs.length * 16);
+    var view = new DataView(out.buffer);
+    out.set([0x50, 0x53, 0x46, 0x47], 0); // "PSFG"
+    [FSG_BLOB_VERSION, grammar.numStates, grammar.start, grammar.end,
+     words.length, arcs.length, table.length].forEach(function(v, i) {
+	 view.setInt32(4 + 4 * i, v, true);
+     });
+    out.set(table, header);
+    var o = header + table.length;
+    arcs.forEach(function(arc) {
+	arc.forEach(function(v) {
+	    view.setInt32(o, v, true);
+	    o += 4;
+	});
+    });
+    return out;
+}
+
+// Reads the Sphinx FSG text format, probabilities become the
+// integer log probabilities addGrammar takes
+function parseFsg(text) {
+    var grammar = {numStates: 0, start: 0, end: 0, transitions: []};
+    text.split("\n").forEach(function(line) {
+	var f = line.replace(/#.*/, "").trim().split(/\s+/);
+	switch (f[0]) {
+	case 'NUM_STATES': case 'N': grammar.numStates = parseInt(f[1]); break;
+	case 'START_STATE': case 'S': grammar.start = parseInt(f[1]); break;
+	case 'FINAL_STATE': case 'F': grammar.end = parseInt(f[1]); break;
+	case 'TRANSITION': case 'T':
+	    grammar.transitions.push({from: parseInt(f[1]), to: parseInt(f[2]),
+				      logp: Math.round(Math.log(parseFloat(f[3])) / Math.log(LOG_BASE)),
+				      word: f[4] || ""});
+	    break;
+	}
+    });
+    return grammar;
+}
+
+if (typeof module !== 'undefined' && typeof require !== 'undefined' && require.main === module) {
+    var fs = require('fs');
+    var args = process.argv.slice(2);
+    if (args.length != 2) {
+	console.error("Usage: node fsg_pack.js GRAMMAR OUTPUT");
+	process.exit(2);
+    }
+    var text = fs.readFileSync(args[0], 'utf8');
+    var grammar = /^\s*\{/.test(text) ? JSON.parse(text) : parseFsg(text);
+    var packed = packGrammar(grammar);
+    fs.writeFileSync(args[1], Buffer.from(packed.buffer));
+    console.log(grammar.transitions.length + " transitions, " + packed.length + " bytes");
+}
@@ -0,0 +1,136 @@
+/***************************************
+*
+* Converts the means, variances and mixture weights of a
+* PocketSphinx acoustic model to 16-bit floats
+*
+* Usage: node tools/hmm_half.js [--bf16] MODEL_DIR OUTPUT_DIR
+*
+* Each converted file NAME is written as NAME.f16, with the same
+* s3 header and a "datatype fp16" (or "bf16") line, the leading
+* integers (dimensions) as they were, and the float payload in
+* half precision. Other files are copied unchanged. The
+* recognizer expands NAME.f16 back to NAME when it loads the
+* model, see src/halfmodel.cpp.
+*
+***************************************/
+
+var fs = require('fs');
+var path = require('path');
+
+var CONVERTED = ['means', 'variances', 'mixture_weights'];
+var BYTE_ORDER_MAGIC = 0x11223344;
+
+var f32 = new Float32Array(1);
+var u32 = new Uint32Array(f32.buffer);
+
+// Rounds to nearest even, overflows to infinity and keeps
+// subnormals
+function toHalf(value) {
+    f32[0] = value;
+    var x = u32[0];
+    var sign = (x >>> 16) & 0x8000;
+    var exp = (x >>> 23) & 0xff;
+    var mant = x & 0x7fffff;
+    if (exp == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0);
+    var e = exp - 127 + 15;
+    if (e >= 0x1f) return sign | 0x7c00;
+    if (e <= 0) {
+	if (e < -10) return sign;
+	mant |= 0x800000;
+	var shift = 14 - e;
+	var half = mant >>> shift;
+	var rest = mant & ((1 << shift) - 1);
+	var mid = 1 << (shift - 1);
+	if (rest > mid || (rest == mid && (half & 1))) half++;
+	return sign | half;
+    }
+    var h = (e << 10) | (mant >>> 13);
+    var r = mant & 0x1fff;
+    if (r > 0x1000 || (r == 0x1000 && (h & 1))) h++;
+    return sign | h;
+}
+
+function toBfloat(value) {
+    f32[0] = value;
+    var x = u32[0];
+    if ((x & 0x7f800000) == 0x7f800000) return x >>> 16;
+    return ((x + 0x7fff + ((x >>> 16) & 1)) >>> 16) & 0xffff;
+}
+
+// Number of int32 values before the float payload
+function leadingInts(name, data, offset, little) {
+    if (name == 'mixture_weights') return 4;
+    // Gaussian densities: n_mgau, n_feat, n_density, veclen[n_feat], n
+    var nFeat = little ? data.readInt32LE(offset + 4) : data.readInt32BE(offset + 4);
+    return 4 + nFeat;
+}
+
+function convert(src, dst, name, bf16) {
+    var data = fs.readFileSync(src);
+    var end = data.indexOf("endhdr\n");
+    if (data.slice(0, 3).toString() != "s3\n" || end < 0)
+	throw new Error(src + " is not an s3 file");
+    var lines = data.slice(0, end).toString().split("\n").filter(function(l) {
+	return !/^\s*chksum0\s/.test(l) && l.trim().length > 0;
+    });
+    var offset = end + "endhdr\n".length;
+    var little = data.readUInt32LE(offset) == BYTE_ORDER_MAGIC;
+    if (!little && data.readUInt32BE(offset) != BYTE_ORDER_MAGIC)
+	throw new Error(src + ": bad byte order magic");
+    offset += 4;
+    var nInts = leadingInts(name, data, offset, little);
+    var nFloats = little ? data.readInt32LE(offset + 4 * (nInts - 1)) : data.readInt32BE(offset + 4 * (nInts - 1));
+    lines.push("datatype " + (bf16 ? "bf16" : "fp16"));
+    lines.push("leading_ints " + nInts);
+    var header = Buffer.from(lines.join("\n") + "\nendhdr\n");
+    var out = Buffer.alloc(header.length + 4 + 4 * nInts + 2 * nFloats);
+    header.copy(out, 0);
+    var o = header.length;
+    out.writeUInt32LE(BYTE_ORDER_MAGIC, o); o += 4;
+    for (var i = 0 ; i < nInts ; i++, o += 4, offset += 4)
+	out.writeInt32LE(little ? data.readInt32LE(offset) : data.readInt32BE(offset), o);
+    var maxError = 0, flushed = 0;
+    for (var i = 0 ; i < nFloats ; i++, o += 2, offset += 4) {
+	var v = little ? data.readFloatLE(offset) : data.readFloatBE(offset);
+	var h = bf16 ? toBfloat(v) : toHalf(v);
+	out.writeUInt16LE(h, o);
+	var back = bf16 ? fromBfloat(h) : fromHalf(h);
+	if (v != 0 && back == 0) flushed++;
+	if (isFinite(v) && v != 0) maxError = Math.max(maxError, Math.abs(back - v) / Math.abs(v));
+    }
+    fs.writeFileSync(dst + ".f16", out);
+    console.log(name + ": " + nFloats + " values, max relative error " + maxError.toExponential(2) +
+		(flushed ? ", " + flushed + " flushed to zero" : ""));
+}
+
+function fromHalf(h) {
+    var sign = (h & 0x8000) ? -1 : 1;
+    var e = (h >>> 10) & 0x1f, m = h & 0x3ff;
+    if (e == 0) return sign * m * Math.pow(2, -24);
+    if (e == 0x1f) return m ? NaN : sign * Infinity;
+    return sign * (1 + m / 1024) * Math.pow(2, e - 15);
+}
+
+function fromBfloat(h) {
+    u32[0] = h << 16;
+    return f32[0];
+}
+
+var args = process.argv.slice(2);
+var bf16 = false;
+if (args[0] == '--bf16') {
+    bf16 = true;
+    args.shift();
+}
+if (args.length != 2) {
+    console.error("Usage: node hmm_half.js [--bf16] MODEL_DIR OUTPUT_DIR");
+    process.exit(2);
+}
+var srcDir = args[0], dstDir = args[1];
+if (!fs.existsSync(dstDir)) fs.mkdirSync(dstDir, {recursive: true});
+fs.readdirSync(srcDir).forEach(function(name) {
+    var src = path.join(srcDir, name), dst = path.join(dstDir, name);
+    if (fs.statSync(src).isDirectory()) return;
+    if (CONVERTED.indexOf(name) >= 0) convert(src, dst, name, bf16);
+    else fs.copyFileSync(src, dst);
+});
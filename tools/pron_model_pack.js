@@ -0,0 +1,60 @@
+/***************************************
+*
+* Packs a pronunciation scoring model into the binary form of
+* loadPronModel
+*
+* Usage: node tools/pron_model_pack.js MODEL OUTPUT
+*
+* MODEL is a JSON file with the standardization of the inputs and
+* the weights:
+*   {mean: [...], scale: [...],
+*    hidden: {weights: [[...], ...], biases: [...], activation: "relu"},
+*    output: {weights: [...], bias: 0}}
+* with one mean, scale and hidden weight per feature of a phone
+* (4, see pronFeatex). Without "hidden", the model is a logistic
+* regression on the inputs. See src/pronmodel.h for the layout. In
+* a web page, the same packing is available as packPronModel(model).
+*
+***************************************/
+
+var PRON_MODEL_VERSION = 1;
+var ACTIVATIONS = {relu: 0, tanh: 1};
+
+// Returns the packed model as a Uint8Array
+function packPronModel(model) {
+    var hidden = model.hidden || {weights: [], biases: []};
+    var activation = ACTIVATIONS[hidden.activation || "relu"];
+    if (activation === undefined) throw new Error("Unknown activation " + hidden.activation);
+    var n = model.mean.length;
+    var floats = [].concat(model.mean, model.scale);
+    hidden.weights.forEach(function(row) {
+	if (row.length != n) throw new Error("Hidden weights should have " + n + " inputs");
+	floats = floats.concat(row);
+    });
+    floats = floats.concat(hidden.biases, model.output.weights, [model.output.bias || 0]);
+    var header = 5 * 4;
+    var out = new Uint8Array(header + 4 * floats.length);
+    var view = new DataView(out.buffer);
+    out.set([0x50, 0x53, 0x50, 0x4d], 0); // "PSPM"
+    [PRON_MODEL_VERSION, n, hidden.weights.length, activation].forEach(function(v, i) {
+	view.setInt32(4 + 4 * i, v, true);
+    });
+    floats.forEach(function(v, i) {
+	view.setFloat32(header + 4 * i, v, true);
+    });
+    return out;
+}
+
+if (typeof module !== 'undefined' && typeof require !== 'undefined' && require.main === module) {
+    var fs = require('fs');
+    var args = process.argv.slice(2);
+    if (args.length != 2) {
+	console.error("Usage: node pron_model_pack.js MODEL OUTPUT");
+	process.exit(2);
+    }
+    var model = JSON.parse(fs.readFileSync(args[0], 'utf8'));
+    var packed = packPronModel(model);
+    fs.writeFileSync(args[1], Buffer.from(packed.buffer));
+    console.log(model.mean.length + " inputs, " + (model.hidden ? model.hidden.weights.length : 0)
+		+ " hidden units, " + packed.length + " bytes");
+}
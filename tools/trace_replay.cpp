@@ -0,0 +1,351 @@
+/**
+ * @file trace_replay.cpp Replays a trace recorded with -trace
+ *
+ * Usage: pocketsphinx_replay TRACE [--set KEY VALUE]... [--out FILE]
+ *
+ * Makes the calls of the trace again, in order, on a native
+ * Recognizer, and reports for each of them the time it took when
+ * it was recorded and now, then totals per kind of call. --set
+ * changes or adds a configuration parameter, for instance to point
+ * "-hmm" at the model folder of the build tree. The exit status is
+ * 1 if a call gave another result or another hypothesis than when
+ * it was recorded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <sstream>
+#include "psRecognizer.h"
+#include "trace.h"
+#include "clock.h"
+
+namespace ps = pocketsphinxjs;
+
+struct Totals {
+  int count;
+  double recorded;
+  double replayed;
+  double slowest;
+};
+
+static bool readConfig(TraceArgsReader& args, const std::map<std::string, std::string>& overrides,
+		       ps::Config& config) {
+  int32_t n;
+  if (!args.i32(n)) return false;
+  std::map<std::string, std::string> items(overrides);
+  for (int i = 0; i < n; ++i) {
+    std::string key, value;
+    if (!args.str(key) || !args.str(value)) return false;
+    if (overrides.find(key) == overrides.end()) items[key] = value;
+  }
+  for (std::map<std::string, std::string>::iterator i = items.begin(); i != items.end(); ++i) {
+    ps::ConfigItem item = {i->first, i->second};
+    config.push_back(item);
+  }
+  return true;
+}
+
+static bool readTransitions(TraceArgsReader& args, std::vector<ps::Transition>& transitions) {
+  int32_t n;
+  if (!args.i32(n)) return false;
+  for (int i = 0; i < n; ++i) {
+    int32_t from, to, logp;
+    ps::Transition t;
+    if (!args.i32(from) || !args.i32(to) || !args.i32(logp) || !args.str(t.word)) return false;
+    t.from = from;
+    t.to = to;
+    t.logp = logp;
+    transitions.push_back(t);
+  }
+  return true;
+}
+
+static bool readGrammar(TraceArgsReader& args, ps::Grammar& grammar) {
+  int32_t numStates, start, end;
+  if (!args.i32(numStates) || !args.i32(start) || !args.i32(end)) return false;
+  grammar.numStates = numStates;
+  grammar.start = start;
+  grammar.end = end;
+  return readTransitions(args, grammar.transitions);
+}
+
+static bool readFeats(TraceArgsReader& args, ps::Feats& values) {
+  int32_t n;
+  if (!args.i32(n)) return false;
+  for (int i = 0; i < n; ++i) {
+    float value;
+    if (!args.f32(value)) return false;
+    values.push_back(value);
+  }
+  return true;
+}
+
+// Makes one call, returns false if its arguments cannot be read
+static bool replay(ps::Recognizer *&r, const TraceRecord& record,
+		   const std::map<std::string, std::string>& overrides,
+		   int& result, std::string& output) {
+  TraceArgsReader args(record.args);
+  ps::Integers ids;
+  std::vector<int16_t> audio;
+  std::string text;
+  int32_t a, b, c;
+  output = "";
+  if (record.call == TRACE_INIT) {
+    ps::Config config;
+    if (!readConfig(args, overrides, config)) return false;
+    if (r == NULL) {
+      r = new ps::Recognizer(config);
+      // The constructor has no result, the report fails the
+      // same way if the decoder could not be created
+      ps::MemoryReport report;
+      result = r->getMemoryReport(report);
+    }
+    else
+      result = r->reInit(config);
+    return true;
+  }
+  if (r == NULL) return false;
+  switch (record.call) {
+  case TRACE_ADD_WORDS: {
+    std::vector<ps::Word> words;
+    if (!args.i32(a)) return false;
+    for (int i = 0; i < a; ++i) {
+      ps::Word w;
+      if (!args.str(w.word) || !args.str(w.pronunciation)) return false;
+      words.push_back(w);
+    }
+    result = r->addWords(words);
+    break;
+  }
+  case TRACE_ADD_GRAMMAR: {
+    ps::Grammar grammar;
+    if (!readGrammar(args, grammar)) return false;
+    result = r->addGrammar(ids, grammar);
+    break;
+  }
+  case TRACE_ADD_GRAMMAR_JSGF:
+    if (!args.str(text)) return false;
+    result = r->addGrammarJsgf(ids, text);
+    break;
+  case TRACE_ADD_GRAMMAR_BINARY:
+    if (!args.str(text)) return false;
+    result = r->addGrammarBinary(ids, text);
+    break;
+  case TRACE_ADD_KEYWORD:
+    if (!args.str(text)) return false;
+    result = r->addKeyword(ids, text);
+    break;
+  case TRACE_SWITCH_SEARCH:
+    if (!args.i32(a)) return false;
+    result = r->switchSearch(a);
+    break;
+  case TRACE_START:
+    result = r->start();
+    break;
+  case TRACE_PROCESS:
+    if (!args.samples(audio)) return false;
+    result = r->process(audio);
+    if (result == ps::SUCCESS) output = r->getHyp();
+    break;
+  case TRACE_STOP:
+    result = r->stop();
+    if (result == ps::SUCCESS) output = r->getHyp();
+    break;
+  case TRACE_WORD_ALIGN:
+    if (!args.samples(audio) || !args.str(text)) return false;
+    result = r->wordAlign(audio, text);
+    break;
+  case TRACE_PRON_FEATEX: {
+    ps::Feats feats;
+    if (!args.samples(audio) || !args.str(text)) return false;
+    result = r->pronFeatex(audio, text, feats);
+    if (result == ps::SUCCESS) {
+      std::ostringstream count;
+      count << feats.size();
+      output = count.str();
+    }
+    break;
+  }
+  case TRACE_SET_FEATURE_STORE:
+    if (!args.i32(a)) return false;
+    result = r->setFeatureStore(a);
+    break;
+  case TRACE_SET_CONTINUOUS:
+    if (!args.i32(a) || !args.i32(b) || !args.i32(c)) return false;
+    result = r->setContinuous(a, b, c);
+    break;
+  case TRACE_SET_EVENT_QUEUE:
+    if (!args.i32(a)) return false;
+    result = r->setEventQueue(a);
+    break;
+  case TRACE_REPROCESS:
+    if (!args.i32(a)) return false;
+    result = r->reprocess(a);
+    if (result == ps::SUCCESS) output = r->getHyp();
+    break;
+  case TRACE_SET_SEARCHES:
+    if (!args.i32(a)) return false;
+    for (int i = 0; i < a; ++i) {
+      if (!args.i32(b)) return false;
+      ids.push_back(b);
+    }
+    result = r->setSearches(ids);
+    break;
+  case TRACE_LOAD_PRON_MODEL:
+    if (!args.str(text)) return false;
+    result = r->loadPronModel(text);
+    break;
+  case TRACE_START_JOB:
+    if (!args.i32(a) || !args.samples(audio) || !args.str(text)) return false;
+    result = r->startJob((ps::JobType) a, audio, text);
+    break;
+  case TRACE_RUN_JOB:
+    // Slices are timed, the job may end in another call than
+    // when it was recorded, later calls then do nothing
+    if (!args.i32(a)) return false;
+    result = r->runJob(a);
+    break;
+  case TRACE_CANCEL_JOB:
+    result = r->cancelJob();
+    break;
+  case TRACE_ADD_TRANSITIONS:
+  case TRACE_REMOVE_TRANSITIONS: {
+    std::vector<ps::Transition> transitions;
+    if (!args.i32(a) || !readTransitions(args, transitions)) return false;
+    if (record.call == TRACE_ADD_TRANSITIONS) result = r->addTransitions(a, transitions);
+    else result = r->removeTransitions(a, transitions);
+    break;
+  }
+  case TRACE_REMOVE_WORD:
+    if (!args.i32(a) || !args.str(text)) return false;
+    result = r->removeWord(a, text);
+    break;
+  case TRACE_ADD_LANGUAGE_MODEL: {
+    std::string path;
+    if (!args.str(text) || !args.str(path)) return false;
+    result = r->addLanguageModel(ids, text, path);
+    break;
+  }
+  case TRACE_SELECT_LANGUAGE_MODEL:
+    if (!args.str(text)) return false;
+    result = r->selectLanguageModel(text);
+    break;
+  case TRACE_INTERPOLATE_LANGUAGE_MODELS: {
+    ps::StringsListType names;
+    ps::Feats weights;
+    if (!args.i32(a)) return false;
+    for (int i = 0; i < a; ++i) {
+      if (!args.str(text)) return false;
+      names.push_back(text);
+    }
+    if (!readFeats(args, weights)) return false;
+    result = r->interpolateLanguageModels(names, weights);
+    break;
+  }
+  case TRACE_SET_LATENCY_BUDGET: {
+    float targetRtf, minScale;
+    if (!args.f32(targetRtf) || !args.f32(minScale)) return false;
+    result = r->setLatencyBudget(targetRtf, minScale);
+    break;
+  }
+  case TRACE_IMPORT_ADAPTATION_STATE: {
+    ps::Feats state;
+    if (!readFeats(args, state)) return false;
+    result = r->importAdaptationState(state);
+    break;
+  }
+  case TRACE_TRANSCRIBE_BATCH: {
+    AudioBuffers clips;
+    BatchResults results;
+    if (!args.i32(a)) return false;
+    clips.resize(a < 0 ? 0 : a);
+    for (int i = 0; i < a; ++i)
+      if (!args.samples(clips[i])) return false;
+    if (!args.i32(b) || !args.i32(c)) return false;
+    result = r->transcribeBatch(clips, b, c, results);
+    for (int i = 0; i < results.size(); ++i) output += (i ? "\n" : "") + results[i].hyp;
+    break;
+  }
+  case TRACE_RESET_UTTERANCE:
+    result = r->resetUtterance();
+    break;
+  case TRACE_LOOKUP_WORD:
+    if (!args.str(text)) return false;
+    output = r->lookupWord(text);
+    result = ps::SUCCESS;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  std::map<std::string, std::string> overrides;
+  std::string trace_file, out_file;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if ((arg == "--set") && (i + 2 < argc)) {
+      overrides[argv[i + 1]] = argv[i + 2];
+      i += 2;
+    }
+    else if ((arg == "--out") && (i + 1 < argc))
+      out_file = argv[++i];
+    else if (trace_file.size() == 0)
+      trace_file = arg;
+    else
+      trace_file = "";
+  }
+  TraceReader reader;
+  if ((trace_file.size() == 0) || (reader.open(trace_file.c_str()) < 0)) {
+    fprintf(stderr, "Usage: %s TRACE [--set KEY VALUE]... [--out FILE]\n", argv[0]);
+    return 2;
+  }
+  // The decoder prints its own traces on stdout, so the
+  // report is best written to a file
+  FILE *out = out_file.size() ? fopen(out_file.c_str(), "w") : stdout;
+  if (out == NULL) return 2;
+
+  ps::Recognizer *r = NULL;
+  std::map<int, Totals> totals;
+  TraceRecord record;
+  int index = 0, differences = 0, status;
+  fprintf(out, "%6s %-26s %12s %12s\n", "call", "", "recorded ms", "replayed ms");
+  while ((status = reader.next(record)) > 0) {
+    int result;
+    std::string output;
+    double t = clock_ms();
+    if (!replay(r, record, overrides, result, output)) {
+      fprintf(stderr, "Call %d (%s) cannot be replayed\n", index, trace_call_name(record.call));
+      status = -1;
+      break;
+    }
+    double ms = clock_ms() - t;
+    fprintf(out, "%6d %-26s %12.2f %12.2f", index++, trace_call_name(record.call), record.ms, ms);
+    if (result != record.result) {
+      fprintf(out, "  result %d, recorded %d", result, record.result);
+      differences++;
+    }
+    else if ((record.output.size() > 0) && (output != record.output)) {
+      fprintf(out, "  \"%s\", recorded \"%s\"", output.c_str(), record.output.c_str());
+      differences++;
+    }
+    fprintf(out, "\n");
+    Totals& total = totals[record.call];
+    total.count++;
+    total.recorded += record.ms;
+    total.replayed += ms;
+    if (ms > total.slowest) total.slowest = ms;
+  }
+  if (status < 0) fprintf(stderr, "The trace is truncated or damaged\n");
+
+  fprintf(out, "\n%-26s %6s %12s %12s %12s\n", "", "calls", "recorded ms", "replayed ms", "slowest ms");
+  for (std::map<int, Totals>::iterator i = totals.begin(); i != totals.end(); ++i)
+    fprintf(out, "%-26s %6d %12.2f %12.2f %12.2f\n", trace_call_name(i->first), i->second.count,
+	    i->second.recorded, i->second.replayed, i->second.slowest);
+  fprintf(out, "%d calls, %d differences\n", index, differences);
+  if (out != stdout) fclose(out);
+  delete r;
+  return (status < 0) ? 2 : (differences > 0) ? 1 : 0;
+}
@@ -69,6 +69,21 @@ startup(function(event) {
     case 'addGrammar':
 	addGrammar(event.data.data, event.data.callbackId);
 	break;
+    case 'addGrammarJsgf':
+	addGrammarJsgf(event.data.data, event.data.callbackId);
+	break;
+    case 'addGrammarBinary':
+	addGrammarBinary(event.data.data, event.data.callbackId);
+	break;
+    case 'addTransitions':
+	editGrammar('addTransitions', event.data.data, event.data.callbackId);
+	break;
+    case 'removeTransitions':
+	editGrammar('removeTransitions', event.data.data, event.data.callbackId);
+	break;
+    case 'removeWord':
+	removeWord(event.data.data, event.data.callbackId);
+	break;
     case 'lookupWord':
 	lookupWord(event.data.data, event.data.callbackId);
 	break;
@@ -78,6 +93,39 @@ startup(function(event) {
     case 'addKeyword':
 	addKeyword(event.data.data, event.data.callbackId);
 	break;
+    case 'addLanguageModel':
+	addLanguageModel(event.data.data, event.data.callbackId);
+	break;
+    case 'selectLanguageModel':
+	selectLanguageModel(event.data.data, event.data.callbackId);
+	break;
+    case 'interpolateLanguageModels':
+	interpolateLanguageModels(event.data.data, event.data.callbackId);
+	break;
+    case 'exportAdaptationState':
+	exportAdaptationState(event.data.callbackId);
+	break;
+    case 'importAdaptationState':
+	importAdaptationState(event.data.data, event.data.callbackId);
+	break;
+    case 'getTrace':
+	getTrace(event.data.callbackId);
+	break;
+    case 'setFeatureStore':
+	setFeatureStore(event.data.data, event.data.callbackId);
+	break;
+    case 'reprocess':
+	reprocess(event.data.data);
+	break;
+    case 'setEventQueue':
+	setEventQueue(event.data.data, event.data.callbackId);
+	break;
+    case 'setContinuous':
+	setContinuous(event.data.data, event.data.callbackId);
+	break;
+    case 'setLatencyBudget':
+	setLatencyBudget(event.data.data, event.data.callbackId);
+	break;
     case 'start':
 	start(event.data.data);
 	break;
@@ -87,6 +135,13 @@ startup(function(event) {
     case 'process':
 	process(event.data.data);
 	break;
+    case 'pronFeatex':
+    case 'wordAlign':
+	queueJob(event.data.command, event.data.data, event.data.callbackId);
+	break;
+    case 'cancelJob':
+	cancelJob(event.data.data, event.data.callbackId);
+	break;
     }
 });
 
@@ -98,6 +153,35 @@ var post = function(message) {
 var recognizer;
 var buffer;
 var segmentation;
+// File given with -trace, in the virtual file system
+var tracePath;
+var history;
+var events;
+// Set when several searches were started together
+var searchHyps;
+// Background jobs (pronFeatex and wordAlign) waiting to run,
+// highest priority first, and the one running. Each slice of the
+// running job is a task of its own, so that messages such as
+// process are handled as soon as the current slice ends
+var jobs = [];
+var runningJob;
+var jobTimer;
+var jobSliceMs = 20;
+
+// Posts the queued events, if any, in one message
+function postEvents() {
+    if (!events) return;
+    recognizer.getEvents(events);
+    if (events.size() == 0) return;
+    var output = [];
+    for (var i = 0 ; i < events.size() ; i++) {
+	var e = events.get(i);
+	output.push({type: e.type == Module.EventType.KEYWORD_SPOTTED ? "keyword" :
+		     (e.type == Module.EventType.WORD_FINAL ? "word" : "end"),
+		     text: Utf8Decode(e.text), start: e.start, end: e.end, score: e.score});
+    }
+    post({events: output});
+}
 
 function segToArray(segmentation) {
     var output = [];
@@ -108,15 +192,26 @@ function segToArray(segmentation) {
     return output;
 };
 
+function searchHypsToArray() {
+    recognizer.getSearchHyps(searchHyps);
+    var output = [];
+    for (var i = 0 ; i < searchHyps.size() ; i++)
+	output.push({'id': searchHyps.get(i).id,
+		     'hyp': Utf8Decode(searchHyps.get(i).hyp),
+		     'score': searchHyps.get(i).score});
+    return output;
+};
 
 function initialize(data, clbId) {
     var config = new Module.Config();
     buffer = new Module.AudioBuffer();
+    tracePath = undefined;
     if (data) {
 	while (data.length > 0) {
 	    var p = data.pop();
 	    if (p.length == 2) {
 		config.push_back([p[0],p[1]]);
+		if (p[0] == "-trace") tracePath = p[1];
 	    } else {
 		post({status: "error", command: "initialize", code: "js-data"});
 	    }
@@ -124,6 +219,13 @@ function initialize(data, clbId) {
     }
     var output;
     if(recognizer) {
+	// reInit drops the job running
+	cancelJobs();
+	// reInit turns the continuous mode and events off
+	if (history) history.delete();
+	history = undefined;
+	if (events) events.delete();
+	events = undefined;
 	output = recognizer.reInit(config);
 	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "initialize", code: output});
 	else post({status: "done", command: "initialize", id: clbId});
@@ -209,6 +311,61 @@ function addGrammar(data, clbId) {
     } else post({status: "error", command: "addGrammar", code: "js-no-recognizer"});
 }
 
+function addGrammarJsgf(data, clbId) {
+    if (recognizer) {
+	if (typeof data === 'string' && data.length > 0) {
+	    var id_v = new Module.Integers();
+	    var output = recognizer.addGrammarJsgf(id_v, Utf8Encode(data));
+	    if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "addGrammarJsgf", code: output});
+	    else post({id: clbId, data: id_v.get(0), status: "done", command: "addGrammarJsgf"});
+	    id_v.delete();
+	} else post({status: "error", command: "addGrammarJsgf", code: "js-data"});
+    } else post({status: "error", command: "addGrammarJsgf", code: "js-no-recognizer"});
+}
+
+// data is the output of tools/fsg_pack.js, as an ArrayBuffer or a
+// Uint8Array, which is copied to the recognizer in one go
+function addGrammarBinary(data, clbId) {
+    if (recognizer) {
+	if (data instanceof ArrayBuffer) data = new Uint8Array(data);
+	if (data instanceof Uint8Array && data.length > 0) {
+	    var id_v = new Module.Integers();
+	    var output = recognizer.addGrammarBinary(id_v, data);
+	    if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "addGrammarBinary", code: output});
+	    else post({id: clbId, data: id_v.get(0), status: "done", command: "addGrammarBinary"});
+	    id_v.delete();
+	} else post({status: "error", command: "addGrammarBinary", code: "js-data"});
+    } else post({status: "error", command: "addGrammarBinary", code: "js-no-recognizer"});
+}
+
+function editGrammar(command, data, clbId) {
+    if (recognizer) {
+	if (data.hasOwnProperty('id') && data.hasOwnProperty('transitions')) {
+	    var transitions = new Module.VectorTransitions();
+	    data.transitions.forEach(function(t) {
+		if (t.hasOwnProperty('from') && t.hasOwnProperty('to'))
+		    transitions.push_back({from: t.from, to: t.to,
+					   logp: t.hasOwnProperty('logp') ? t.logp : 0,
+					   word: Utf8Encode(t.hasOwnProperty('word') ? t.word : "")});
+	    });
+	    var output = recognizer[command](parseInt(data.id), transitions);
+	    if (output != Module.ReturnType.SUCCESS) post({status: "error", command: command, code: output});
+	    else post({id: clbId, status: "done", command: command});
+	    transitions.delete();
+	} else post({status: "error", command: command, code: "js-data"});
+    } else post({status: "error", command: command, code: "js-no-recognizer"});
+}
+
+function removeWord(data, clbId) {
+    if (recognizer) {
+	if (data.hasOwnProperty('id') && data.hasOwnProperty('word')) {
+	    var output = recognizer.removeWord(parseInt(data.id), Utf8Encode(data.word));
+	    if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "removeWord", code: output});
+	    else post({id: clbId, status: "done", command: "removeWord"});
+	} else post({status: "error", command: "removeWord", code: "js-data"});
+    } else post({status: "error", command: "removeWord", code: "js-no-recognizer"});
+}
+
 function lookupWord(data, clbId) {
     if (recognizer) {
 	var output = recognizer.lookupWord(Utf8Encode(data));
@@ -242,10 +399,107 @@ function addKeyword(data, clbId) {
     } else post({status: "error", command: "addKeyword", code: "js-no-recognizer"});
 }
 
+function addLanguageModel(data, clbId) {
+    if (recognizer) {
+	if (data.hasOwnProperty('name') && data.hasOwnProperty('path')) {
+	    var id_v = new Module.Integers();
+	    var output = recognizer.addLanguageModel(id_v, data.name, data.path);
+	    if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "addLanguageModel", code: output});
+	    else post({id: clbId, data: id_v.get(0), status: "done", command: "addLanguageModel"});
+	    id_v.delete();
+	} else post({status: "error", command: "addLanguageModel", code: "js-data"});
+    } else post({status: "error", command: "addLanguageModel", code: "js-no-recognizer"});
+}
+
+function selectLanguageModel(data, clbId) {
+    if (recognizer) {
+	var output = recognizer.selectLanguageModel(data);
+	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "selectLanguageModel", code: output});
+	else post({id: clbId, status: "done", command: "selectLanguageModel"});
+    } else post({status: "error", command: "selectLanguageModel", code: "js-no-recognizer"});
+}
+
+function interpolateLanguageModels(data, clbId) {
+    if (recognizer) {
+	if (data.hasOwnProperty('names') && data.hasOwnProperty('weights')) {
+	    var names = new Module.StringList();
+	    var weights = new Module.Feats();
+	    data.names.forEach(function(name) {names.push_back(name);});
+	    data.weights.forEach(function(weight) {weights.push_back(weight);});
+	    var output = recognizer.interpolateLanguageModels(names, weights);
+	    if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "interpolateLanguageModels", code: output});
+	    else post({id: clbId, status: "done", command: "interpolateLanguageModels"});
+	    names.delete();
+	    weights.delete();
+	} else post({status: "error", command: "interpolateLanguageModels", code: "js-data"});
+    } else post({status: "error", command: "interpolateLanguageModels", code: "js-no-recognizer"});
+}
+
+function exportAdaptationState(clbId) {
+    if (recognizer) {
+	var state = new Module.Feats();
+	var output = recognizer.exportAdaptationState(state);
+	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "exportAdaptationState", code: output});
+	else {
+	    var data = [];
+	    for (var i = 0 ; i < state.size() ; i++) data.push(state.get(i));
+	    post({id: clbId, data: data, status: "done", command: "exportAdaptationState"});
+	}
+	state.delete();
+    } else post({status: "error", command: "exportAdaptationState", code: "js-no-recognizer"});
+}
+
+// The trace is complete up to the last stop, it can be replayed
+// with pocketsphinx_replay
+function getTrace(clbId) {
+    if (recognizer) {
+	if (tracePath) {
+	    try {
+		var data = FS.readFile(tracePath);
+		post({id: clbId, data: data, status: "done", command: "getTrace"});
+	    } catch (e) {
+		post({status: "error", command: "getTrace", code: "js-no-trace"});
+	    }
+	} else post({status: "error", command: "getTrace", code: "js-no-trace"});
+    } else post({status: "error", command: "getTrace", code: "js-no-recognizer"});
+}
+
+function importAdaptationState(data, clbId) {
+    if (recognizer) {
+	var state = new Module.Feats();
+	for (var i = 0 ; i < data.length ; i++) state.push_back(data[i]);
+	var output = recognizer.importAdaptationState(state);
+	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "importAdaptationState", code: output});
+	else post({id: clbId, status: "done", command: "importAdaptationState"});
+	state.delete();
+    } else post({status: "error", command: "importAdaptationState", code: "js-no-recognizer"});
+}
+
+function setLatencyBudget(data, clbId) {
+    if (recognizer) {
+	if (data.hasOwnProperty('targetRtf')) {
+	    var output = recognizer.setLatencyBudget(data.targetRtf, data.hasOwnProperty('minScale') ? data.minScale : 0.3);
+	    if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "setLatencyBudget", code: output});
+	    else post({id: clbId, status: "done", command: "setLatencyBudget"});
+	} else post({status: "error", command: "setLatencyBudget", code: "js-data"});
+    } else post({status: "error", command: "setLatencyBudget", code: "js-no-recognizer"});
+}
+
+// id is one search, or an array of searches to run together
 function start(id) {
     if (recognizer) {
 	var output;
-	output = recognizer.switchSearch(parseInt(id));
+	if (Array.isArray(id)) {
+	    var ids = new Module.Integers();
+	    for (var i = 0 ; i < id.length ; i++) ids.push_back(parseInt(id[i]));
+	    output = recognizer.setSearches(ids);
+	    ids.delete();
+	    if (!searchHyps) searchHyps = new Module.SearchHyps();
+	} else {
+	    output = recognizer.switchSearch(parseInt(id));
+	    if (searchHyps) searchHyps.delete();
+	    searchHyps = undefined;
+	}
 	if (output != Module.ReturnType.SUCCESS) {
 	    post({status: "error", command: "switchgrammar", code: output});
 	    return;
@@ -264,16 +518,69 @@ function stop() {
 	if (output != Module.ReturnType.SUCCESS)
 	    post({status: "error", command: "stop", code: output});
 	else {
+	    postEvents();
 	    recognizer.getHypseg(segmentation);
-	    post({hyp: Utf8Decode(recognizer.getHyp()),
-		  hypseg: segToArray(segmentation),
-		  final: true});
+	    var message = {hyp: Utf8Decode(recognizer.getHyp()),
+			   hypseg: segToArray(segmentation),
+			   final: true};
+	    if (searchHyps) message.hyps = searchHypsToArray();
+	    post(message);
 	}
     } else {
 	post({status: "error", command: "stop", code: "js-no-recognizer"});
     }
 }
 
+function setFeatureStore(data, clbId) {
+    if (recognizer) {
+	var output = recognizer.setFeatureStore(parseInt(data));
+	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "setFeatureStore", code: output});
+	else post({id: clbId, status: "done", command: "setFeatureStore"});
+    } else post({status: "error", command: "setFeatureStore", code: "js-no-recognizer"});
+}
+
+function reprocess(id) {
+    if (recognizer) {
+	var output = recognizer.reprocess(parseInt(id));
+	if (output != Module.ReturnType.SUCCESS)
+	    post({status: "error", command: "reprocess", code: output});
+	else {
+	    recognizer.getHypseg(segmentation);
+	    post({hyp: Utf8Decode(recognizer.getHyp()),
+		  hypseg: segToArray(segmentation),
+		  final: true});
+	}
+    } else post({status: "error", command: "reprocess", code: "js-no-recognizer"});
+}
+
+function setContinuous(data, clbId) {
+    if (recognizer) {
+	var maxFrames = data.hasOwnProperty('maxFrames') ? data.maxFrames : 0;
+	var output = recognizer.setContinuous(maxFrames,
+					      data.hasOwnProperty('silenceFrames') ? data.silenceFrames : 0,
+					      data.hasOwnProperty('historySize') ? data.historySize : 100);
+	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "setContinuous", code: output});
+	else {
+	    if (history) history.delete();
+	    history = (maxFrames > 0) ? new Module.Segmentation() : undefined;
+	    post({id: clbId, status: "done", command: "setContinuous"});
+	}
+    } else post({status: "error", command: "setContinuous", code: "js-no-recognizer"});
+}
+
+function setEventQueue(data, clbId) {
+    if (recognizer) {
+	var size = parseInt(data);
+	var output = recognizer.setEventQueue(size);
+	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: "setEventQueue", code: output});
+	else {
+	    if (events) events.delete();
+	    events = (size > 0) ? new Module.Events() : undefined;
+	    post({id: clbId, status: "done", command: "setEventQueue"});
+	}
+    } else post({status: "error", command: "setEventQueue", code: "js-no-recognizer"});
+}
+
 function process(array) {
     if (recognizer) {
 	while (buffer.size() < array.length)
@@ -283,12 +590,127 @@ function process(array) {
 	var output = recognizer.process(buffer);
 	if (output != Module.ReturnType.SUCCESS)
 	    post({status: "error", command: "process", code: output});
-	else {
+	else if (events) {
+	    // Events replace the hypothesis of every buffer
+	    postEvents();
+	} else {
 	    recognizer.getHypseg(segmentation);
-	    post({hyp: Utf8Decode(recognizer.getHyp()),
-		  hypseg: segToArray(segmentation)});
+	    var message = {hyp: Utf8Decode(recognizer.getHyp()),
+			   hypseg: segToArray(segmentation)};
+	    if (history) {
+		recognizer.getHistory(history);
+		message.history = segToArray(history);
+	    }
+	    if (searchHyps) message.hyps = searchHypsToArray();
+	    post(message);
 	    }
     } else {
 	post({status: "error", command: "process", code: "js-no-recognizer"});
     }
 }
+
+// data is {text: "HELLO WORLD", audio: array, priority: 0}, without
+// audio the stored utterance is used. Messages of the form
+// {command: "pronFeatex", job: callbackId, progress: 0.4} follow
+// the progress of the job until its result comes back
+function queueJob(command, data, clbId) {
+    if (recognizer) {
+	if (data && data.hasOwnProperty('text')) {
+	    var job = {command: command, data: data, id: clbId,
+		       priority: data.hasOwnProperty('priority') ? data.priority : 0};
+	    var i = jobs.length;
+	    while ((i > 0) && (jobs[i - 1].priority < job.priority)) i--;
+	    jobs.splice(i, 0, job);
+	    scheduleJobs();
+	} else post({status: "error", command: command, code: "js-data"});
+    } else post({status: "error", command: command, code: "js-no-recognizer"});
+}
+
+function scheduleJobs() {
+    if (!jobTimer && (runningJob || (jobs.length > 0)))
+	jobTimer = setTimeout(runJobs, 0);
+}
+
+function runJobs() {
+    jobTimer = undefined;
+    if (!recognizer) return;
+    if (!runningJob && (jobs.length > 0)) {
+	var job = jobs.shift();
+	var audio = new Module.AudioBuffer();
+	var array = job.data.audio || [];
+	for (var i = 0 ; i < array.length ; i++) audio.push_back(array[i]);
+	var output = recognizer.startJob((job.command == 'wordAlign') ? Module.JobType.ALIGN_JOB : Module.JobType.FEATEX_JOB,
+					 audio, Utf8Encode(job.data.text));
+	audio.delete();
+	if (output != Module.ReturnType.SUCCESS) post({status: "error", command: job.command, code: output});
+	else runningJob = job;
+    } else if (runningJob) {
+	var output = recognizer.runJob(jobSliceMs);
+	var status = recognizer.getJobStatus();
+	if (output != Module.ReturnType.SUCCESS) {
+	    post({status: "error", command: runningJob.command, code: output});
+	    runningJob = undefined;
+	} else if (status.done) {
+	    postJobResult(runningJob);
+	    runningJob = undefined;
+	} else post({command: runningJob.command, job: runningJob.id, progress: status.progress});
+    }
+    scheduleJobs();
+}
+
+function postJobResult(job) {
+    var data;
+    if (job.command == 'wordAlign') {
+	recognizer.getWordAlignSeg(segmentation);
+	data = segToArray(segmentation);
+    } else {
+	var feats = new Module.Feats();
+	var phones = new Module.Feats();
+	var words = new Module.Feats();
+	recognizer.getJobFeats(feats);
+	data = {feats: []};
+	for (var i = 0 ; i < feats.size() ; i++) data.feats.push(feats.get(i));
+	if (recognizer.getPronScores(phones, words) == Module.ReturnType.SUCCESS) {
+	    data.phoneScores = [];
+	    data.wordScores = [];
+	    for (var i = 0 ; i < phones.size() ; i++) data.phoneScores.push(phones.get(i));
+	    for (var i = 0 ; i < words.size() ; i++) data.wordScores.push(words.get(i));
+	}
+	feats.delete();
+	phones.delete();
+	words.delete();
+    }
+    post({id: job.id, data: data, status: "done", command: job.command});
+}
+
+// data is the callbackId the job was queued with
+function cancelJob(data, clbId) {
+    if (recognizer) {
+	var found = false;
+	for (var i = 0 ; i < jobs.length ; i++) {
+	    if (jobs[i].id === data) {
+		post({status: "error", command: jobs[i].command, code: "js-cancelled"});
+		jobs.splice(i, 1);
+		found = true;
+		break;
+	    }
+	}
+	if (!found && runningJob && (runningJob.id === data)) {
+	    recognizer.cancelJob();
+	    post({status: "error", command: runningJob.command, code: "js-cancelled"});
+	    runningJob = undefined;
+	    found = true;
+	}
+	if (found) post({id: clbId, status: "done", command: "cancelJob"});
+	else post({status: "error", command: "cancelJob", code: "js-data"});
+    } else post({status: "error", command: "cancelJob", code: "js-no-recognizer"});
+}
+
+function cancelJobs() {
+    var cancelled = runningJob ? [runningJob].concat(jobs) : jobs;
+    cancelled.forEach(function(job) {
+	post({status: "error", command: job.command, code: "js-cancelled"});
+    });
+    jobs = [];
+    runningJob = undefined;
+}